@@ -0,0 +1,258 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "BufferPool.h"
+
+#include <GLES3/gl3.h>
+
+#include <iterator>
+
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+// static
+BufferPool &BufferPool::Get() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::~BufferPool() {
+    stopAllocator();
+}
+
+BufferPool::Lease BufferPool::lease(uint32_t width, uint32_t height) {
+    EGLDisplay display = eglGetCurrentDisplay();
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        Lease lease;
+        if (takeIdleLocked(width, height, display, lease)) {
+            return lease;
+        }
+    }
+    return allocate(width, height);
+}
+
+std::shared_ptr<BufferPool::PendingLeases> BufferPool::leaseAsync(uint32_t width, uint32_t height,
+                                                                  int count) {
+    auto pending = std::make_shared<PendingLeases>();
+    pending->mWidth = width;
+    pending->mHeight = height;
+    EGLDisplay display = eglGetCurrentDisplay();
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (static_cast<int>(pending->mLeases.size()) < count) {
+        Lease lease;
+        if (!takeIdleLocked(width, height, display, lease)) {
+            break;
+        }
+        pending->mLeases.push_back(std::move(lease));
+    }
+    pending->mCount = count - static_cast<int>(pending->mLeases.size());
+    if (pending->mCount == 0) {
+        pending->mReady.store(true, std::memory_order_release);
+        return pending;
+    }
+    startAllocatorLocked();
+    mRequests.push_back(pending);
+    mAllocatorCondition.notify_one();
+    return pending;
+}
+
+void BufferPool::cancel(const std::shared_ptr<PendingLeases> &pending) {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!pending->isReady()) {
+            // The allocation thread recycles them when it gets there.
+            pending->mCancelled = true;
+            return;
+        }
+    }
+    for (auto &lease: pending->take()) {
+        recycle(std::move(lease), pending->mWidth, pending->mHeight);
+    }
+}
+
+void BufferPool::recycle(Lease lease, uint32_t width, uint32_t height) {
+    Entry entry;
+    entry.lease = std::move(lease);
+    entry.display = eglGetCurrentDisplay();
+    entry.width = width;
+    entry.height = height;
+
+    std::list<Entry> evicted;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mStats.idleBytes += entry.bytes();
+        mIdle.push_front(std::move(entry));
+        evicted = evictLocked();
+    }
+    for (auto &victim: evicted) {
+        destroy(victim);
+    }
+}
+
+void BufferPool::setMemoryCap(size_t bytes) {
+    std::list<Entry> evicted;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mMemoryCap = bytes;
+        evicted = evictLocked();
+    }
+    for (auto &victim: evicted) {
+        destroy(victim);
+    }
+}
+
+void BufferPool::clear() {
+    stopAllocator();
+
+    std::list<Entry> idle;
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        idle.swap(mIdle);
+        mStats.idleBytes = 0;
+    }
+    for (auto &entry: idle) {
+        destroy(entry);
+    }
+}
+
+BufferPool::Stats BufferPool::stats() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+bool BufferPool::takeIdleLocked(uint32_t width, uint32_t height, EGLDisplay display,
+                                Lease &lease) {
+    for (auto it = mIdle.begin(); it != mIdle.end(); ++it) {
+        if (it->width == width && it->height == height && it->display == display) {
+            lease = std::move(it->lease);
+            mStats.idleBytes -= it->bytes();
+            mStats.hits++;
+            mIdle.erase(it);
+            return true;
+        }
+    }
+    mStats.misses++;
+    return false;
+}
+
+std::list<BufferPool::Entry> BufferPool::evictLocked() {
+    std::list<Entry> evicted;
+    while (mStats.idleBytes > mMemoryCap) {
+        mStats.idleBytes -= mIdle.back().bytes();
+        mStats.evictions++;
+        evicted.splice(evicted.begin(), mIdle, std::prev(mIdle.end()));
+    }
+    return evicted;
+}
+
+// static
+BufferPool::Lease BufferPool::allocate(uint32_t width, uint32_t height) {
+    Lease lease;
+    lease.buffer.reset(platform::allocateBuffer(width, height));
+    if (!lease.buffer) {
+        return {};
+    }
+    lease.eglImage = platform::createEGLImage(eglGetCurrentDisplay(), lease.buffer.get());
+    if (lease.eglImage == EGL_NO_IMAGE_KHR) {
+        return {};
+    }
+    return lease;
+}
+
+// static
+void BufferPool::destroy(Entry &entry) {
+    if (entry.lease.eglImage != EGL_NO_IMAGE_KHR) {
+        platform::destroyEGLImage(entry.display, entry.lease.eglImage);
+    }
+    entry.lease.buffer = nullptr;
+}
+
+void BufferPool::startAllocatorLocked() {
+    if (mAllocator.joinable()) {
+        return;
+    }
+    // The allocation context is created like the caller's, on the same display.
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLint configId = 0;
+    eglQueryContext(display, eglGetCurrentContext(), EGL_CONFIG_ID, &configId);
+    EGLint configAttribs[] = {
+            EGL_CONFIG_ID, configId,
+            EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint numConfigs = 0;
+    eglChooseConfig(display, configAttribs, &config, 1, &numConfigs);
+
+    mStopAllocator = false;
+    mAllocator = std::thread([this, display, config] { runAllocator(display, config); });
+}
+
+void BufferPool::stopAllocator() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (!mAllocator.joinable()) {
+            return;
+        }
+        mStopAllocator = true;
+        mAllocatorCondition.notify_one();
+    }
+    mAllocator.join();
+    mAllocator = std::thread();
+}
+
+void BufferPool::runAllocator(EGLDisplay display, EGLConfig config) {
+    EGLint contextAttribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 3,
+            EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        LOGE("Failed to create EGL context for buffer allocation");
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    // Pending requests are finished before stopping, nobody waits forever.
+    while (!mStopAllocator || !mRequests.empty()) {
+        if (mRequests.empty()) {
+            mAllocatorCondition.wait(lock);
+            continue;
+        }
+        auto pending = std::move(mRequests.front());
+        mRequests.pop_front();
+        if (pending->mCancelled) {
+            continue;
+        }
+        lock.unlock();
+        for (int i = 0; i < pending->mCount; i++) {
+            Lease lease = allocate(pending->mWidth, pending->mHeight);
+            if (!lease.buffer) {
+                break;
+            }
+            pending->mLeases.push_back(std::move(lease));
+        }
+        // Host buffers are GL textures, their storage has to exist before another context uses
+        // them.
+        glFinish();
+        lock.lock();
+        if (pending->mCancelled) {
+            lock.unlock();
+            for (auto &lease: pending->mLeases) {
+                recycle(std::move(lease), pending->mWidth, pending->mHeight);
+            }
+            lock.lock();
+        } else {
+            pending->mReady.store(true, std::memory_order_release);
+        }
+    }
+    lock.unlock();
+
+    if (context != EGL_NO_CONTEXT) {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+    }
+}
@@ -0,0 +1,122 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_BUFFERPOOL_H
+#define HELLOSURFACECONTROL_BUFFERPOOL_H
+
+#include <EGL/egl.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Platform.h"
+#include "ScopedFd.h"
+
+// Process wide pool of idle buffers with their EGLImages, keyed by size. BufferQueues lease their
+// buffers from it and give them back when they resize or go away, so bouncing between a few sizes
+// or recreating surfaces does not go back to the allocator nor re-import the EGLImage. Format and
+// usage are fixed by platform::allocateBuffer(), so the size is the whole key.
+//
+// Idle buffers are evicted least recently returned first once they take more than the memory cap.
+// Thread safe. Leasing needs a current EGL context, the EGLImages are per display and can be used
+// with any context of it. leaseAsync() allocates on a background thread with its own context, so
+// the caller's thread does not stall on the allocator.
+class BufferPool {
+public:
+    struct Lease {
+        platform::UniqueBuffer buffer;
+        EGLImage eglImage = EGL_NO_IMAGE;
+        // Signals when the last reader of a recycled buffer is done, -1 if there is none.
+        ScopedFd releaseFenceFd;
+    };
+
+    class PendingLeases {
+    public:
+        bool isReady() const { return mReady.load(std::memory_order_acquire); }
+        // Only once isReady(). Buffers that failed to allocate are missing.
+        std::vector<Lease> take() { return std::move(mLeases); }
+
+    private:
+        friend class BufferPool;
+
+        uint32_t mWidth = 0;
+        uint32_t mHeight = 0;
+        int mCount = 0;
+        std::vector<Lease> mLeases;
+        std::atomic<bool> mReady{false};
+        // Guarded by BufferPool::mMutex.
+        bool mCancelled = false;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        size_t idleBytes = 0;
+    };
+
+    static BufferPool &Get();
+
+    // Returns an idle buffer of this size or allocates one. |buffer| is null on failure.
+    Lease lease(uint32_t width, uint32_t height);
+    // |count| buffers of this size, ready right away if the pool has them.
+    std::shared_ptr<PendingLeases> leaseAsync(uint32_t width, uint32_t height, int count);
+    // Returns the leases to the pool, now or once they are allocated.
+    void cancel(const std::shared_ptr<PendingLeases> &pending);
+    // The compositor may still read |lease| until its releaseFenceFd signals.
+    void recycle(Lease lease, uint32_t width, uint32_t height);
+
+    // 0 disables pooling.
+    void setMemoryCap(size_t bytes);
+    // Destroys every idle buffer and stops the allocation thread, before the EGL display goes away.
+    void clear();
+
+    Stats stats();
+
+private:
+    struct Entry {
+        Lease lease;
+        EGLDisplay display = EGL_NO_DISPLAY;
+        uint32_t width = 0;
+        uint32_t height = 0;
+
+        size_t bytes() const { return static_cast<size_t>(width) * height * 4; }
+    };
+
+    BufferPool() = default;
+    ~BufferPool();
+
+    static Lease allocate(uint32_t width, uint32_t height);
+    static void destroy(Entry &entry);
+    // Called with mMutex held.
+    bool takeIdleLocked(uint32_t width, uint32_t height, EGLDisplay display, Lease &lease);
+    // Called with mMutex held, returns the entries to destroy outside of it.
+    std::list<Entry> evictLocked();
+
+    std::mutex mMutex;
+    // Most recently returned first.
+    std::list<Entry> mIdle;
+    size_t mMemoryCap = 64 * 1024 * 1024;
+    Stats mStats;
+
+    void startAllocatorLocked();
+    void stopAllocator();
+    void runAllocator(EGLDisplay display, EGLConfig config);
+
+    std::thread mAllocator;
+    std::condition_variable mAllocatorCondition;
+    std::deque<std::shared_ptr<PendingLeases>> mRequests;
+    bool mStopAllocator = false;
+};
+
+
+#endif //HELLOSURFACECONTROL_BUFFERPOOL_H
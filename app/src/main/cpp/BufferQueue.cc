@@ -4,192 +4,758 @@
 
 #include "BufferQueue.h"
 
+#include <algorithm>
 #include <cassert>
-#include <EGL/eglext.h>
+#include <thread>
+#include <poll.h>
 #include <unistd.h>
 
+#include "FrameTracer.h"
 #include "GLFence.h"
 #include "Log.h"
+#include "MultisampleTarget.h"
 
 #define LOG_TAG "SurfaceControlApp"
 
 constexpr int kBufferCount = 3;
+constexpr int kMinBufferCount = 2;
+constexpr int kMaxAdaptiveBufferCount = 4;
+// Starved frames within a window that add an image.
+constexpr int kGrowAfterStarvedFrames = 3;
+constexpr uint64_t kStarvationWindowFrames = 60;
+constexpr int64_t kShrinkDelayNanos = 1'000'000'000;
+constexpr int64_t kMaxShrinkDelayNanos = 32'000'000'000;
+constexpr size_t kDefaultMemoryBudget = 128 * 1024 * 1024;
+
+static std::atomic<size_t> sMemoryBudget{kDefaultMemoryBudget};
+// Of every queue's current and retired rings.
+static std::atomic<size_t> sBufferBytes{0};
+#if !defined(__ANDROID__)
+static std::atomic<void (*)()> sReleaseHook{nullptr};
+#endif
 
-BufferQueue::BufferQueue(VkDevice device) : mDevice(device) {}
+static size_t bufferBytes(int width, int height) {
+    return static_cast<size_t>(width) * height * 4;
+}
 
-BufferQueue::~BufferQueue() {
-    releaseBuffers();
-}
-
-void BufferQueue::createBuffers() {
-    assert(mBuffers.empty());
-    assert(mImages.empty());
-
-    // Create buffers
-    for (int i = 0; i < kBufferCount; i++) {
-        AHardwareBuffer *buffer = nullptr;
-        AHardwareBuffer_Desc desc = {};
-        desc.width = mWidth;
-        desc.height = mHeight;
-        desc.layers = 1;
-        desc.format = AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
-        desc.usage =
-                AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE | AHARDWAREBUFFER_USAGE_GPU_FRAMEBUFFER |
-                AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY;
-        int res = AHardwareBuffer_allocate(&desc, &buffer);\
-        if (res != 0) {
-            LOGE("Failed to allocate AHardwareBuffer");
-            return;
-        }
-        mBuffers.emplace_back(buffer);
-
-
-        // Import the AHardwareBuffer to the EGLImage
-        EGLClientBuffer clientBuffer = eglGetNativeClientBufferANDROID(buffer);
-        EGLImage eglImage = eglCreateImageKHR(eglGetCurrentDisplay(), EGL_NO_CONTEXT,
-                                              EGL_NATIVE_BUFFER_ANDROID,
-                                              clientBuffer, nullptr);
-        if (eglImage == EGL_NO_IMAGE_KHR) {
-            LOGE("Failed to create EGL image");
-            return;
-        }
-        mEGLImages.push_back(eglImage);
-
-        mAvailableImages.push_back(std::make_unique<Image>(buffer, eglImage));
-#if 0
-        // Create a VkImage with external memory support
-        VkExternalMemoryImageCreateInfo externalMemoryImageCreateInfo = {};
-        externalMemoryImageCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
-        externalMemoryImageCreateInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_ANDROID_HARDWARE_BUFFER_BIT_ANDROID;
-
-        VkImageCreateInfo imageCreateInfo = {};
-        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        imageCreateInfo.pNext = &externalMemoryImageCreateInfo;
-        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-        imageCreateInfo.extent = {static_cast<uint32_t>(desc.width),
-                                  static_cast<uint32_t>(desc.height), 1};
-        imageCreateInfo.mipLevels = 1;
-        imageCreateInfo.arrayLayers = 1;
-        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageCreateInfo.usage =
-                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-        VkImage image = VK_NULL_HANDLE;
-        VkResult result = vkCreateImage(mDevice, &imageCreateInfo, nullptr, &image);
-        if (result != VK_SUCCESS) {
-            LOGE("Failed to create image");
-            return;
-        }
-
-        // Import the AHardwareBuffer to the VkImage
-        VkImportAndroidHardwareBufferInfoANDROID importInfo = {};
-        importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_ANDROID_HARDWARE_BUFFER_INFO_ANDROID;
-        importInfo.buffer = buffer;
-
-        VkMemoryRequirements memRequirements;
-        vkGetImageMemoryRequirements(mDevice, image, &memRequirements);
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memRequirements.size;
-        allocInfo.memoryTypeIndex = 0; // You need to find the proper memory type index
-
-        VkMemoryDedicatedAllocateInfo dedicatedAllocInfo = {};
-        dedicatedAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
-        dedicatedAllocInfo.image = image;
-
-        allocInfo.pNext = &dedicatedAllocInfo;
-
-        VkDeviceMemory memory;
-        result = vkAllocateMemory(mDevice, &allocInfo, nullptr, &memory);
-        if (result != VK_SUCCESS) {
-            LOGE("Failed to allocate memory");
-            return;
-        }
-
-        result = vkBindImageMemory(mDevice, image, memory, 0);
-        if (result != VK_SUCCESS) {
-            LOGE("Failed to bind image memory");
-            return;
-        }
-
-        mImages.push_back(image);
-#endif
+// Empty rects stand for the whole image.
+static platform::Rect uniteDamage(const platform::Rect &a, const platform::Rect &b) {
+    auto isEmpty = [](const platform::Rect &rect) {
+        return rect.left >= rect.right || rect.top >= rect.bottom;
+    };
+    if (isEmpty(a) || isEmpty(b)) {
+        return {};
     }
+    return {std::min(a.left, b.left), std::min(a.top, b.top), std::max(a.right, b.right),
+            std::max(a.bottom, b.bottom)};
+}
+
+BufferQueue::BufferQueue(VkDevice device)
+        : mDevice(device),
+          mBufferCount(kBufferCount),
+          mMinBufferCount(kMinBufferCount),
+          mMaxBufferCount(kMaxAdaptiveBufferCount),
+          mShrinkDelay(kShrinkDelayNanos) {}
+
+// static
+void BufferQueue::SetMemoryBudget(size_t bytes) {
+    sMemoryBudget.store(bytes, std::memory_order_relaxed);
+}
+
+#if !defined(__ANDROID__)
+// static
+void BufferQueue::SetReleaseHookForTesting(void (*hook)()) {
+    sReleaseHook.store(hook, std::memory_order_relaxed);
+}
+#endif
+
+// static
+size_t BufferQueue::GetBufferBytes() {
+    return sBufferBytes.load(std::memory_order_relaxed);
 }
 
-void BufferQueue::releaseBuffers() {
-    // Release old egl images
-    for (auto eglImage: mEGLImages) {
-        eglDestroyImageKHR(eglGetCurrentDisplay(), eglImage);
+BufferQueue::~BufferQueue() {
+    cancelPendingResize();
+    if (mRetired) {
+        releaseBuffers(*mRetired, false);
     }
-    mEGLImages.clear();
+    releaseBuffers(*mCurrent, false);
 
+#if defined(__ANDROID__)
     // Release old images
     for (auto image: mImages) {
         vkDestroyImage(mDevice, image, nullptr);
     }
+#endif
     mImages.clear();
+}
+
+void BufferQueue::createBuffers(SlotSet &set, std::vector<BufferPool::Lease> leases) {
+    assert(set.bufferCount == 0);
+    static_assert(kBufferCount <= kMaxBufferCount);
 
-    mBuffers.clear();
+    // Reserved once, the ring grows without allocating.
+    set.buffers.reserve(kMaxBufferCount);
+    for (auto &lease: leases) {
+        addSlot(set, std::move(lease));
+        set.ring[set.bufferCount - 1] = static_cast<uint8_t>(set.bufferCount - 1);
+    }
 }
 
-void BufferQueue::resize(int width, int height) {
-    if (mWidth == width && mHeight == height) {
+BufferQueue::Slot &BufferQueue::addSlot(SlotSet &set, BufferPool::Lease lease) {
+    set.buffers.push_back(std::move(lease));
+    auto &added = set.buffers.back();
+    platform::Buffer *buffer = added.buffer.get();
+    EGLImage eglImage = added.eglImage;
+
+    Slot &slot = set.slots[set.bufferCount++];
+    slot.image = Image(buffer, eglImage);
+    // A recycled buffer may still be read by its previous owner's compositor.
+    slot.image.fenceFd = std::move(added.releaseFenceFd);
+
+    glGenTextures(1, &slot.image.texture);
+    glBindTexture(platform::kBufferTextureTarget, slot.image.texture);
+    platform::bindEGLImageAsTexture(platform::kBufferTextureTarget, eglImage);
+    glBindTexture(platform::kBufferTextureTarget, 0);
+
+    glGenFramebuffers(1, &slot.image.framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, slot.image.framebuffer);
+    MultisampleTarget::AttachTexture(platform::kBufferTextureTarget, slot.image.texture,
+                                     mRenderToTextureSamples);
+    if (mDepthStencil != 0) {
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                                  mDepthStencil);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    slot.state.store(SlotState::AVAILABLE, std::memory_order_relaxed);
+    sBufferBytes.fetch_add(bufferBytes(set.width, set.height), std::memory_order_relaxed);
+#if 0
+    // Create a VkImage with external memory support
+    VkExternalMemoryImageCreateInfo externalMemoryImageCreateInfo = {};
+    externalMemoryImageCreateInfo.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+    externalMemoryImageCreateInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_ANDROID_HARDWARE_BUFFER_BIT_ANDROID;
+
+    VkImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.pNext = &externalMemoryImageCreateInfo;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageCreateInfo.extent = {static_cast<uint32_t>(mWidth),
+                              static_cast<uint32_t>(mHeight), 1};
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImage image = VK_NULL_HANDLE;
+    VkResult result = vkCreateImage(mDevice, &imageCreateInfo, nullptr, &image);
+    if (result != VK_SUCCESS) {
+        LOGE("Failed to create image");
+        return slot;
+    }
+
+    // Import the AHardwareBuffer to the VkImage
+    VkImportAndroidHardwareBufferInfoANDROID importInfo = {};
+    importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_ANDROID_HARDWARE_BUFFER_INFO_ANDROID;
+    importInfo.buffer = buffer;
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(mDevice, image, &memRequirements);
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = 0; // You need to find the proper memory type index
+
+    VkMemoryDedicatedAllocateInfo dedicatedAllocInfo = {};
+    dedicatedAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedAllocInfo.image = image;
+
+    allocInfo.pNext = &dedicatedAllocInfo;
+
+    VkDeviceMemory memory;
+    result = vkAllocateMemory(mDevice, &allocInfo, nullptr, &memory);
+    if (result != VK_SUCCESS) {
+        LOGE("Failed to allocate memory");
+        return slot;
+    }
+
+    result = vkBindImageMemory(mDevice, image, memory, 0);
+    if (result != VK_SUCCESS) {
+        LOGE("Failed to bind image memory");
+        return slot;
+    }
+
+    mImages.push_back(image);
+#endif
+
+    return slot;
+}
+
+void BufferQueue::removeLastSlot(SlotSet &set) {
+    Slot &slot = set.slots[set.bufferCount - 1];
+    assert(slot.state.load(std::memory_order_relaxed) == SlotState::AVAILABLE);
+    Image &image = slot.image;
+    glDeleteFramebuffers(1, &image.framebuffer);
+    glDeleteTextures(1, &image.texture);
+
+    auto &lease = set.buffers.back();
+    lease.releaseFenceFd = std::move(image.fenceFd);
+    BufferPool::Get().recycle(std::move(lease), set.width, set.height);
+    set.buffers.pop_back();
+    image = Image();
+    set.bufferCount--;
+    sBufferBytes.fetch_sub(bufferBytes(set.width, set.height), std::memory_order_relaxed);
+}
+
+bool BufferQueue::releaseBuffers(SlotSet &set, bool keepPresenting) {
+    bool kept = false;
+    for (int i = 0; i < set.bufferCount; i++) {
+        Slot &slot = set.slots[i];
+        Image &image = slot.image;
+        glDeleteFramebuffers(1, &image.framebuffer);
+        glDeleteTextures(1, &image.texture);
+        image.framebuffer = 0;
+        image.texture = 0;
+        image.fence = nullptr;
+
+        auto &lease = set.buffers[i];
+        if (!lease.buffer) {
+            continue;
+        }
+        // Pairs with the release store in releasePresentImage() so the fence fd is visible.
+        if (slot.state.load(std::memory_order_acquire) != SlotState::PRESENTING) {
+            // Whoever leases it next waits for the compositor to be done with it.
+            lease.releaseFenceFd = std::move(image.fenceFd);
+            BufferPool::Get().recycle(std::move(lease), set.width, set.height);
+            lease = {};
+        } else if (keepPresenting) {
+            kept = true;
+        } else {
+            // Dropped, the buffer goes away with the compositor's last reference.
+            platform::destroyEGLImage(eglGetCurrentDisplay(), lease.eglImage);
+            lease = {};
+        }
+    }
+    if (!kept) {
+        resetSlotSet(set);
+    }
+    return kept;
+}
+
+void BufferQueue::resetSlotSet(SlotSet &set) {
+    sBufferBytes.fetch_sub(set.bufferCount * bufferBytes(set.width, set.height),
+                           std::memory_order_relaxed);
+    for (int i = 0; i < set.bufferCount; i++) {
+        set.slots[i].image = Image();
+        set.slots[i].state.store(SlotState::AVAILABLE, std::memory_order_relaxed);
+    }
+    set.buffers.clear();
+    set.bufferCount = 0;
+    set.presentCount = 0;
+    set.releaseCount.store(0, std::memory_order_relaxed);
+}
+
+void BufferQueue::sweepRetired() {
+    if (!mRetired) {
         return;
     }
+    bool outstanding = false;
+    for (int i = 0; i < mRetired->bufferCount; i++) {
+        Slot &slot = mRetired->slots[i];
+        auto &lease = mRetired->buffers[i];
+        if (!lease.buffer) {
+            continue;
+        }
+        if (slot.state.load(std::memory_order_acquire) == SlotState::PRESENTING) {
+            outstanding = true;
+            continue;
+        }
+        lease.releaseFenceFd = std::move(slot.image.fenceFd);
+        BufferPool::Get().recycle(std::move(lease), mRetired->width, mRetired->height);
+        lease = {};
+    }
+    if (!outstanding) {
+        resetSlotSet(*mRetired);
+        mRetired = nullptr;
+    }
+}
+
+void BufferQueue::switchBuffers(std::vector<BufferPool::Lease> leases, int width, int height) {
+    assert(!mCurrentProduceSlot);
+    if (mRetired) {
+        // A synchronous resize does not wait for the one before to drain. Releases still due for
+        // its images are ignored from here on, and those already past the generation check are
+        // waited for, so none of them touches the set while it is torn down and rebuilt.
+        // Sequentially consistent like the other side in releasePresentImage(): either the
+        // release sees kNoGeneration or this sees it in flight.
+        mRetired->generation.store(kNoGeneration);
+        while (mRetired->releasesInFlight.load() != 0) {
+            std::this_thread::yield();
+        }
+        releaseBuffers(*mRetired, false);
+        mRetired = nullptr;
+    }
 
+    SlotSet *previous = mCurrent;
+    SlotSet &next = mCurrent == &mSets[0] ? mSets[1] : mSets[0];
+    next.width = width;
+    next.height = height;
+    createBuffers(next, std::move(leases));
+    // Generations alternate between the two sets, see releasePresentImage().
+    uint32_t generation = ++mGeneration;
+    for (int i = 0; i < next.bufferCount; i++) {
+        next.slots[i].image.generation = generation;
+    }
+    next.generation.store(generation, std::memory_order_release);
+    mCurrent = &next;
     mWidth = width;
     mHeight = height;
+    mProduceSlot = 0;
+    mPresentSlot = 0;
+    mProducedFrameCount = 0;
+    mStarvedFrames = 0;
+    mStarvationWindowStart = 0;
+    mSpareSince = 0;
+    mStats.bufferCount.store(next.bufferCount, std::memory_order_relaxed);
+
+    // Images produced at the old size and not presented yet are dropped.
+    if (releaseBuffers(*previous, true)) {
+        mRetired = previous;
+    }
+}
+
+void BufferQueue::attachDepthStencil(GLuint renderbuffer) {
+    // Images added later get it too.
+    mDepthStencil = renderbuffer;
+    for (int i = 0; i < mCurrent->bufferCount; i++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, mCurrent->slots[i].image.framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                                  renderbuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            LOGE("Framebuffer is not complete");
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void BufferQueue::setRenderToTextureSamples(int samples) {
+    // Images added later get it too.
+    mRenderToTextureSamples = samples;
+    for (int i = 0; i < mCurrent->bufferCount; i++) {
+        const Image &image = mCurrent->slots[i].image;
+        glBindFramebuffer(GL_FRAMEBUFFER, image.framebuffer);
+        MultisampleTarget::AttachTexture(platform::kBufferTextureTarget, image.texture, samples);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void BufferQueue::resize(int width, int height) {
+    cancelPendingResize();
+    if (mWidth == width && mHeight == height) {
+        return;
+    }
+
+    std::vector<BufferPool::Lease> leases;
+    for (int i = 0; i < mBufferCount; i++) {
+        auto lease = BufferPool::Get().lease(width, height);
+        if (!lease.buffer) {
+            break;
+        }
+        leases.push_back(std::move(lease));
+    }
+    switchBuffers(std::move(leases), width, height);
+}
+
+void BufferQueue::resizeAsync(int width, int height) {
+    if (mPendingLeases && mPendingWidth == width && mPendingHeight == height) {
+        return;
+    }
+    cancelPendingResize();
+    if (mWidth == width && mHeight == height) {
+        return;
+    }
+    mPendingWidth = width;
+    mPendingHeight = height;
+    mPendingLeases = BufferPool::Get().leaseAsync(width, height, mBufferCount);
+}
+
+bool BufferQueue::updateSize() {
+    sweepRetired();
+    // The other set is only free once the compositor released the retired images.
+    if (!mPendingLeases || !mPendingLeases->isReady() || mRetired) {
+        return false;
+    }
+    auto leases = mPendingLeases->take();
+    mPendingLeases = nullptr;
+    switchBuffers(std::move(leases), mPendingWidth, mPendingHeight);
+    return true;
+}
+
+void BufferQueue::setBufferCountRange(int minCount, int maxCount) {
+    mMinBufferCount = std::clamp(minCount, kMinBufferCount, kMaxBufferCount);
+    mMaxBufferCount = std::clamp(maxCount, mMinBufferCount, kMaxBufferCount);
+    mBufferCount = std::clamp(mBufferCount, mMinBufferCount, mMaxBufferCount);
+}
+
+bool BufferQueue::isRingIdle() const {
+    for (int i = 0; i < mCurrent->bufferCount; i++) {
+        SlotState state = mCurrent->slots[i].state.load(std::memory_order_acquire);
+        if (state == SlotState::PRODUCING || state == SlotState::PRODUCED) {
+            return false;
+        }
+    }
+    // Everything produced was presented, both cursors are at the same position.
+    assert(mProduceSlot == mPresentSlot);
+    return true;
+}
+
+bool BufferQueue::updateBufferCount() {
+    if (mCurrent->bufferCount == 0 || mPendingLeases) {
+        return false;
+    }
+    int count = mCurrent->bufferCount;
+    if (mStarvedFrames >= kGrowAfterStarvedFrames) {
+        mStarvedFrames = 0;
+        mSpareSince = 0;
+        if (count >= mMaxBufferCount || !growBuffers()) {
+            return false;
+        }
+        if (mShrinkDelay < kMaxShrinkDelayNanos) {
+            mShrinkDelay *= 2;
+        }
+        return true;
+    }
+    if (count > mMinBufferCount && mSpareSince != 0 &&
+        FrameTracer::now() - mSpareSince >= mShrinkDelay) {
+        mSpareSince = 0;
+        return shrinkBuffers();
+    }
+    // Out of bounds since setBufferCountRange().
+    if (count > mMaxBufferCount) {
+        return shrinkBuffers();
+    }
+    return false;
+}
 
-    releaseBuffers();
-    createBuffers();
+void BufferQueue::trim() {
+    if (mPendingLeases) {
+        return;
+    }
+    while (mCurrent->bufferCount > mMinBufferCount && shrinkBuffers()) {
+    }
+    mSpareSince = 0;
+}
+
+bool BufferQueue::growBuffers() {
+    SlotSet &set = *mCurrent;
+    if (!isRingIdle()) {
+        return false;
+    }
+    size_t bytes = bufferBytes(set.width, set.height);
+    // Racy across queues, the budget may be overshot by a buffer or so.
+    if (sBufferBytes.load(std::memory_order_relaxed) + bytes >
+        sMemoryBudget.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    auto lease = BufferPool::Get().lease(set.width, set.height);
+    if (!lease.buffer) {
+        return false;
+    }
+    int index = set.bufferCount;
+    Slot &slot = addSlot(set, std::move(lease));
+    slot.image.generation = set.generation.load(std::memory_order_relaxed);
+    // The producer takes the new image next, whatever the compositor still holds stays in order
+    // behind it.
+    std::copy_backward(set.ring.begin() + mProduceSlot, set.ring.begin() + index,
+                       set.ring.begin() + index + 1);
+    set.ring[mProduceSlot] = static_cast<uint8_t>(index);
+    mBufferCount = set.bufferCount;
+    mStats.bufferCount.store(set.bufferCount, std::memory_order_relaxed);
+    return true;
+}
+
+bool BufferQueue::shrinkBuffers() {
+    SlotSet &set = *mCurrent;
+    // Only the last slot goes, the others may be referenced by releases still due.
+    int index = set.bufferCount - 1;
+    if (!isRingIdle() ||
+        set.slots[index].state.load(std::memory_order_acquire) != SlotState::AVAILABLE) {
+        return false;
+    }
+    auto position = static_cast<int>(
+            std::find(set.ring.begin(), set.ring.begin() + set.bufferCount, index) -
+            set.ring.begin());
+    std::copy(set.ring.begin() + position + 1, set.ring.begin() + set.bufferCount,
+              set.ring.begin() + position);
+    if (position < mProduceSlot) {
+        mProduceSlot--;
+    }
+    removeLastSlot(set);
+    if (mProduceSlot == set.bufferCount) {
+        mProduceSlot = 0;
+    }
+    mPresentSlot = mProduceSlot;
+    mBufferCount = set.bufferCount;
+    mStats.bufferCount.store(set.bufferCount, std::memory_order_relaxed);
+    return true;
+}
+
+void BufferQueue::cancelPendingResize() {
+    if (!mPendingLeases) {
+        return;
+    }
+    BufferPool::Get().cancel(mPendingLeases);
+    mPendingLeases = nullptr;
+}
+
+bool BufferQueue::isLastImageLatched() const {
+    int presenting = 0;
+    for (int i = 0; i < mCurrent->bufferCount; i++) {
+        SlotState state = mCurrent->slots[i].state.load(std::memory_order_acquire);
+        if (state == SlotState::PRODUCED) {
+            return false;
+        }
+        if (state == SlotState::PRESENTING) {
+            presenting++;
+        }
+    }
+    // The compositor releases an image once it latched the next one, so only the image on screen
+    // may still be out.
+    return presenting <= 1;
 }
 
 const BufferQueue::Image *BufferQueue::produceImage() {
-    std::unique_lock<std::mutex> lock(mMutex);
-    assert(!mCurrentProduceImage);
-    if (mAvailableImages.empty()) {
+    assert(!mCurrentProduceSlot);
+    sweepRetired();
+    if (mCurrent->bufferCount == 0) {
+        mStats.skippedFrames.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    if (mPresentMode == PresentMode::LATEST_ONLY && !isLastImageLatched()) {
+        mStats.throttledFrames.fetch_add(1, std::memory_order_relaxed);
+        mStats.skippedFrames.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Slot &slot = slotAt(mProduceSlot);
+    int64_t now = FrameTracer::now();
+    // Pairs with the release store in releasePresentImage() so the fence fd is visible.
+    if (slot.state.load(std::memory_order_acquire) != SlotState::AVAILABLE) {
+        if (mStarvedSince == 0) {
+            mStarvedSince = now;
+            // Waiting on frames not presented yet is back pressure, more images would not help.
+            bool backPressure = std::any_of(
+                    mCurrent->slots.begin(), mCurrent->slots.begin() + mCurrent->bufferCount,
+                    [](const Slot &other) {
+                        return other.state.load(std::memory_order_relaxed) == SlotState::PRODUCED;
+                    });
+            if (!backPressure) {
+                mStarvedFrames++;
+            }
+        }
+        mSpareSince = 0;
+        mStats.skippedFrames.fetch_add(1, std::memory_order_relaxed);
         return nullptr;
     }
-    mCurrentProduceImage = std::move(mAvailableImages.front());
-    mAvailableImages.pop_front();
-    if (mCurrentProduceImage->fenceFd.isValid()) {
-        mCurrentProduceImage->fence = GLFence::CreateFromFenceFd(
-                std::move(mCurrentProduceImage->fenceFd));
+    if (mStarvedSince != 0) {
+        mStats.starved.record(now - mStarvedSince);
+        FrameTracer::Get().slice("starved", mTraceTrack, mStarvedSince, now);
+        mStarvedSince = 0;
+    }
+    bool signaled = selectSignaledImage();
+    slot.state.store(SlotState::PRODUCING, std::memory_order_relaxed);
+    mProduceSlot = nextSlot(mProduceSlot);
+    mCurrentProduceSlot = &slot;
+
+    if (slotAt(mProduceSlot).state.load(std::memory_order_relaxed) != SlotState::AVAILABLE) {
+        mSpareSince = 0;
+    } else if (mSpareSince == 0) {
+        mSpareSince = now;
+    }
+    if (mProducedFrameCount - mStarvationWindowStart >= kStarvationWindowFrames) {
+        mStarvationWindowStart = mProducedFrameCount;
+        mStarvedFrames = 0;
+    }
+
+    Image &image = slot.image;
+    image.fence = nullptr;
+    if (signaled) {
+        // Nothing to wait for, skip importing the fence.
+        image.fenceFd.reset();
+    } else {
+        image.fence = GLFence::CreateFromFenceFd(std::move(image.fenceFd));
     }
-    return mCurrentProduceImage.get();
+    image.age = image.producedFrame ? static_cast<int>(mProducedFrameCount -
+                                                        image.producedFrame + 1) : 0;
+    image.producedTime = now;
+    return &image;
 }
 
-void BufferQueue::enqueueProducedImage(std::shared_ptr<GLFence> fence) {
-    std::unique_lock<std::mutex> lock(mMutex);
-    assert(mCurrentProduceImage);
-    mCurrentProduceImage->fence = std::move(fence);
-    mProducedImages.push_back(std::move(mCurrentProduceImage));
+static bool isFenceSignaled(const ScopedFd &fenceFd) {
+    if (!fenceFd.isValid()) {
+        return true;
+    }
+    pollfd fd = {fenceFd.get(), POLLIN, 0};
+    return poll(&fd, 1, 0) > 0;
+}
+
+bool BufferQueue::selectSignaledImage() {
+    // Available images form a run starting at the produce cursor, released oldest first.
+    std::array<Slot *, kMaxBufferCount> candidates;
+    int count = 0;
+    for (int position = mProduceSlot; count < mCurrent->bufferCount;
+         position = nextSlot(position)) {
+        Slot &candidate = slotAt(position);
+        if (candidate.state.load(std::memory_order_acquire) != SlotState::AVAILABLE) {
+            break;
+        }
+        candidates[count++] = &candidate;
+    }
+    for (int i = 0; i < count; i++) {
+        if (isFenceSignaled(candidates[i]->image.fenceFd)) {
+            if (i != 0) {
+                swapSlots(*candidates[0], *candidates[i]);
+                mStats.reorderedImages.fetch_add(1, std::memory_order_relaxed);
+            }
+            return true;
+        }
+    }
+    if (mFenceWaitTimeout.count() <= 0) {
+        return false;
+    }
+
+    // Block until the first of them signals, sync_file fds poll readable once signaled.
+    std::array<pollfd, kMaxBufferCount> fds;
+    for (int i = 0; i < count; i++) {
+        fds[i] = {candidates[i]->image.fenceFd.get(), POLLIN, 0};
+    }
+    int64_t waitStart = FrameTracer::now();
+    auto seconds = std::chrono::duration_cast<std::chrono::seconds>(mFenceWaitTimeout);
+    timespec timeout = {static_cast<time_t>(seconds.count()),
+                        static_cast<long>((mFenceWaitTimeout - seconds).count())};
+    int ready = ppoll(fds.data(), count, &timeout, nullptr);
+    int64_t waitEnd = FrameTracer::now();
+    mStats.fenceWait.record(waitEnd - waitStart);
+    FrameTracer::Get().slice("release fence", mTraceTrack, waitStart, waitEnd);
+    if (ready <= 0) {
+        mStats.fenceTimeouts.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (fds[i].revents != 0) {
+            if (i != 0) {
+                swapSlots(*candidates[0], *candidates[i]);
+                mStats.reorderedImages.fetch_add(1, std::memory_order_relaxed);
+            }
+            // An error means the fence is gone, the GPU wait sorts it out.
+            return (fds[i].revents & POLLIN) != 0;
+        }
+    }
+    return false;
+}
+
+void BufferQueue::swapSlots(Slot &a, Slot &b) {
+    // Both are available, nobody else touches their images. Buffers move along with their images
+    // so the ring order stays as the presenting and releasing threads know it.
+    auto &buffers = mCurrent->buffers;
+    auto indexOf = [this](const Slot &slot) { return &slot - mCurrent->slots.data(); };
+    std::swap(a.image, b.image);
+    std::swap(buffers[indexOf(a)], buffers[indexOf(b)]);
+}
+
+void BufferQueue::enqueueProducedImage(std::shared_ptr<GLFence> fence,
+                                       const platform::Rect &damage) {
+    assert(mCurrentProduceSlot);
+    Image &image = mCurrentProduceSlot->image;
+    image.fence = std::move(fence);
+    image.damage = damage;
+    image.producedFrame = ++mProducedFrameCount;
+    image.enqueuedTime = FrameTracer::now();
+    FrameTracer::Get().slice("draw", mTraceTrack, image.producedTime, image.enqueuedTime);
+    // The image may be presented by another thread than the one that drew it.
+    mCurrentProduceSlot->state.store(SlotState::PRODUCED, std::memory_order_release);
+    mCurrentProduceSlot = nullptr;
+}
+
+bool BufferQueue::hasImageToPresent() const {
+    return mCurrent->bufferCount != 0 &&
+           slotAt(mPresentSlot).state.load(std::memory_order_acquire) == SlotState::PRODUCED;
 }
 
 const BufferQueue::Image *BufferQueue::presentImage() {
-    std::unique_lock<std::mutex> lock(mMutex);
-    if (mProducedImages.empty()) {
+    if (mCurrent->bufferCount == 0) {
         return nullptr;
     }
-    auto image = std::move(mProducedImages.front());
-    mProducedImages.pop_front();
-    mInPresentImages.push_back(std::move(image));
-    return mInPresentImages.back().get();
+    Slot *slot = &slotAt(mPresentSlot);
+    if (slot->state.load(std::memory_order_acquire) != SlotState::PRODUCED) {
+        return nullptr;
+    }
+    if (mPresentMode == PresentMode::MAILBOX) {
+        // Skip to the newest produced image, the older ones go straight back to the producer. The
+        // presented image's damage has to cover the frames skipped on the way.
+        platform::Rect damage = slot->image.damage;
+        int next = nextSlot(mPresentSlot);
+        while (next != mPresentSlot &&
+               slotAt(next).state.load(std::memory_order_acquire) == SlotState::PRODUCED) {
+            FrameTracer::Get().instant("dropped", mTraceTrack, FrameTracer::now());
+            slot->state.store(SlotState::AVAILABLE, std::memory_order_release);
+            mStats.droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            mPresentSlot = next;
+            slot = &slotAt(mPresentSlot);
+            damage = uniteDamage(damage, slot->image.damage);
+            next = nextSlot(mPresentSlot);
+        }
+        slot->image.damage = damage;
+    }
+    Image &image = slot->image;
+    image.presentedTime = FrameTracer::now();
+    mStats.produceToPresent.record(image.presentedTime - image.producedTime);
+    FrameTracer::Get().slice("queued", mTraceTrack, image.enqueuedTime, image.presentedTime);
+    // Releases arrive in present order, which is not slot order once images are skipped.
+    mCurrent->presentOrder[mCurrent->presentCount++ % kMaxBufferCount] =
+            mCurrent->ring[mPresentSlot];
+    // Published to the releasing thread through the compositor, the store only needs to be
+    // ordered after our last touch of the image.
+    slot->state.store(SlotState::PRESENTING, std::memory_order_release);
+    mPresentSlot = nextSlot(mPresentSlot);
+    return &slot->image;
 }
 
-void BufferQueue::releasePresentImage(int fenceFd) {
-    std::unique_lock<std::mutex> lock(mMutex);
-    assert(!mInPresentImages.empty());
-    auto image = std::move(mInPresentImages.front());
-    mInPresentImages.pop_front();
+void BufferQueue::releasePresentImage(uint32_t generation, int fenceFd) {
+    SlotSet &set = mSets[generation & 1];
+    // Keeps switchBuffers() from reusing the set until this release is done with it.
+    set.releasesInFlight.fetch_add(1);
+    if (set.generation.load() != generation) {
+        // Its set was dropped by a synchronous resize.
+        set.releasesInFlight.fetch_sub(1, std::memory_order_release);
+        if (fenceFd >= 0) {
+            close(fenceFd);
+        }
+        return;
+    }
+#if !defined(__ANDROID__)
+    if (auto hook = sReleaseHook.load(std::memory_order_relaxed)) {
+        hook();
+    }
+#endif
+    // Release callbacks of a set arrive in present order, so its n-th release belongs to its n-th
+    // presented image. At most bufferCount images are out, presentOrder is not overwritten before.
+    uint64_t releaseCount = set.releaseCount.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = set.slots[set.presentOrder[releaseCount % kMaxBufferCount]];
+    // Pairs with the release store in presentImage() so presentedTime is visible.
+    SlotState state = slot.state.load(std::memory_order_acquire);
+    assert(state == SlotState::PRESENTING);
+    (void) state;
+    int64_t now = FrameTracer::now();
+    mStats.presentToRelease.record(now - slot.image.presentedTime);
+    FrameTracer::Get().slice("presented", mTraceTrack, slot.image.presentedTime, now);
     // releaseProducerFence(fenceFd) could be called off gl thread, fence fd cannot be imported off
     // the gl thread, so we have to defer importing the fence.
-    image->fenceFd = ScopedFd(fenceFd);
-    mAvailableImages.push_back(std::move(image));
+    slot.image.fenceFd = ScopedFd(fenceFd);
+    slot.state.store(SlotState::AVAILABLE, std::memory_order_release);
+    set.releasesInFlight.fetch_sub(1, std::memory_order_release);
 }
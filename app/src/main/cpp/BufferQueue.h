@@ -6,65 +6,286 @@
 #define HELLOSURFACECONTROL_BUFFERQUEUE_H
 
 
-#include <android/hardware_buffer.h>
-
 #include <EGL/egl.h>
-#include <vulkan/vulkan.h>
+#include <GLES3/gl3.h>
 
-#include <deque>
-#include <mutex>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
+#include "BufferPool.h"
+#include "LatencyHistogram.h"
+#include "Platform.h"
 #include "ScopedFd.h"
 
 class GLFence;
 
-struct AHardwareBufferDeleter {
-    void operator()(AHardwareBuffer* buffer) const {
-        AHardwareBuffer_release(buffer);
-    }
-};
-
-using UniqueAHardwareBuffer = std::unique_ptr<AHardwareBuffer, AHardwareBufferDeleter>;
-
+// Images cycle through a ring of slots:
+//   AVAILABLE -> produceImage() -> PRODUCING -> enqueueProducedImage() -> PRODUCED
+//   -> presentImage() -> PRESENTING -> releasePresentImage() -> AVAILABLE
+// Each stage keeps a cursor into the ring and the slot state tells whether the image under it has
+// been handed over. Images are produced and presented in ring order, except that:
+//   - produceImage() may swap an available image whose release fence signaled ahead of the one
+//     under its cursor, see setFenceWaitTimeout().
+//   - presentImage() skips to the newest produced image in PresentMode::MAILBOX, and the skipped
+//     ones go back to AVAILABLE.
+// Releases arrive in present order, which is tracked per ring, so they need not match ring order.
+//
+// produceImage() and enqueueProducedImage() must be called on the thread whose GL context owns the
+// image framebuffers, presentImage() on a single (possibly different) thread, and
+// releasePresentImage() may be called from any number of other threads. enqueueProducedImage(),
+// presentImage(), hasImageToPresent() and releasePresentImage() never block nor allocate.
+// produceImage() blocks in ppoll() for up to the fence wait timeout when no available image's
+// release fence signaled, and never otherwise. While a retired ring (see below) drains,
+// produceImage() hands its released images back to BufferPool, which takes the pool's mutex and
+// allocates, as do the resize and buffer count calls.
+//
+// Each size has its own ring. A resize switches to a new ring and retires the old one, whose
+// images the compositor still holds go back to BufferPool as it releases them.
+//
+// The ring grows by one image when produceImage() keeps finding all images held by the compositor,
+// and shrinks by one when an image stayed spare for a while, within setBufferCountRange() and the
+// process wide SetMemoryBudget(). Both happen in updateBufferCount().
 class BufferQueue {
 public:
     explicit BufferQueue(VkDevice device);
     ~BufferQueue();
 
+    // Switches to buffers of the new size right away.
     void resize(int width, int height);
+    // Has the buffers of the new size allocated in the background, the queue keeps its current
+    // size until updateSize() switches over.
+    void resizeAsync(int width, int height);
+    // Switches to the buffers of the last resizeAsync() once they are allocated and the ring
+    // retired before is released, and returns whether it did. Called on the producing thread, not
+    // concurrently with presentImage().
+    bool updateSize();
+    bool isResizePending() const { return mPendingLeases != nullptr; }
+
+    // Bounds of the adaptive buffer count, clamped to [2, kMaxBufferCount]. The compositor keeps
+    // the image on screen until it latches the next one, so fewer than two would stall.
+    void setBufferCountRange(int minCount, int maxCount);
+    // Adds or removes an image as starvation and spare images since the last call suggest, and
+    // returns whether it did. Called on the producing thread, not concurrently with
+    // presentImage().
+    bool updateBufferCount();
+    // Drops spare images down to the minimum count right away, for a producer going idle. Same
+    // threading as updateBufferCount().
+    void trim();
+    int bufferCount() const { return mCurrent->bufferCount; }
 
-    void createBuffers();
-    void releaseBuffers();
+    // Caps the bytes of all queues' buffers, images are not added beyond it.
+    static void SetMemoryBudget(size_t bytes);
+    static size_t GetBufferBytes();
+#if !defined(__ANDROID__)
+    // Host checks only: |hook| runs in releasePresentImage() between its generation check and its
+    // update of the image, so a check can hold a release there. Null removes it.
+    static void SetReleaseHookForTesting(void (*hook)());
+#endif
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    // Attaches |renderbuffer| (0 to detach) to every image's framebuffer and validates them, so
+    // drawing only has to bind Image::framebuffer. Images added later, after a resize too, get it
+    // as well.
+    void attachDepthStencil(GLuint renderbuffer);
+    // Attaches every image's texture multisampled with EXT_multisampled_render_to_texture, 0 for
+    // plain attachments. See MultisampleTarget.
+    void setRenderToTextureSamples(int samples);
+
+    static constexpr int kMaxBufferCount = 8;
 
     struct Image {
-        Image(AHardwareBuffer* buffer, EGLImage eglImage) : buffer(buffer), eglImage(eglImage) {}
-        AHardwareBuffer* buffer = nullptr;
+        Image() = default;
+        Image(platform::Buffer* buffer, EGLImage eglImage) : buffer(buffer), eglImage(eglImage) {}
+        platform::Buffer* buffer = nullptr;
         EGLImage eglImage = EGL_NO_IMAGE;
+        // Owned by the queue, live as long as the buffer.
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
         std::shared_ptr<GLFence> fence;
         ScopedFd fenceFd;
+        // Frames since this image was last produced, like EGL_EXT_buffer_age: 1 means it holds
+        // the previous frame, 0 means its contents are undefined. Set by produceImage().
+        int age = 0;
+        uint64_t producedFrame = 0;
+        // What changed since the previously produced image, empty when unknown (all of it).
+        platform::Rect damage = {};
+        // Identifies the ring the image belongs to, handed back to releasePresentImage().
+        uint32_t generation = 0;
+        // FrameTracer::now() of this trip's transitions, written by the thread making them.
+        int64_t producedTime = 0;
+        int64_t enqueuedTime = 0;
+        int64_t presentedTime = 0;
+    };
+
+    // Recorded on every trip through the ring, readable from any thread.
+    struct Stats {
+        LatencyHistogram produceToPresent;
+        LatencyHistogram presentToRelease;
+        // How long produceImage() kept finding no available image.
+        LatencyHistogram starved;
+        // Produced images recycled without being presented, see PresentMode::MAILBOX.
+        std::atomic<uint64_t> droppedFrames{0};
+        // produceImage() calls refused by PresentMode::LATEST_ONLY.
+        std::atomic<uint64_t> throttledFrames{0};
+        // Images of the current ring, see updateBufferCount().
+        std::atomic<int> bufferCount{0};
+        // produceImage() calls that returned no image, each a frame its producer skips.
+        std::atomic<uint64_t> skippedFrames{0};
+        // Images taken ahead of their ring position because their release fence had signaled.
+        std::atomic<uint64_t> reorderedImages{0};
+        // How long produceImage() blocked on release fences, and how often it gave up and left
+        // the wait to the GPU.
+        LatencyHistogram fenceWait;
+        std::atomic<uint64_t> fenceTimeouts{0};
+    };
+
+    enum class PresentMode {
+        // Every produced image is presented, in order. Production is only limited by the ring.
+        FIFO,
+        // presentImage() presents the newest produced image and recycles the older ones, for the
+        // lowest latency when production runs ahead.
+        MAILBOX,
+        // produceImage() fails until the compositor latched the last presented image, so at most
+        // one frame is queued ahead of the screen.
+        LATEST_ONLY,
     };
 
+    // Called on the producing thread.
+    void setPresentMode(PresentMode mode) { mPresentMode = mode; }
+
+    // How long produceImage() may block for a release fence to signal when none of the available
+    // images' has, before it hands the oldest one's fence to the GPU to wait on. 0 never blocks.
+    void setFenceWaitTimeout(std::chrono::nanoseconds timeout) { mFenceWaitTimeout = timeout; }
+    PresentMode presentMode() const { return mPresentMode; }
+
+    const Stats& stats() const { return mStats; }
+
+    // Trace events for this queue go to |track| of FrameTracer.
+    void setTraceTrack(int track) { mTraceTrack = track; }
+
     const Image* produceImage();
-    void enqueueProducedImage(std::shared_ptr<GLFence> fence);
+    void enqueueProducedImage(std::shared_ptr<GLFence> fence, const platform::Rect& damage = {});
 
     const Image* presentImage();
-    void releasePresentImage(int fenceFd);
+    // Whether presentImage() would return an image, called on the presenting thread.
+    bool hasImageToPresent() const;
+    void releasePresentImage(uint32_t generation, int fenceFd);
 
 private:
+    enum class SlotState : uint8_t {
+        AVAILABLE,
+        PRODUCING,
+        PRODUCED,
+        PRESENTING,
+    };
+
+    struct Slot {
+        Image image;
+        std::atomic<SlotState> state{SlotState::AVAILABLE};
+    };
+
+    // The ring of one size.
+    struct SlotSet {
+        std::array<Slot, kMaxBufferCount> slots;
+        // Leased from BufferPool, indexed like |slots|.
+        std::vector<BufferPool::Lease> buffers;
+        int bufferCount = 0;
+        int width = 0;
+        int height = 0;
+        // Slot at each ring position, the cursors below walk positions. Images are added and
+        // removed at the produce cursor without moving slots the compositor may release.
+        std::array<uint8_t, kMaxBufferCount> ring = {};
+        // Slot of the n-th presented image at n % kMaxBufferCount, written by the presenting
+        // thread.
+        std::array<uint8_t, kMaxBufferCount> presentOrder = {};
+        uint64_t presentCount = 0;
+        std::atomic<uint32_t> generation{0};
+        // Bumped by whichever thread delivers the release callback.
+        std::atomic<uint64_t> releaseCount{0};
+        // releasePresentImage() calls between their generation check and their last touch of the
+        // set, a set is not rebuilt before they are done.
+        std::atomic<int> releasesInFlight{0};
+    };
+
+    void createBuffers(SlotSet& set, std::vector<BufferPool::Lease> leases);
+    // Appends a slot for |lease|, ring position is up to the caller.
+    Slot& addSlot(SlotSet& set, BufferPool::Lease lease);
+    // Hands the last slot's buffer back to BufferPool, it must be AVAILABLE.
+    void removeLastSlot(SlotSet& set);
+    bool growBuffers();
+    bool shrinkBuffers();
+    // Whether no image is being produced or waiting to be presented, so the ring can change.
+    bool isRingIdle() const;
+    // Returns whether images the compositor holds were kept when |keepPresenting|.
+    bool releaseBuffers(SlotSet& set, bool keepPresenting);
+    void resetSlotSet(SlotSet& set);
+    // Recycles released images of the retired set, and the set once all are.
+    void sweepRetired();
+    void switchBuffers(std::vector<BufferPool::Lease> leases, int width, int height);
+    void cancelPendingResize();
+    bool isLastImageLatched() const;
+    // Moves an available image whose release fence signaled, or signals within the timeout, to
+    // the produce cursor. Returns whether the image there needs no fence wait.
+    bool selectSignaledImage();
+    void swapSlots(Slot& a, Slot& b);
+
+    int nextSlot(int position) const {
+        return position + 1 == mCurrent->bufferCount ? 0 : position + 1;
+    }
+    Slot& slotAt(int position) { return mCurrent->slots[mCurrent->ring[position]]; }
+    const Slot& slotAt(int position) const { return mCurrent->slots[mCurrent->ring[position]]; }
+
     VkDevice mDevice = VK_NULL_HANDLE;
     int mWidth = 0;
     int mHeight = 0;
-    std::vector<UniqueAHardwareBuffer> mBuffers;
     std::vector<VkImage> mImages;
-    std::vector<EGLImage> mEGLImages;
 
-    std::mutex mMutex;
-    std::deque<std::unique_ptr<Image>> mAvailableImages;
-    std::deque<std::unique_ptr<Image>> mProducedImages;
-    std::deque<std::unique_ptr<Image>> mInPresentImages;
+    // The set of generation g is mSets[g & 1]. Only the producing thread switches sets.
+    // kNoGeneration marks a set being rebuilt, mGeneration never reaches it.
+    static constexpr uint32_t kNoGeneration = UINT32_MAX;
+    std::array<SlotSet, 2> mSets;
+    SlotSet* mCurrent = &mSets[0];
+    SlotSet* mRetired = nullptr;
+    uint32_t mGeneration = 0;
+
+    std::shared_ptr<BufferPool::PendingLeases> mPendingLeases;
+    int mPendingWidth = 0;
+    int mPendingHeight = 0;
+
+    // Ring positions, only touched by the producing and the presenting thread respectively.
+    int mProduceSlot = 0;
+    int mPresentSlot = 0;
+    Slot* mCurrentProduceSlot = nullptr;
+    uint64_t mProducedFrameCount = 0;
+    // When produceImage() first found no available image, 0 if it did not.
+    int64_t mStarvedSince = 0;
+
+    PresentMode mPresentMode = PresentMode::FIFO;
+    std::chrono::nanoseconds mFenceWaitTimeout = std::chrono::milliseconds(2);
+
+    // Images a new ring starts with, follows the adaptive count.
+    int mBufferCount;
+    int mMinBufferCount;
+    int mMaxBufferCount;
+    // Starved produceImage() episodes with every image held by the compositor, counted over a
+    // window of frames starting at mStarvationWindowStart.
+    int mStarvedFrames = 0;
+    uint64_t mStarvationWindowStart = 0;
+    // Since when every produceImage() left an image spare, 0 if the last one did not.
+    int64_t mSpareSince = 0;
+    // Doubles whenever a removed image had to be added back.
+    int64_t mShrinkDelay;
+    GLuint mDepthStencil = 0;
+    int mRenderToTextureSamples = 0;
 
-    std::unique_ptr<Image> mCurrentProduceImage;
+    Stats mStats;
+    int mTraceTrack = 0;
 };
 
 
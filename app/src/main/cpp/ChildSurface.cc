@@ -7,90 +7,44 @@
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
-#include <dlfcn.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <fcntl.h>
 #include <unistd.h>
 
+#include "FrameTracer.h"
 #include "GLFence.h"
 #include "Log.h"
 #include "Matrix.h"
+#include "SurfaceAtlas.h"
 
 #define LOG_TAG "SurfaceControlApp"
 
-constexpr GLenum kTextureTarget = GL_TEXTURE_EXTERNAL_OES;
-// Using GL_TEXTURE_EXTERNAL_OES causes problem on Android Emulator.
-//constexpr GLenum kTextureTarget = GL_TEXTURE_2D;
-
-static void *gLibAndroid = nullptr;
-using PFN_OnBufferRelease = void (*)(void *_Null_unspecified context,
-                                     int release_fence_fd);
-using PFN_ASurfaceTransaction_setBufferWithRelease = void (*)(
-        ASurfaceTransaction *_Nonnull transaction,
-        ASurfaceControl *_Nonnull surface_control,
-        AHardwareBuffer *_Nonnull buffer,
-        int acquire_fence_fd, void *_Null_unspecified context,
-        PFN_OnBufferRelease _Nonnull func);
-static PFN_ASurfaceTransaction_setBufferWithRelease ASurfaceTransaction_setBufferWithReleaseFn = nullptr;
-
 static const std::chrono::system_clock::time_point kStartTime = std::chrono::system_clock::now();
 
-ChildSurface::ChildSurface(VkDevice device, VkQueue queue) :
-        mDevice(device), mQueue(queue), mBufferQueue(device) {
-    if (!gLibAndroid) {
-        gLibAndroid = dlopen("libandroid.so", RTLD_NOW);
-        ASurfaceTransaction_setBufferWithReleaseFn = reinterpret_cast<PFN_ASurfaceTransaction_setBufferWithRelease>(dlsym(
-                gLibAndroid, "ASurfaceTransaction_setBufferWithRelease"));
-        if (!ASurfaceTransaction_setBufferWithReleaseFn) {
-            LOGE("Failed to find ASurfaceTransaction_setBufferWithRelease which is available in Android SDK API level 36+");
-        }
-    }
+static bool isEmptyRect(const platform::Rect &rect) {
+    return rect.left >= rect.right || rect.top >= rect.bottom;
 }
 
-ChildSurface::~ChildSurface() {
-    mSurfaceControl = nullptr;
-    // release gl objects
-    glDeleteProgram(mProgram);
-    glDeleteBuffers(1, &mVbo);
-    glDeleteBuffers(1, &mVbo);
-    glDeleteVertexArrays(1, &mVao);
-    glDeleteFramebuffers(1, &mFbo);
-    glDeleteRenderbuffers(1, &mRbo);
+static bool isSameRect(const platform::Rect &a, const platform::Rect &b) {
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
 }
 
-bool ChildSurface::init(ASurfaceControl *parent, const char *debugName) {
-    assert(mSurfaceControl == nullptr);
-
-    mSurfaceControl.reset(ASurfaceControl_create(parent, debugName));
-    if (mSurfaceControl == nullptr) {
-        LOGE("Failed to create ASurfaceControl");
-        return false;
+static platform::Rect uniteRects(const platform::Rect &a, const platform::Rect &b) {
+    if (isEmptyRect(a)) {
+        return b;
     }
-
-    createProgram();
-    setupBuffers();
-
-    return true;
-}
-
-void ChildSurface::resize(int width, int height) {
-    LOGD("ChildSurface::resize() width=%d, height=%d", width, height);
-
-    if (mWidth == width && mHeight == height) {
-        return;
+    if (isEmptyRect(b)) {
+        return a;
     }
-
-    mWidth = width;
-    mHeight = height;
-
-    mBufferQueue.resize(width, height);
-    setupFramebuffer();
-}
-
-void ChildSurface::draw() {
-    drawGL();
+    return {std::min(a.left, b.left), std::min(a.top, b.top), std::max(a.right, b.right),
+            std::max(a.bottom, b.bottom)};
 }
 
 // Shader sources (simple shaders to draw a triangle)
-const char *vertexShaderSource = R"(#version 300 es
+static const char *vertexShaderSource = R"(#version 300 es
     in vec3 aPosition;
     in vec4 aColor;
     out vec4 vColor;
@@ -104,7 +58,7 @@ const char *vertexShaderSource = R"(#version 300 es
     }
 )";
 
-const char *fragmentShaderSource = R"(#version 300 es
+static const char *fragmentShaderSource = R"(#version 300 es
     precision mediump float;
     in vec4 vColor;
     in vec2 vTexCoord;
@@ -114,199 +68,231 @@ const char *fragmentShaderSource = R"(#version 300 es
     }
 )";
 
-GLuint createShader(GLenum type, const char *source) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
-
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        GLint logLength;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
-        char *log = new char[logLength];
-        glGetShaderInfoLog(shader, logLength, nullptr, log);
-        LOGE("Shader compile error: %s", log);
-        delete[] log;
-    }
-    return shader;
-}
+ChildSurface::ChildSurface(VkDevice device, VkQueue queue) :
+        mDevice(device), mQueue(queue), mBufferQueue(device) {}
 
-void ChildSurface::createProgram() {
-    GLuint vertexShader = createShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint fragmentShader = createShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-
-    mProgram = glCreateProgram();
-    glAttachShader(mProgram, vertexShader);
-    glAttachShader(mProgram, fragmentShader);
-    glLinkProgram(mProgram);
-
-    GLint success;
-    glGetProgramiv(mProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        GLint logLength;
-        glGetProgramiv(mProgram, GL_INFO_LOG_LENGTH, &logLength);
-        char *log = new char[logLength];
-        glGetProgramInfoLog(mProgram, logLength, nullptr, log);
-        LOGE("Program link error: %s", log);
-        delete[] log;
+ChildSurface::~ChildSurface() {
+    mSurfaceControl = nullptr;
+    // The program, the mesh and the depth/stencil renderbuffer belong to the GLResourceCache,
+    // mGpuTimer deletes its queries
+    if (mDepthStencil != 0) {
+        mResourceCache->releaseDepthStencil(mDepthStencil);
     }
 }
 
-void ChildSurface::setupBuffers() {
-    // clang-format off
-    GLfloat cubeVertexArray[] = {
-            // float3 position, float4 color, float2 uv,
-            1, -1, 1, 1, 0, 1, 1, 0, 1,
-            -1, -1, 1, 0, 0, 1, 1, 1, 1,
-            -1, -1, -1, 0, 0, 0, 1, 1, 0,
-            1, -1, -1, 1, 0, 0, 1, 0, 0,
-
-            1, 1, 1, 1, 1, 1, 1, 0, 1,
-            1, -1, 1, 1, 0, 1, 1, 1, 1,
-            1, -1, -1, 1, 0, 0, 1, 1, 0,
-            1, 1, -1, 1, 1, 0, 1, 0, 0,
-
-            -1, 1, 1, 0, 1, 1, 1, 0, 1,
-            1, 1, 1, 1, 1, 1, 1, 1, 1,
-            1, 1, -1, 1, 1, 0, 1, 1, 0,
-            -1, 1, -1, 0, 1, 0, 1, 0, 0,
-
-            -1, -1, 1, 0, 0, 1, 1, 0, 1,
-            -1, 1, 1, 0, 1, 1, 1, 1, 1,
-            -1, 1, -1, 0, 1, 0, 1, 1, 0,
-            -1, -1, -1, 0, 0, 0, 1, 0, 0,
-
-            1, 1, 1, 1, 1, 1, 1, 0, 1,
-            -1, 1, 1, 0, 1, 1, 1, 1, 1,
-            -1, -1, 1, 0, 0, 1, 1, 1, 0,
-            1, -1, 1, 1, 0, 1, 1, 0, 0,
-
-            1, -1, -1, 1, 0, 0, 1, 0, 1,
-            -1, -1, -1, 0, 0, 0, 1, 1, 1,
-            -1, 1, -1, 0, 1, 0, 1, 1, 0,
-            1, 1, -1, 1, 1, 0, 1, 0, 0,
-    };
-
-    GLuint cubeIndices[] = {
-            0, 1, 2,
-            3, 0, 2,
-
-            4, 5, 6,
-            7, 4, 6,
-
-            8, 9, 10,
-            11, 8, 10,
-
-            12, 13, 14,
-            15, 12, 14,
-
-            16, 17, 18,
-            18, 19, 16,
+bool ChildSurface::init(platform::Surface *parent, const char *debugName,
+                        GLResourceCache &resourceCache) {
+    assert(mSurfaceControl == nullptr);
 
-            20, 21, 22,
-            23, 20, 22,
-    };
-    // clang-format on
+    mSurfaceControl.reset(platform::createSurface(parent, debugName));
+    if (mSurfaceControl == nullptr) {
+        LOGE("Failed to create ASurfaceControl");
+        return false;
+    }
+    mBufferQueue.setTraceTrack(FrameTracer::Get().registerTrack(debugName));
 
-    constexpr int kStride = 9 * sizeof(GLfloat);
-    constexpr int kPositionOffset = 0;
-    constexpr int kColorOffset = 3 * sizeof(GLfloat);
-    constexpr int kTexCoordOffset = 7 * sizeof(GLfloat);
+    mReleaseContexts = std::make_shared<ReleaseContextPool>();
+    for (auto &releaseContext: mReleaseContexts->contexts) {
+        releaseContext.owner = weak_from_this();
+    }
 
+    mProgram = resourceCache.getProgram(vertexShaderSource, fragmentShaderSource);
+    if (mProgram == nullptr) {
+        return false;
+    }
+    mRotationMatrixLocation = mProgram->uniformLocation("uRotationMatrix");
+    mMesh = resourceCache.getMesh(GLResourceCache::MeshId::CUBE);
+    mResourceCache = &resourceCache;
 
-    // Create VAO, VBO, and EBO
-    glGenVertexArrays(1, &mVao);
-    glGenBuffers(1, &mVbo);
-    glGenBuffers(1, &mEbo);
+    return true;
+}
 
-    glBindVertexArray(mVao);
+void ChildSurface::resize(int width, int height) {
+    LOGD("ChildSurface::resize() width=%d, height=%d", width, height);
 
-    glBindBuffer(GL_ARRAY_BUFFER, mVbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertexArray), cubeVertexArray, GL_STATIC_DRAW);
+    if (mTargetWidth == width && mTargetHeight == height) {
+        return;
+    }
 
+    mTargetWidth = width;
+    mTargetHeight = height;
+    if (mAtlas) {
+        // Drawn at the old size until the atlas switched to the new layout.
+        mAtlas->invalidateLayout();
+        return;
+    }
+    resizeBuffers();
+}
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kStride, (GLvoid *) kPositionOffset);
-    glEnableVertexAttribArray(0);
+void ChildSurface::resizeBuffers() {
+    float scale = mResolution.scale();
+    int width = std::max(1, static_cast<int>(std::lround(mTargetWidth * scale)));
+    int height = std::max(1, static_cast<int>(std::lround(mTargetHeight * scale)));
+    // The buffers are allocated in the background, frames keep coming at the old size meanwhile.
+    mBufferQueue.resizeAsync(width, height);
+    mChangedFlags[SCALE_CHANGED] = true;
+    mChangedFlags[CROP_CHANGED] = !isEmptyRect(mCrop);
+}
 
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, kStride,
-                          (GLvoid *) kColorOffset);
-    glEnableVertexAttribArray(1);
+void ChildSurface::setFrameTimeBudget(int64_t nanos) {
+    if (mResolution.setBudget(nanos) && !mAtlas && mTargetWidth > 0) {
+        resizeBuffers();
+    }
+}
 
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, kStride,
-                          (GLvoid *) kTexCoordOffset);
-    glEnableVertexAttribArray(2);
+void ChildSurface::updateSize() {
+    if (!mBufferQueue.updateSize()) {
+        return;
+    }
+    mWidth = mBufferQueue.width();
+    mHeight = mBufferQueue.height();
+    // New buffers start out undefined, the next frame is drawn in full.
+    mFrameNumber = 0;
+    mContentDirty = true;
+    mAttachmentsDirty = true;
+    mChangedFlags[SCALE_CHANGED] = true;
+    mChangedFlags[CROP_CHANGED] = !isEmptyRect(mCrop);
+}
 
-    glBindVertexArray(0);
+void ChildSurface::setAtlasRect(const platform::Rect &rect) {
+    mAtlasRect = rect;
+    mWidth = rect.right - rect.left;
+    mHeight = rect.bottom - rect.top;
+    mContentDirty = true;
+    // The crop selects the region and the position makes up for its offset.
+    mChangedFlags[CROP_CHANGED] = true;
+    mChangedFlags[POSITION_CHANGED] = true;
+    mChangedFlags[SCALE_CHANGED] = true;
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void ChildSurface::draw() {
+    drawGL();
 }
 
-void ChildSurface::setupFramebuffer() {
-    if (mFbo != 0) {
-        glDeleteFramebuffers(1, &mFbo);
-        mFbo = 0;
+bool ChildSurface::beginFrame(int64_t vsyncNanos) {
+    // Vsync timestamps jitter, a frame slightly early still counts.
+    constexpr int64_t kCadenceSlackNanos = 2'000'000;
+    if (mFrameIntervalNanos == 0) {
+        mFrameDue = true;
+        return true;
     }
-    if (mRbo != 0) {
-        glDeleteRenderbuffers(1, &mRbo);
-        mRbo = 0;
+    mFrameDue = vsyncNanos >= mNextFrameNanos - kCadenceSlackNanos;
+    if (mFrameDue) {
+        // Keeps the phase, so rates that do not divide the display's still average out, unless
+        // frames were missed for longer than an interval.
+        mNextFrameNanos = vsyncNanos - mNextFrameNanos > mFrameIntervalNanos ?
+                          vsyncNanos + mFrameIntervalNanos :
+                          mNextFrameNanos + mFrameIntervalNanos;
     }
-
-    glGenFramebuffers(1, &mFbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, mFbo);
-
-    glGenRenderbuffers(1, &mRbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, mRbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mWidth, mHeight);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mRbo);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    return mFrameDue;
 }
 
-int bindEGLImageAsTexture(EGLImage eglImage) {
-    GLuint textureId;
-    glGenTextures(1, &textureId);
-    glBindTexture(kTextureTarget, textureId);
-    glEGLImageTargetTexture2DOES(kTextureTarget, eglImage);
-    return textureId;
-}
+void ChildSurface::updateAttachments() {
+    mAttachmentsDirty = false;
+    // Atlas members draw into the atlas' framebuffers.
+    int samples = mAtlas ? 1 : mRequestedSamples;
+    bool depthNeeded = mDepthTestEnabled && !mAtlas;
+    // Rebuilt for the new size, gives the images back their plain attachments.
+    mMultisampleTarget = nullptr;
+
+    // Multisampled drawing has depth/stencil of its own.
+    bool sharedNeeded = depthNeeded && samples <= 1;
+    if (mDepthStencil != 0 &&
+        (!sharedNeeded || mDepthStencilWidth != mWidth || mDepthStencilHeight != mHeight)) {
+        mResourceCache->releaseDepthStencil(mDepthStencil);
+        mDepthStencil = 0;
+    }
+    if (sharedNeeded && mDepthStencil == 0) {
+        mDepthStencil = mResourceCache->acquireDepthStencil(mWidth, mHeight);
+        mDepthStencilWidth = mWidth;
+        mDepthStencilHeight = mHeight;
+    }
+    // Also when the name did not change: a renderbuffer released above may be deleted and its
+    // name handed out again, while the images' framebuffers still hold the deleted one.
+    mBufferQueue.attachDepthStencil(mDepthStencil);
 
+    if (samples > 1) {
+        mMultisampleTarget = std::make_unique<MultisampleTarget>(mBufferQueue, samples, mWidth,
+                                                                 mHeight, depthNeeded);
+    }
+}
 
 void ChildSurface::drawGL() {
+    updateSize();
+    if (mAttachmentsDirty) {
+        updateAttachments();
+    }
+    mBufferQueue.updateBufferCount();
     const auto *image = mBufferQueue.produceImage();
     if (!image) {
+        // The frame is skipped and counted in BufferQueue::Stats::skippedFrames, the content
+        // stays dirty for the next one.
         return;
     }
 
+    if (GpuTimer::IsEnabled() || mResolution.isEnabled()) {
+        collectGpuTimes();
+    }
+
     if (image->fence) {
         image->fence->wait();
     }
 
-    GLuint texture = bindEGLImageAsTexture(image->eglImage);
+    Matrix4x4 rotationMatrix;
+    bool backgroundChanged = animate(&rotationMatrix);
 
-    // Bind the framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, mFbo);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, kTextureTarget, texture,
-                           0);
+    // What changed since the previous frame: everything when the background color did, otherwise
+    // where the cube was and where it is now.
+    const platform::Rect bounds = {0, 0, mWidth, mHeight};
+    platform::Rect cubeBounds = projectedCubeBounds(rotationMatrix);
+    platform::Rect frameDamage = uniteRects(mCubeBounds, cubeBounds);
+    if (mFrameNumber == 0 || backgroundChanged || mContentDirty) {
+        frameDamage = bounds;
+    }
+    mCubeBounds = cubeBounds;
+    mFrameNumber++;
+    mDamageHistory[mFrameNumber % mDamageHistory.size()] = frameDamage;
+
+    // The image is missing every frame produced since it was last drawn, buffer-age style.
+    platform::Rect repaint = bounds;
+    if (image->age > 0 && image->age <= static_cast<int>(mDamageHistory.size())) {
+        repaint = {};
+        for (int i = 0; i < image->age; i++) {
+            repaint = uniteRects(repaint, mDamageHistory[(mFrameNumber - i) %
+                                                         mDamageHistory.size()]);
+        }
+    }
 
-    // Bind the renderbuffer
-    glBindRenderbuffer(GL_RENDERBUFFER, mRbo);
+    // GL's window origin is the first row of the buffer, so damage and scissor share coordinates.
+    if (!isEmptyRect(repaint)) {
+        bool partial = !isSameRect(repaint, bounds);
+        GLuint framebuffer = mMultisampleTarget ? mMultisampleTarget->framebuffer(*image) :
+                             image->framebuffer;
+        encodeFrame(framebuffer, bounds, partial ? &repaint : nullptr, rotationMatrix, image);
+    }
 
+    mBufferQueue.enqueueProducedImage(GLFence::Create(), frameDamage);
+    mContentDirty = false;
+}
 
-    // Check if the framebuffer is complete
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        LOGE("Framebuffer is not complete");
+void ChildSurface::drawIntoAtlas(GLuint framebuffer) {
+    if (GpuTimer::IsEnabled()) {
+        collectGpuTimes();
     }
+    // The atlas image is shared, so the whole region is drawn every time.
+    Matrix4x4 rotationMatrix;
+    animate(&rotationMatrix);
+    mFrameNumber++;
+    encodeFrame(framebuffer, mAtlasRect, &mAtlasRect, rotationMatrix);
+    mContentDirty = false;
+}
 
-    // Set the viewport
-    glViewport(0, 0, mWidth, mHeight);
-
-    auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::system_clock::now() - kStartTime).count();
+bool ChildSurface::animate(Matrix4x4 *rotationMatrix) {
+    if (mAnimating) {
+        mContentTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now() - kStartTime).count();
+    }
+    auto time = mContentTime;
 
     auto computeColor = [time, this](int period) {
         period *= mDelta;
@@ -314,13 +300,6 @@ void ChildSurface::drawGL() {
         return std::abs(result / period);
     };
 
-    // Clear the screen to red
-    glClearColor(computeColor(1000), computeColor(3000), computeColor(2000), 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    // Use the shader program
-    glUseProgram(mProgram);
-
     auto computeAngle = [time, this](int period) {
         period *= mDelta;
         return 2 * M_PI * (time % period) / period;
@@ -332,86 +311,273 @@ void ChildSurface::drawGL() {
 
 
     // Rotate the triangle by angle{X,Y,Z}
-    Matrix4x4 rotationMatrix =
-            Matrix4x4::Rotate(angleX, angleY, angleZ) * Matrix4x4::Scale(0.5f, 0.5f, 0.5f);
+    *rotationMatrix = Matrix4x4::TranslateRotateScale(0.0f, 0.0f, 0.0f,
+                                                      angleX, angleY, angleZ,
+                                                      0.5f, 0.5f, 0.5f);
+
+    bool backgroundChanged = false;
+    if (mFrameNumber == 0 || mBackgroundAnimated) {
+        float clearColor[3] = {computeColor(1000), computeColor(3000), computeColor(2000)};
+        backgroundChanged = !std::equal(clearColor, clearColor + 3, mClearColor);
+        std::copy(clearColor, clearColor + 3, mClearColor);
+    }
+    return backgroundChanged;
+}
+
+void ChildSurface::encodeFrame(GLuint framebuffer, const platform::Rect &viewport,
+                               const platform::Rect *scissor, const Matrix4x4 &rotationMatrix,
+                               const BufferQueue::Image *image) {
+    const bool timed = GpuTimer::IsEnabled() || mResolution.isEnabled();
+    int64_t encodeStart = 0;
+    if (timed) {
+        encodeStart = FrameTracer::now();
+        mGpuTimer.begin();
+    }
+
+    // Bind the framebuffer, attachments were set up and validated when the buffers were
+    // created
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+    // Set the viewport
+    glViewport(viewport.left, viewport.top, viewport.right - viewport.left,
+               viewport.bottom - viewport.top);
+    if (scissor) {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(scissor->left, scissor->top, scissor->right - scissor->left,
+                  scissor->bottom - scissor->top);
+    }
+
+    // Clear the screen to red. Depth/stencil are cleared rather than loaded, they come from a
+    // renderbuffer other surfaces share.
+    glClearColor(mClearColor[0], mClearColor[1], mClearColor[2], 1.0f);
+    GLbitfield clearMask = GL_COLOR_BUFFER_BIT;
+    if (mDepthTestEnabled) {
+        glEnable(GL_DEPTH_TEST);
+        clearMask |= GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
+    }
+    glClear(clearMask);
 
-    GLint rotationMatrixLocation = glGetUniformLocation(mProgram, "uRotationMatrix");
-    glUniformMatrix4fv(rotationMatrixLocation, 1, GL_FALSE, rotationMatrix.data);
+    // Use the shader program
+    glUseProgram(mProgram->id);
+
+    glUniformMatrix4fv(mRotationMatrixLocation, 1, GL_FALSE, rotationMatrix.data);
 
     // set cull
     glEnable(GL_CULL_FACE);
 
     // Draw the cube
-    glBindVertexArray(mVao);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEbo);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    glBindVertexArray(mMesh->vao);
+    glDrawElements(GL_TRIANGLES, mMesh->indexCount, mMesh->indexType, 0);
     glBindVertexArray(0);
 
-    mBufferQueue.enqueueProducedImage(GLFence::Create());
+    if (mDepthTestEnabled) {
+        glDisable(GL_DEPTH_TEST);
+        // Not stored back to memory. An atlas discards it once all its members drew.
+        if (!mAtlas) {
+            const GLenum attachments[] = {GL_DEPTH_ATTACHMENT, GL_STENCIL_ATTACHMENT};
+            glInvalidateFramebuffer(GL_FRAMEBUFFER, 2, attachments);
+        }
+    }
+    const platform::Rect &drawn = scissor ? *scissor : viewport;
+    // Only the shared renderbuffer would otherwise be loaded and stored, multisampled drawing
+    // has depth of its own and atlas members draw into the atlas'.
+    if (mDepthStencil != 0) {
+        mDepthTrafficAvoided.fetch_add(static_cast<uint64_t>(drawn.right - drawn.left) *
+                                       (drawn.bottom - drawn.top) * 8, std::memory_order_relaxed);
+    }
+    if (scissor) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+    if (mMultisampleTarget && image) {
+        mMultisampleTarget->resolve(*image, drawn);
+    }
+
+    if (timed) {
+        mGpuTimer.end();
+        int64_t encodeTime = FrameTracer::now() - encodeStart;
+        mDrawStats.cpuEncode.record(encodeTime);
+        mDrawStats.recentCpuEncode.record(encodeTime);
+    }
+}
+
+void ChildSurface::collectGpuTimes() {
+    int64_t gpuTime;
+    while (mGpuTimer.poll(&gpuTime)) {
+        mDrawStats.gpuTime.record(gpuTime);
+        mDrawStats.recentGpuTime.record(gpuTime);
+        // Frames of the previous size are still coming in until the new buffers are used.
+        if (mAtlas || mBufferQueue.isResizePending()) {
+            continue;
+        }
+        if (mResolution.record(gpuTime)) {
+            LOGD("ChildSurface::collectGpuTimes() resolution scale %.2f, frame time %.2fms",
+                 mResolution.scale(), gpuTime / 1e6);
+            resizeBuffers();
+        }
+    }
+}
+
+platform::Rect ChildSurface::projectedCubeBounds(const Matrix4x4 &matrix) const {
+    // The matrix is uploaded untransposed, so GL reads data[] column-major.
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (int corner = 0; corner < 8; corner++) {
+        float v[3] = {corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f,
+                      corner & 4 ? 1.0f : -1.0f};
+        float x = matrix.data[0] * v[0] + matrix.data[4] * v[1] + matrix.data[8] * v[2] +
+                  matrix.data[12];
+        float y = matrix.data[1] * v[0] + matrix.data[5] * v[1] + matrix.data[9] * v[2] +
+                  matrix.data[13];
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+    }
+    // One pixel of slack for rasterization rounding.
+    auto toPixel = [](float ndc, int size) { return (ndc + 1.0f) * 0.5f * size; };
+    platform::Rect rect = {
+            static_cast<int32_t>(std::floor(toPixel(minX, mWidth))) - 1,
+            static_cast<int32_t>(std::floor(toPixel(minY, mHeight))) - 1,
+            static_cast<int32_t>(std::ceil(toPixel(maxX, mWidth))) + 1,
+            static_cast<int32_t>(std::ceil(toPixel(maxY, mHeight))) + 1,
+    };
+    rect.left = std::max(rect.left, 0);
+    rect.top = std::max(rect.top, 0);
+    rect.right = std::min(rect.right, mWidth);
+    rect.bottom = std::min(rect.bottom, mHeight);
+    return rect;
+}
+
+ChildSurface::ReleaseContext *ChildSurface::obtainReleaseContext() {
+    for (auto &releaseContext: mReleaseContexts->contexts) {
+        if (!releaseContext.inUse.load(std::memory_order_acquire)) {
+            releaseContext.inUse.store(true, std::memory_order_relaxed);
+            releaseContext.pool = mReleaseContexts;
+            return &releaseContext;
+        }
+    }
+    return nullptr;
 }
 
 // static
 void ChildSurface::bufferReleasedCallback(void *context, int fenceFd) {
-    auto *weakSelf = reinterpret_cast<std::weak_ptr<ChildSurface> *>(context);
-    if (auto self = weakSelf->lock()) {
-        self->bufferReleased(fenceFd);
+    auto *releaseContext = reinterpret_cast<ReleaseContext *>(context);
+    // Keeps the contexts alive until this returns, even if the ChildSurface is gone.
+    auto pool = std::move(releaseContext->pool);
+    if (auto self = releaseContext->owner.lock()) {
+        self->bufferReleased(releaseContext->generation, fenceFd);
     } else {
         if (fenceFd > 0) {
             close(fenceFd);
         }
         LOGD("ChildSurface is already destroyed");
     }
-    delete weakSelf;
+    releaseContext->inUse.store(false, std::memory_order_release);
+}
+
+void ChildSurface::bufferReleased(uint32_t generation, int fenceFd) {
+    mBufferQueue.releasePresentImage(generation, fenceFd);
 }
 
-void ChildSurface::bufferReleased(int fenceFd) {
-    mBufferQueue.releasePresentImage(fenceFd);
+std::shared_ptr<GLFence> ChildSurface::takeImageToPresent() {
+    mImageToPresentTaken = true;
+    mImageToPresent = nullptr;
+    mImageReleaseContext = nullptr;
+    if (!mBufferQueue.hasImageToPresent()) {
+        return nullptr;
+    }
+    // Every presented image is released before the ring comes around to it again, and at most
+    // twice the ring is out across a resize, so a context is always free.
+    mImageReleaseContext = obtainReleaseContext();
+    if (mImageReleaseContext == nullptr) {
+        LOGE("Out of buffer release contexts, presenting next frame");
+        return nullptr;
+    }
+    mImageToPresent = mBufferQueue.presentImage();
+    return mImageToPresent ? mImageToPresent->fence : nullptr;
 }
 
-void ChildSurface::applyChanges(ASurfaceTransaction *transaction) {
-    if (const auto *image = mBufferQueue.presentImage()) {
-        std::weak_ptr<ChildSurface> *weakSelf = new std::weak_ptr<ChildSurface>(
-                shared_from_this());
-        ASurfaceTransaction_setBufferWithReleaseFn(transaction, mSurfaceControl.get(),
-                                                   image->buffer,
-                                                   image->fence
-                                                   ? image->fence->getFd().release()
-                                                   : -1,
-                                                   weakSelf,
-                                                   ChildSurface::bufferReleasedCallback);
+void ChildSurface::applyChanges(platform::Transaction *transaction,
+                                const ScopedFd *acquireFence) {
+    if (!mImageToPresentTaken) {
+        takeImageToPresent();
+    }
+    mImageToPresentTaken = false;
+    if (const auto *image = mImageToPresent) {
+        mImageReleaseContext->generation = image->generation;
+        int acquireFenceFd = -1;
+        if (acquireFence) {
+            acquireFenceFd = acquireFence->isValid() ?
+                             fcntl(acquireFence->get(), F_DUPFD_CLOEXEC, 0) : -1;
+        } else if (image->fence) {
+            acquireFenceFd = image->fence->getFd().release();
+        }
+        platform::setBuffer(transaction, mSurfaceControl.get(), image->buffer, acquireFenceFd,
+                            mImageReleaseContext, ChildSurface::bufferReleasedCallback);
+        if (!isEmptyRect(image->damage)) {
+            platform::setDamageRegion(transaction, mSurfaceControl.get(), &image->damage, 1);
+        }
     }
     if (mChangedFlags[VISIBILITY_CHANGED]) {
-        ASurfaceTransaction_setVisibility(transaction, mSurfaceControl.get(),
-                                          mVisible
-                                          ? ASurfaceTransactionVisibility::ASURFACE_TRANSACTION_VISIBILITY_SHOW
-                                          : ASurfaceTransactionVisibility::ASURFACE_TRANSACTION_VISIBILITY_HIDE);
+        platform::setVisibility(transaction, mSurfaceControl.get(), mVisible);
+    }
+    // While the buffers lag behind a resize, they are stretched to the new size.
+    float stretchX = mWidth > 0 && mTargetWidth > 0 ? static_cast<float>(mTargetWidth) / mWidth : 1.0f;
+    float stretchY = mHeight > 0 && mTargetHeight > 0 ?
+                     static_cast<float>(mTargetHeight) / mHeight : 1.0f;
+    if (mAtlas && (mChangedFlags[CROP_CHANGED] || mChangedFlags[POSITION_CHANGED] ||
+                   mChangedFlags[SCALE_CHANGED])) {
+        applyAtlasGeometry(transaction, stretchX, stretchY);
+        mChangedFlags[CROP_CHANGED] = false;
+        mChangedFlags[POSITION_CHANGED] = false;
     }
     if (mChangedFlags[CROP_CHANGED]) {
-        ASurfaceTransaction_setCrop(transaction, mSurfaceControl.get(), mCrop);
+        platform::Rect crop = {static_cast<int32_t>(mCrop.left / stretchX),
+                               static_cast<int32_t>(mCrop.top / stretchY),
+                               static_cast<int32_t>(mCrop.right / stretchX),
+                               static_cast<int32_t>(mCrop.bottom / stretchY)};
+        platform::setCrop(transaction, mSurfaceControl.get(), crop);
     }
     if (mChangedFlags[POSITION_CHANGED]) {
-        ASurfaceTransaction_setPosition(transaction, mSurfaceControl.get(), mLeft, mTop);
+        platform::setPosition(transaction, mSurfaceControl.get(), mLeft, mTop);
     }
     if (mChangedFlags[TRANSFORM_CHANGED]) {
-        ASurfaceTransaction_setBufferTransform(transaction, mSurfaceControl.get(), mTransform);
+        platform::setBufferTransform(transaction, mSurfaceControl.get(), mTransform);
     }
     if (mChangedFlags[SCALE_CHANGED]) {
-        ASurfaceTransaction_setScale(transaction, mSurfaceControl.get(), mXScale, mYScale);
+        platform::setScale(transaction, mSurfaceControl.get(), mXScale * stretchX,
+                           mYScale * stretchY);
     }
     if (mChangedFlags[ALPHA_CHANGED]) {
-        ASurfaceTransaction_setBufferAlpha(transaction, mSurfaceControl.get(), mAlpha);
+        platform::setBufferAlpha(transaction, mSurfaceControl.get(), mAlpha);
     }
     if (mChangedFlags[COLOR_CHANGED]) {
-        ASurfaceTransaction_setColor(transaction, mSurfaceControl.get(), mColor[0], mColor[1],
-                                     mColor[2],
-                                     mColor[3], ADataSpace::ADATASPACE_UNKNOWN);
+        platform::setColor(transaction, mSurfaceControl.get(), mColor[0], mColor[1], mColor[2],
+                           mColor[3]);
     }
     if (mChangedFlags[TRANSPARENT_CHANGED]) {
-        ASurfaceTransaction_setBufferTransparency(transaction, mSurfaceControl.get(),
-                                                  mTransparent
-                                                  ? ASURFACE_TRANSACTION_TRANSPARENCY_TRANSPARENT
-                                                  : ASURFACE_TRANSACTION_TRANSPARENCY_OPAQUE);
+        platform::setBufferTransparency(transaction, mSurfaceControl.get(), mTransparent);
+    }
+    if (mChangedFlags[FRAME_RATE_CHANGED]) {
+        platform::setFrameRate(transaction, mSurfaceControl.get(), mFrameRate);
     }
 
     mChangedFlags.reset();
 }
+
+void ChildSurface::applyAtlasGeometry(platform::Transaction *transaction, float stretchX,
+                                      float stretchY) {
+    // The region of the atlas buffer, or the part of it the crop leaves, shown where the whole
+    // buffer would be without an atlas.
+    platform::Rect crop = isEmptyRect(mCrop) ? platform::Rect{0, 0, mTargetWidth, mTargetHeight}
+                                             : mCrop;
+    crop = {mAtlasRect.left + static_cast<int32_t>(crop.left / stretchX),
+            mAtlasRect.top + static_cast<int32_t>(crop.top / stretchY),
+            mAtlasRect.left + static_cast<int32_t>(crop.right / stretchX),
+            mAtlasRect.top + static_cast<int32_t>(crop.bottom / stretchY)};
+    crop.right = std::min(crop.right, mAtlasRect.right);
+    crop.bottom = std::min(crop.bottom, mAtlasRect.bottom);
+    platform::setCrop(transaction, mSurfaceControl.get(), crop);
+    platform::setPosition(transaction, mSurfaceControl.get(),
+                          mLeft - static_cast<int32_t>(mAtlasRect.left * mXScale * stretchX),
+                          mTop - static_cast<int32_t>(mAtlasRect.top * mYScale * stretchY));
+}
@@ -5,21 +5,25 @@
 #ifndef HELLOSURFACECONTROL_CHILDSURFACE_H
 #define HELLOSURFACECONTROL_CHILDSURFACE_H
 
-#include <android/surface_control.h>
 #include <GLES3/gl3.h>
+#include <array>
+#include <atomic>
+#include <memory>
 #include <cstring>
 #include <deque>
 #include <bitset>
 
 #include "BufferQueue.h"
+#include "GLResourceCache.h"
+#include "GpuTimer.h"
+#include "LatencyHistogram.h"
+#include "Matrix.h"
+#include "MultisampleTarget.h"
+#include "Platform.h"
+#include "ResolutionController.h"
+#include "ScopedFd.h"
 
-struct ASurfaceControlDeleter {
-    void operator()(ASurfaceControl *surfaceControl) const {
-        ASurfaceControl_release(surfaceControl);
-    }
-};
-
-using UniqueASurfaceControl = std::unique_ptr<ASurfaceControl, ASurfaceControlDeleter>;
+class SurfaceAtlas;
 
 class ChildSurface : public std::enable_shared_from_this<ChildSurface> {
 public:
@@ -27,13 +31,46 @@ public:
 
     ~ChildSurface();
 
-    bool init(ASurfaceControl *parent, const char *debugName);
+    bool init(platform::Surface *parent, const char *debugName, GLResourceCache &resourceCache);
 
     void resize(int width, int height);
 
+    int targetWidth() const { return mTargetWidth; }
+    int targetHeight() const { return mTargetHeight; }
+
     void draw();
 
-    void setCrop(const ARect &crop) {
+    // Atlas mode, managed by SurfaceAtlas: the surface leaves its own BufferQueue empty and shows
+    // |rect| of the atlas' buffers instead, drawn by drawIntoAtlas() with the atlas image's
+    // framebuffer. resize() asks the atlas to repack.
+    void setAtlas(SurfaceAtlas *atlas) { mAtlas = atlas; }
+    SurfaceAtlas *atlas() const { return mAtlas; }
+    void setAtlasRect(const platform::Rect &rect);
+    void drawIntoAtlas(GLuint framebuffer);
+
+    platform::Surface *surfaceControl() const { return mSurfaceControl.get(); }
+
+    // Content has to be redrawn when it animates or after invalidate(), and frames keep coming
+    // until a resize has switched buffers.
+    bool needsRedraw() const {
+        return mAnimating || mContentDirty || mBufferQueue.isResizePending();
+    }
+
+    // Whether the buffers have yet to catch up with the last resize().
+    bool isResizePending() const {
+        return mBufferQueue.isResizePending();
+    }
+
+    void invalidate() {
+        mContentDirty = true;
+    }
+
+    // Whether applyChanges() has anything to put into a transaction.
+    bool hasPendingChanges() const {
+        return mChangedFlags.any() || mBufferQueue.hasImageToPresent();
+    }
+
+    void setCrop(const platform::Rect &crop) {
         if (std::memcmp(&crop, &mCrop, sizeof(crop)) == 0) {
             return;
         }
@@ -98,37 +135,211 @@ public:
         mDelta = delta;
     }
 
-    void applyChanges(ASurfaceTransaction *transaction);
+    // Stopping the animation freezes the content at its current state.
+    void setAnimating(bool animating) {
+        mAnimating = animating;
+    }
+
+    // Rate the content is meant to update at, told to the compositor so it can pick a display
+    // rate. Frames in between are left out, see beginFrame(). 0, the default, follows the display.
+    void setFrameRate(float frameRate) {
+        if (mFrameRate == frameRate) {
+            return;
+        }
+        mFrameRate = frameRate;
+        mFrameIntervalNanos = frameRate > 0 ? static_cast<int64_t>(1e9 / frameRate) : 0;
+        mNextFrameNanos = 0;
+        mChangedFlags[FRAME_RATE_CHANGED] = true;
+    }
+
+    // Decides whether the frame of |vsyncNanos| is on the setFrameRate() cadence, and keeps the
+    // answer for isFrameDue(). A frame off the cadence should neither draw nor change properties.
+    // Called once per frame.
+    bool beginFrame(int64_t vsyncNanos);
+    bool isFrameDue() const {
+        return mFrameDue;
+    }
+
+    // The cube is convex and drawn with its back faces culled, so by default the surface draws
+    // without depth test and has no depth/stencil attachment at all. With the depth test it gets
+    // one of GLResourceCache's shared renderbuffers, cleared before and invalidated after every
+    // draw, so tilers neither load nor store it.
+    void setDepthTestEnabled(bool enabled) {
+        if (mDepthTestEnabled == enabled) {
+            return;
+        }
+        mDepthTestEnabled = enabled;
+        mAttachmentsDirty = true;
+        mContentDirty = true;
+    }
+    bool depthTestEnabled() const {
+        return mDepthTestEnabled;
+    }
+
+    // Anti-aliases with |samples| per pixel, clamped to what the context supports, see
+    // MultisampleTarget. 1, the default, draws into the images directly. Atlas members ignore it.
+    void setSampleCount(int samples) {
+        if (mRequestedSamples == samples) {
+            return;
+        }
+        mRequestedSamples = samples;
+        mAttachmentsDirty = true;
+        mContentDirty = true;
+    }
+    // Null unless drawing multisampled.
+    const MultisampleTarget *multisampleTarget() const {
+        return mMultisampleTarget.get();
+    }
+
+    // Estimated depth/stencil tile traffic saved, in bytes, readable from any thread. Each pixel
+    // drawn with the shared depth/stencil attached would load and store 4 bytes of it, were it
+    // not cleared and invalidated.
+    uint64_t depthTrafficAvoided() const {
+        return mDepthTrafficAvoided.load(std::memory_order_relaxed);
+    }
+
+    // A static background leaves only the cube damaged, so frames are redrawn partially.
+    void setBackgroundAnimated(bool animated) {
+        mBackgroundAnimated = animated;
+    }
+
+    // Takes the image the next applyChanges() presents, if any, and returns the fence its buffer
+    // waits on. applyChanges() takes it itself when this was not called first.
+    std::shared_ptr<GLFence> takeImageToPresent();
+    // |acquireFence|, if given, is what the buffer waits on instead of its own fence: one fence
+    // for the whole transaction, see GLFence::Merge(). The fd stays with the caller.
+    void applyChanges(platform::Transaction *transaction, const ScopedFd *acquireFence = nullptr);
+
+    void setPresentMode(BufferQueue::PresentMode mode) {
+        mBufferQueue.setPresentMode(mode);
+    }
+
+    void setBufferCountRange(int minCount, int maxCount) {
+        mBufferQueue.setBufferCountRange(minCount, maxCount);
+    }
+
+    // Gives spare buffers back while the surface is not drawn.
+    void trimBuffers() {
+        mBufferQueue.trim();
+    }
+
+    const BufferQueue::Stats &bufferStats() const {
+        return mBufferQueue.stats();
+    }
+
+    // Renders into smaller buffers, which the compositor scales up, while the GPU time of its
+    // frames exceeds |nanos|, see ResolutionController. 0, the default, always renders at full
+    // resolution. Needs EXT_disjoint_timer_query, atlas members ignore it.
+    void setFrameTimeBudget(int64_t nanos);
+
+    // Of the buffers to the size given to resize(), readable from any thread.
+    float resolutionScale() const {
+        return mResolution.scale();
+    }
+
+    // Recorded while GpuTimer::IsEnabled() or a frame time budget is set, readable from any
+    // thread. GPU times come in a few frames after the draw they measure.
+    struct DrawStats {
+        // Issuing the frame's GL commands on the drawing thread.
+        LatencyHistogram cpuEncode;
+        LatencyHistogram gpuTime;
+        RollingDuration recentCpuEncode;
+        RollingDuration recentGpuTime;
+    };
+
+    const DrawStats &drawStats() const {
+        return mDrawStats;
+    }
 
 private:
     void drawGL();
 
-    void createProgram();
-
-    void setupBuffers();
+    // Advances the content to now and returns whether the background color changed. The color
+    // only follows the animation with mBackgroundAnimated, or on the first frame.
+    bool animate(Matrix4x4 *rotationMatrix);
+
+    // Draws the content into |viewport| of |framebuffer|, only inside |scissor| unless null. When
+    // drawing multisampled, |image| is what the frame resolves into.
+    void encodeFrame(GLuint framebuffer, const platform::Rect &viewport,
+                     const platform::Rect *scissor, const Matrix4x4 &rotationMatrix,
+                     const BufferQueue::Image *image = nullptr);
+
+    // Sets up multisampling and attaches a shared depth/stencil renderbuffer of the buffers'
+    // size, or none, as the buffer size, sample count and depth test ask for.
+    void updateAttachments();
+
+    // Crop and position showing mAtlasRect of the atlas buffer.
+    void applyAtlasGeometry(platform::Transaction *transaction, float stretchX, float stretchY);
+
+    // Records the GPU times of earlier draws whose queries have finished.
+    void collectGpuTimes();
+
+    // Asks for buffers of the target size at the resolution scale.
+    void resizeBuffers();
+    // Picks up buffers of a new size once BufferQueue has them.
+    void updateSize();
+
+    platform::Rect projectedCubeBounds(const Matrix4x4 &matrix) const;
+
+    // Context of a presented buffer's release callback. The contexts are allocated once with the
+    // surface and each holds its pool while in use, so a late release outlives the ChildSurface.
+    struct ReleaseContextPool;
+    struct ReleaseContext {
+        std::weak_ptr<ChildSurface> owner;
+        std::shared_ptr<ReleaseContextPool> pool;
+        uint32_t generation = 0;
+        std::atomic<bool> inUse{false};
+    };
+    struct ReleaseContextPool {
+        // Buffers of the previous size may still be out after a resize.
+        std::array<ReleaseContext, BufferQueue::kMaxBufferCount * 2> contexts;
+    };
 
-    void setupFramebuffer();
+    ReleaseContext *obtainReleaseContext();
 
     static void bufferReleasedCallback(void *context, int fenceFd);
 
-    void bufferReleased(int fenceFd);
+    void bufferReleased(uint32_t generation, int fenceFd);
 
     VkDevice mDevice = VK_NULL_HANDLE;
     VkQueue mQueue = VK_NULL_HANDLE;
 
-    UniqueASurfaceControl mSurfaceControl;
+    platform::UniqueSurface mSurfaceControl;
 
+    // Size of the buffers drawn to. They are stretched to the size asked for by resize(), when
+    // rendered at a lower resolution and until buffers of a new size are allocated.
     int mWidth = 0;
     int mHeight = 0;
+    int mTargetWidth = 0;
+    int mTargetHeight = 0;
 
     BufferQueue mBufferQueue;
-    GLuint mProgram = 0;
-    GLuint mVao = 0;
-    GLuint mVbo = 0;
-    GLuint mEbo = 0;
-
-    GLuint mFbo = 0;
-    GLuint mRbo = 0;
+    SurfaceAtlas *mAtlas = nullptr;
+    // Where the content is in the atlas' buffers, mWidth by mHeight.
+    platform::Rect mAtlasRect = {};
+    std::shared_ptr<ReleaseContextPool> mReleaseContexts;
+    // Set by takeImageToPresent() for the next applyChanges().
+    bool mImageToPresentTaken = false;
+    const BufferQueue::Image *mImageToPresent = nullptr;
+    ReleaseContext *mImageReleaseContext = nullptr;
+    const GLResourceCache::Program *mProgram = nullptr;
+    GLint mRotationMatrixLocation = -1;
+    const GLResourceCache::Mesh *mMesh = nullptr;
+
+    GLResourceCache *mResourceCache = nullptr;
+    bool mDepthTestEnabled = false;
+    bool mAttachmentsDirty = false;
+    // Shared, of mDepthStencilWidth by mDepthStencilHeight.
+    GLuint mDepthStencil = 0;
+    int mDepthStencilWidth = 0;
+    int mDepthStencilHeight = 0;
+    std::atomic<uint64_t> mDepthTrafficAvoided{0};
+    int mRequestedSamples = 1;
+    std::unique_ptr<MultisampleTarget> mMultisampleTarget;
+
+    GpuTimer mGpuTimer;
+    DrawStats mDrawStats;
+    ResolutionController mResolution;
 
     enum : int {
         VISIBILITY_CHANGED,
@@ -139,13 +350,14 @@ private:
         ALPHA_CHANGED,
         COLOR_CHANGED,
         TRANSPARENT_CHANGED,
+        FRAME_RATE_CHANGED,
         MAX_CHANGED_FLAGS,
     };
 
     std::bitset<MAX_CHANGED_FLAGS> mChangedFlags;
 
     bool mVisible = true;
-    ARect mCrop = {};
+    platform::Rect mCrop = {};
     float mXScale = 1.0f;
     float mYScale = 1.0f;
 
@@ -157,7 +369,24 @@ private:
     float mColor[4] = {1.0f, 1.0f, 1.0f, 1.0f};
     bool mTransparent = false;
 
+    float mFrameRate = 0.0f;
+    int64_t mFrameIntervalNanos = 0;
+    // Vsync time the next frame on the cadence is due at.
+    int64_t mNextFrameNanos = 0;
+    bool mFrameDue = true;
+
     float mDelta = 1.0f;
+    bool mAnimating = true;
+    bool mBackgroundAnimated = true;
+    bool mContentDirty = true;
+    // Animation time of the last drawn frame, in milliseconds since kStartTime.
+    int64_t mContentTime = 0;
+
+    // Damage of the most recent frames indexed by frame number, enough to cover any buffer age.
+    std::array<platform::Rect, BufferQueue::kMaxBufferCount> mDamageHistory = {};
+    uint64_t mFrameNumber = 0;
+    platform::Rect mCubeBounds = {};
+    float mClearColor[3] = {};
 };
 
 
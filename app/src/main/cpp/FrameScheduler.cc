@@ -0,0 +1,48 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "FrameScheduler.h"
+
+#include <algorithm>
+
+namespace {
+
+FrameScheduler::Clock::time_point fromNanos(int64_t nanos) {
+    return FrameScheduler::Clock::time_point(std::chrono::nanoseconds(nanos));
+}
+
+}  // namespace
+
+void FrameScheduler::onVsync(int64_t vsyncNanos, int64_t deadlineNanos) {
+    if (mPendingFrame) {
+        mStats.vsyncsDropped++;
+    }
+    mPendingFrame = Frame{fromNanos(vsyncNanos), fromNanos(deadlineNanos)};
+}
+
+std::optional<FrameScheduler::Clock::time_point> FrameScheduler::nextDrawTime() const {
+    if (!mPendingFrame) {
+        return std::nullopt;
+    }
+    return std::max(mPendingFrame->vsync, mPendingFrame->deadline - mDrawOffset);
+}
+
+std::optional<FrameScheduler::Frame> FrameScheduler::beginFrame(Clock::time_point now) {
+    auto drawTime = nextDrawTime();
+    if (!drawTime || now < *drawTime) {
+        return std::nullopt;
+    }
+    Frame frame = *mPendingFrame;
+    mPendingFrame.reset();
+    return frame;
+}
+
+void FrameScheduler::endFrame(const Frame &frame, Clock::time_point now) {
+    mStats.frames++;
+    if (now <= frame.deadline) {
+        mStats.deadlinesHit++;
+    } else {
+        mStats.deadlinesMissed++;
+    }
+}
@@ -0,0 +1,57 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_FRAMESCHEDULER_H
+#define HELLOSURFACECONTROL_FRAMESCHEDULER_H
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// Turns vsync callbacks into draw times. A frame is started |drawOffset| before the deadline of the
+// latest vsync and counts as a hit if its transaction was applied by that deadline. Vsyncs which
+// arrive before the previous one got drawn are counted as dropped.
+//
+// Not thread safe, callers serialize onVsync() with the rest.
+class FrameScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame {
+        Clock::time_point vsync;
+        Clock::time_point deadline;
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t deadlinesHit = 0;
+        uint64_t deadlinesMissed = 0;
+        uint64_t vsyncsDropped = 0;
+    };
+
+    explicit FrameScheduler(Clock::duration drawOffset) : mDrawOffset(drawOffset) {}
+
+    void setDrawOffset(Clock::duration drawOffset) {
+        mDrawOffset = drawOffset;
+    }
+
+    void onVsync(int64_t vsyncNanos, int64_t deadlineNanos);
+
+    // When the next frame should start, or nullopt while waiting for a vsync.
+    std::optional<Clock::time_point> nextDrawTime() const;
+
+    // Takes the pending frame if its draw time has come.
+    std::optional<Frame> beginFrame(Clock::time_point now);
+    void endFrame(const Frame &frame, Clock::time_point now);
+
+    const Stats &stats() const { return mStats; }
+
+private:
+    Clock::duration mDrawOffset;
+    std::optional<Frame> mPendingFrame;
+    Stats mStats;
+};
+
+
+#endif //HELLOSURFACECONTROL_FRAMESCHEDULER_H
@@ -0,0 +1,125 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "FrameTracer.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+// static
+FrameTracer &FrameTracer::Get() {
+    static FrameTracer tracer;
+    return tracer;
+}
+
+// static
+int64_t FrameTracer::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameTracer::FrameTracer() : mEvents(new Event[kCapacity]) {}
+
+int FrameTracer::registerTrack(std::string name) {
+    std::unique_lock<std::mutex> lock(mTrackMutex);
+    mTracks.push_back(std::move(name));
+    return static_cast<int>(mTracks.size());
+}
+
+void FrameTracer::slice(const char *name, int track, int64_t startNanos, int64_t endNanos) {
+    if (isEnabled()) {
+        record(name, track, startNanos, endNanos);
+    }
+}
+
+void FrameTracer::instant(const char *name, int track, int64_t timeNanos) {
+    if (isEnabled()) {
+        record(name, track, timeNanos, -1);
+    }
+}
+
+void FrameTracer::record(const char *name, int track, int64_t startNanos, int64_t endNanos) {
+    uint64_t index = mNextEvent.fetch_add(1, std::memory_order_relaxed);
+    Event &event = mEvents[index % kCapacity];
+    event.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    event.name.store(name, std::memory_order_relaxed);
+    event.track.store(track, std::memory_order_relaxed);
+    event.start.store(startNanos, std::memory_order_relaxed);
+    event.end.store(endNanos, std::memory_order_relaxed);
+    event.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+std::string FrameTracer::toJson() const {
+    std::string json = "{\"traceEvents\":[\n";
+    char line[256];
+    bool first = true;
+    auto append = [&](const char *text) {
+        if (!first) {
+            json += ",\n";
+        }
+        first = false;
+        json += text;
+    };
+
+    {
+        std::unique_lock<std::mutex> lock(mTrackMutex);
+        for (size_t i = 0; i < mTracks.size(); i++) {
+            snprintf(line, sizeof(line),
+                     R"({"ph":"M","name":"thread_name","pid":1,"tid":%zu,"args":{"name":"%s"}})",
+                     i + 1, mTracks[i].c_str());
+            append(line);
+        }
+    }
+
+    uint64_t end = mNextEvent.load(std::memory_order_acquire);
+    uint64_t begin = end > kCapacity ? end - kCapacity : 0;
+    for (uint64_t index = begin; index < end; index++) {
+        const Event &event = mEvents[index % kCapacity];
+        uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * index + 2) {
+            continue;
+        }
+        const char *name = event.name.load(std::memory_order_relaxed);
+        int track = event.track.load(std::memory_order_relaxed);
+        int64_t startNanos = event.start.load(std::memory_order_relaxed);
+        int64_t endNanos = event.end.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (event.sequence.load(std::memory_order_relaxed) != sequence) {
+            continue;
+        }
+        // Timestamps are microseconds.
+        if (endNanos < 0) {
+            snprintf(line, sizeof(line),
+                     R"({"ph":"i","s":"t","name":"%s","pid":1,"tid":%d,"ts":%.3f})",
+                     name, track, startNanos / 1000.0);
+        } else {
+            snprintf(line, sizeof(line),
+                     R"({"ph":"X","name":"%s","pid":1,"tid":%d,"ts":%.3f,"dur":%.3f})",
+                     name, track, startNanos / 1000.0, (endNanos - startNanos) / 1000.0);
+        }
+        append(line);
+    }
+    json += "\n]}\n";
+    return json;
+}
+
+bool FrameTracer::dump(const std::string &path) const {
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        LOGE("Failed to open %s", path.c_str());
+        return false;
+    }
+    std::string json = toJson();
+    bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        LOGE("Failed to write %s", path.c_str());
+    }
+    return written;
+}
@@ -0,0 +1,66 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_FRAMETRACER_H
+#define HELLOSURFACECONTROL_FRAMETRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Process-wide ring of trace events, dumped in the Chrome trace event JSON format which the
+// Perfetto UI and chrome://tracing load. Recording is lock-free and costs a relaxed load while
+// disabled, the oldest events are overwritten once the ring is full.
+class FrameTracer {
+public:
+    static FrameTracer &Get();
+
+    // CLOCK_MONOTONIC nanoseconds, the clock vsync and transaction timestamps use.
+    static int64_t now();
+
+    void setEnabled(bool enabled) { mEnabled.store(enabled, std::memory_order_relaxed); }
+
+    bool isEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+    // A named row in the trace, e.g. one per surface.
+    int registerTrack(std::string name);
+
+    // |name| must outlive the tracer, string literals only.
+    void slice(const char *name, int track, int64_t startNanos, int64_t endNanos);
+    void instant(const char *name, int track, int64_t timeNanos);
+
+    std::string toJson() const;
+    bool dump(const std::string &path) const;
+
+private:
+    FrameTracer();
+
+    struct Event {
+        // 0 when empty, odd while being written, 2 * index + 2 once complete. Fields are atomics
+        // so dumping can race with recording, torn events are detected and skipped.
+        std::atomic<uint64_t> sequence{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<int> track{0};
+        std::atomic<int64_t> start{0};
+        // -1 for instant events.
+        std::atomic<int64_t> end{0};
+    };
+
+    void record(const char *name, int track, int64_t startNanos, int64_t endNanos);
+
+    static constexpr uint64_t kCapacity = 1 << 14;
+
+    std::atomic<bool> mEnabled{false};
+    std::unique_ptr<Event[]> mEvents;
+    std::atomic<uint64_t> mNextEvent{0};
+
+    mutable std::mutex mTrackMutex;
+    std::vector<std::string> mTracks;
+};
+
+
+#endif //HELLOSURFACECONTROL_FRAMETRACER_H
@@ -4,24 +4,46 @@
 
 #include "GLFence.h"
 
+#include <fcntl.h>
+
+#include <algorithm>
+#include <vector>
+
 #include "Log.h"
+#include "Platform.h"
 
 #define LOG_TAG "SurfaceControlApp"
 
-PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROIDFn = nullptr;
+namespace {
+
+thread_local std::vector<std::shared_ptr<GLFence>> tFencePool;
+
+}  // namespace
 
 GLFence::GLFence() = default;
 
 GLFence::~GLFence() {
-    if (mSync != EGL_NO_SYNC_KHR) {
-        eglDestroySyncKHR(eglGetCurrentDisplay(), mSync);
+    reset();
+}
+
+// static
+std::shared_ptr<GLFence> GLFence::Obtain() {
+    // A fence only the pool refers to can not be handed out concurrently, the use count is exact.
+    for (const auto &fence: tFencePool) {
+        if (fence.use_count() == 1) {
+            fence->reset();
+            return fence;
+        }
     }
+    tFencePool.push_back(std::make_shared<GLFence>());
+    return tFencePool.back();
 }
 
 // static
 std::shared_ptr<GLFence> GLFence::Create() {
-    auto fence = std::make_shared<GLFence>();
-    if (!fence->init(EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr)) {
+    auto fence = Obtain();
+    EGLDisplay display = eglGetCurrentDisplay();
+    if (!fence->init(display, platform::createFence(display))) {
         return nullptr;
     }
     return fence;
@@ -29,16 +51,24 @@ std::shared_ptr<GLFence> GLFence::Create() {
 
 // static
 std::shared_ptr<GLFence> GLFence::CreateFromFenceFd(ScopedFd fenceFd) {
-    EGLint attribs[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fenceFd.release(), EGL_NONE};
-    auto fence = std::make_shared<GLFence>();
-    if (!fence->init(EGL_SYNC_NATIVE_FENCE_ANDROID, attribs)) {
+    auto fence = Obtain();
+    EGLDisplay display = eglGetCurrentDisplay();
+    if (!fence->init(display, platform::importFence(display, fenceFd.release()))) {
         return nullptr;
     }
     return fence;
 }
 
-bool GLFence::init(EGLint type, const EGLint *attribs) {
-    mSync = eglCreateSyncKHR(eglGetCurrentDisplay(), type, attribs);
+// static
+void GLFence::TrimPool() {
+    tFencePool.erase(std::remove_if(tFencePool.begin(), tFencePool.end(),
+                                    [](const auto &fence) { return fence.use_count() == 1; }),
+                     tFencePool.end());
+}
+
+bool GLFence::init(EGLDisplay display, EGLSyncKHR sync) {
+    mDisplay = display;
+    mSync = sync;
     if (mSync == EGL_NO_SYNC_KHR) {
         LOGE("Failed to eglCreateSyncKHR");
         return false;
@@ -46,25 +76,48 @@ bool GLFence::init(EGLint type, const EGLint *attribs) {
     return true;
 }
 
+void GLFence::reset() {
+    mFd.reset();
+    mFdExported = false;
+    if (mSync != EGL_NO_SYNC_KHR) {
+        platform::destroyFence(mDisplay, mSync);
+        mSync = EGL_NO_SYNC_KHR;
+    }
+}
+
 void GLFence::wait() {
-    if (eglWaitSyncKHR(eglGetCurrentDisplay(), mSync, 0) == EGL_FALSE) {
+    if (!platform::waitFence(eglGetCurrentDisplay(), mSync)) {
         LOGE("Failed to eglWaitSyncKHR");
     }
 }
 
 ScopedFd GLFence::getFd() {
-    if (eglDupNativeFenceFDANDROIDFn == nullptr) {
-        eglDupNativeFenceFDANDROIDFn = reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(
-                eglGetProcAddress("eglDupNativeFenceFDANDROID"));
-        if (eglDupNativeFenceFDANDROIDFn == nullptr) {
-            LOGE("Failed to eglGetProcAddress eglDupNativeFenceFDANDROID");
-            return {};
-        }
+    if (!mFdExported) {
+        mFd = ScopedFd(platform::dupFenceFd(mDisplay, mSync));
+        mFdExported = true;
     }
-    EGLint fd = eglDupNativeFenceFDANDROIDFn(eglGetCurrentDisplay(), mSync);
-    if (fd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
-        LOGE("Failed to eglDupNativeFenceFDANDROID");
+    if (!mFd.isValid()) {
         return {};
     }
-    return ScopedFd(fd);
-}
\ No newline at end of file
+    return ScopedFd(fcntl(mFd.get(), F_DUPFD_CLOEXEC, 0));
+}
+
+// static
+ScopedFd GLFence::Merge(const std::shared_ptr<GLFence> *fences, size_t count) {
+    ScopedFd merged;
+    for (size_t i = 0; i < count; i++) {
+        if (!fences[i]) {
+            continue;
+        }
+        ScopedFd fd = fences[i]->getFd();
+        if (!fd.isValid()) {
+            continue;
+        }
+        if (!merged.isValid()) {
+            merged = std::move(fd);
+            continue;
+        }
+        merged = ScopedFd(platform::mergeFenceFds("GLFence", merged.get(), fd.get()));
+    }
+    return merged;
+}
@@ -16,16 +16,33 @@ public:
     GLFence();
     ~GLFence();
 
+    // Fences are recycled per thread: once nothing else holds a fence returned here, a later call
+    // on the same thread reuses it, so steady state frames do not allocate. EGL syncs signal only
+    // once, each fence still gets a new one.
     static std::shared_ptr<GLFence> Create();
     static std::shared_ptr<GLFence> CreateFromFenceFd(ScopedFd fenceFd);
 
+    // Destroys the calling thread's unused fences, before its EGL display goes away.
+    static void TrimPool();
+
     void wait();
+    // The native fence fd is exported once per fence, later calls dup the cached one.
     ScopedFd getFd();
 
+    // Returns a single fence fd signaling once all of |fences| have, invalid if none can be
+    // exported. Null fences are skipped.
+    static ScopedFd Merge(const std::shared_ptr<GLFence>* fences, size_t count);
+
 private:
-    bool init(EGLint type, const EGLint *attribs);
+    static std::shared_ptr<GLFence> Obtain();
+
+    bool init(EGLDisplay display, EGLSyncKHR sync);
+    void reset();
 
+    EGLDisplay mDisplay = EGL_NO_DISPLAY;
     EGLSyncKHR mSync = EGL_NO_SYNC_KHR;
+    ScopedFd mFd;
+    bool mFdExported = false;
 };
 
 
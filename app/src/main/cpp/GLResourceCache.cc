@@ -0,0 +1,366 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "GLResourceCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+namespace {
+
+GLuint createShader(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        GLint logLength;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+        char *log = new char[logLength];
+        glGetShaderInfoLog(shader, logLength, nullptr, log);
+        LOGE("Shader compile error: %s", log);
+        delete[] log;
+    }
+    return shader;
+}
+
+bool linkProgram(GLuint program, const char *vertexShaderSource,
+                 const char *fragmentShaderSource) {
+    GLuint vertexShader = createShader(GL_VERTEX_SHADER, vertexShaderSource);
+    GLuint fragmentShader = createShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
+    // The program keeps them alive until it is deleted.
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        GLint logLength;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+        char *log = new char[logLength];
+        glGetProgramInfoLog(program, logLength, nullptr, log);
+        LOGE("Program link error: %s", log);
+        delete[] log;
+        return false;
+    }
+    return true;
+}
+
+void resolveUniforms(GLResourceCache::Program &program) {
+    GLint count = 0;
+    GLint maxLength = 0;
+    glGetProgramiv(program.id, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program.id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<char> name(maxLength + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program.id, i, static_cast<GLsizei>(name.size()), nullptr, &size,
+                           &type, name.data());
+        program.uniforms.emplace_back(name.data(), glGetUniformLocation(program.id, name.data()));
+    }
+}
+
+std::unique_ptr<GLResourceCache::Mesh> createCube() {
+    // clang-format off
+    GLfloat cubeVertexArray[] = {
+            // float3 position, float4 color, float2 uv,
+            1, -1, 1, 1, 0, 1, 1, 0, 1,
+            -1, -1, 1, 0, 0, 1, 1, 1, 1,
+            -1, -1, -1, 0, 0, 0, 1, 1, 0,
+            1, -1, -1, 1, 0, 0, 1, 0, 0,
+
+            1, 1, 1, 1, 1, 1, 1, 0, 1,
+            1, -1, 1, 1, 0, 1, 1, 1, 1,
+            1, -1, -1, 1, 0, 0, 1, 1, 0,
+            1, 1, -1, 1, 1, 0, 1, 0, 0,
+
+            -1, 1, 1, 0, 1, 1, 1, 0, 1,
+            1, 1, 1, 1, 1, 1, 1, 1, 1,
+            1, 1, -1, 1, 1, 0, 1, 1, 0,
+            -1, 1, -1, 0, 1, 0, 1, 0, 0,
+
+            -1, -1, 1, 0, 0, 1, 1, 0, 1,
+            -1, 1, 1, 0, 1, 1, 1, 1, 1,
+            -1, 1, -1, 0, 1, 0, 1, 1, 0,
+            -1, -1, -1, 0, 0, 0, 1, 0, 0,
+
+            1, 1, 1, 1, 1, 1, 1, 0, 1,
+            -1, 1, 1, 0, 1, 1, 1, 1, 1,
+            -1, -1, 1, 0, 0, 1, 1, 1, 0,
+            1, -1, 1, 1, 0, 1, 1, 0, 0,
+
+            1, -1, -1, 1, 0, 0, 1, 0, 1,
+            -1, -1, -1, 0, 0, 0, 1, 1, 1,
+            -1, 1, -1, 0, 1, 0, 1, 1, 0,
+            1, 1, -1, 1, 1, 0, 1, 0, 0,
+    };
+
+    GLuint cubeIndices[] = {
+            0, 1, 2,
+            3, 0, 2,
+
+            4, 5, 6,
+            7, 4, 6,
+
+            8, 9, 10,
+            11, 8, 10,
+
+            12, 13, 14,
+            15, 12, 14,
+
+            16, 17, 18,
+            18, 19, 16,
+
+            20, 21, 22,
+            23, 20, 22,
+    };
+    // clang-format on
+
+    constexpr int kStride = 9 * sizeof(GLfloat);
+    constexpr int kPositionOffset = 0;
+    constexpr int kColorOffset = 3 * sizeof(GLfloat);
+    constexpr int kTexCoordOffset = 7 * sizeof(GLfloat);
+
+    auto mesh = std::make_unique<GLResourceCache::Mesh>();
+    mesh->indexCount = sizeof(cubeIndices) / sizeof(cubeIndices[0]);
+    mesh->indexType = GL_UNSIGNED_INT;
+
+    // Create VAO, VBO, and EBO
+    glGenVertexArrays(1, &mesh->vao);
+    glGenBuffers(1, &mesh->vbo);
+    glGenBuffers(1, &mesh->ebo);
+
+    glBindVertexArray(mesh->vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertexArray), cubeVertexArray, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, kStride, (GLvoid *) kPositionOffset);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, kStride,
+                          (GLvoid *) kColorOffset);
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, kStride,
+                          (GLvoid *) kTexCoordOffset);
+    glEnableVertexAttribArray(2);
+
+    // The element buffer binding is VAO state, so drawing only needs to bind the VAO.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    return mesh;
+}
+
+}  // namespace
+
+GLint GLResourceCache::Program::uniformLocation(const char *name) const {
+    for (const auto &[uniformName, location]: uniforms) {
+        if (uniformName == name) {
+            return location;
+        }
+    }
+    return -1;
+}
+
+GLResourceCache::GLResourceCache(std::string cacheDir) : mCacheDir(std::move(cacheDir)) {}
+
+GLResourceCache::~GLResourceCache() {
+    for (const auto &[key, program]: mPrograms) {
+        glDeleteProgram(program->id);
+    }
+    for (const auto &[id, mesh]: mMeshes) {
+        glDeleteVertexArrays(1, &mesh->vao);
+        glDeleteBuffers(1, &mesh->vbo);
+        glDeleteBuffers(1, &mesh->ebo);
+    }
+    for (const auto &depthStencil: mDepthStencils) {
+        glDeleteRenderbuffers(1, &depthStencil.renderbuffer);
+    }
+}
+
+GLuint GLResourceCache::acquireDepthStencil(int width, int height) {
+    for (auto &depthStencil: mDepthStencils) {
+        if (depthStencil.width == width && depthStencil.height == height) {
+            depthStencil.users++;
+            return depthStencil.renderbuffer;
+        }
+    }
+    GLuint renderbuffer = 0;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    mDepthStencils.push_back({renderbuffer, width, height, 1});
+    return renderbuffer;
+}
+
+void GLResourceCache::releaseDepthStencil(GLuint renderbuffer) {
+    auto it = std::find_if(mDepthStencils.begin(), mDepthStencils.end(),
+                           [renderbuffer](const DepthStencil &depthStencil) {
+                               return depthStencil.renderbuffer == renderbuffer;
+                           });
+    if (it == mDepthStencils.end()) {
+        LOGE("Releasing unknown depth/stencil renderbuffer %u", renderbuffer);
+        return;
+    }
+    if (--it->users == 0) {
+        glDeleteRenderbuffers(1, &it->renderbuffer);
+        mDepthStencils.erase(it);
+    }
+}
+
+GLResourceCache::DepthStencilStats GLResourceCache::depthStencilStats() const {
+    DepthStencilStats stats;
+    for (const auto &depthStencil: mDepthStencils) {
+        size_t bytes = static_cast<size_t>(depthStencil.width) * depthStencil.height * 4;
+        stats.renderbuffers++;
+        stats.users += depthStencil.users;
+        stats.bytes += bytes;
+        stats.unsharedBytes += bytes * depthStencil.users;
+    }
+    return stats;
+}
+
+const GLResourceCache::Program *GLResourceCache::getProgram(const char *vertexShaderSource,
+                                                           const char *fragmentShaderSource) {
+    std::string key = std::string(vertexShaderSource) + '\0' + fragmentShaderSource;
+    auto it = mPrograms.find(key);
+    if (it != mPrograms.end()) {
+        return it->second.get();
+    }
+
+    auto program = std::make_unique<Program>();
+    program->id = glCreateProgram();
+
+    std::string binaryPath = programBinaryPath(key);
+    if (!loadProgramBinary(program->id, binaryPath)) {
+        if (!linkProgram(program->id, vertexShaderSource, fragmentShaderSource)) {
+            glDeleteProgram(program->id);
+            return nullptr;
+        }
+        saveProgramBinary(program->id, binaryPath);
+    }
+    resolveUniforms(*program);
+
+    return mPrograms.emplace(std::move(key), std::move(program)).first->second.get();
+}
+
+const GLResourceCache::Mesh *GLResourceCache::getMesh(MeshId id) {
+    auto it = mMeshes.find(id);
+    if (it != mMeshes.end()) {
+        return it->second.get();
+    }
+
+    std::unique_ptr<Mesh> mesh;
+    switch (id) {
+        case MeshId::CUBE:
+            mesh = createCube();
+            break;
+    }
+    return mMeshes.emplace(id, std::move(mesh)).first->second.get();
+}
+
+std::string GLResourceCache::programBinaryPath(const std::string &key) const {
+    if (mCacheDir.empty()) {
+        return {};
+    }
+    // Binaries are only valid for the driver which produced them.
+    std::string driverKey = key;
+    for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        driverKey += '\0';
+        driverKey += reinterpret_cast<const char *>(glGetString(name));
+    }
+    char fileName[64];
+    std::snprintf(fileName, sizeof(fileName), "/program-%016zx.bin",
+                  std::hash<std::string>()(driverKey));
+    return mCacheDir + fileName;
+}
+
+bool GLResourceCache::loadProgramBinary(GLuint program, const std::string &path) {
+    if (path.empty()) {
+        return false;
+    }
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    GLenum format = 0;
+    std::vector<char> binary;
+    bool readOk = std::fread(&format, sizeof(format), 1, file) == 1;
+    if (readOk) {
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file) - static_cast<long>(sizeof(format));
+        std::fseek(file, sizeof(format), SEEK_SET);
+        readOk = size > 0;
+        if (readOk) {
+            binary.resize(size);
+            readOk = std::fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+    }
+    std::fclose(file);
+    if (!readOk) {
+        return false;
+    }
+
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // Stale or from another driver, it is recompiled and overwritten.
+        LOGW("Failed to load program binary %s", path.c_str());
+        return false;
+    }
+    LOGD("Loaded program binary %s", path.c_str());
+    return true;
+}
+
+void GLResourceCache::saveProgramBinary(GLuint program, const std::string &path) {
+    if (path.empty()) {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    // Written aside and renamed, so a crash never leaves a truncated binary behind.
+    std::string tmpPath = path + ".tmp";
+    FILE *file = std::fopen(tmpPath.c_str(), "wb");
+    if (!file) {
+        LOGW("Failed to open %s", tmpPath.c_str());
+        return;
+    }
+    bool writeOk = std::fwrite(&format, sizeof(format), 1, file) == 1 &&
+                   std::fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+    writeOk = std::fclose(file) == 0 && writeOk;
+    if (!writeOk || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOGW("Failed to write program binary %s", path.c_str());
+        std::remove(tmpPath.c_str());
+    }
+}
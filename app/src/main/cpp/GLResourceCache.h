@@ -0,0 +1,91 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_GLRESOURCECACHE_H
+#define HELLOSURFACECONTROL_GLRESOURCECACHE_H
+
+#include <GLES3/gl3.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// GL objects shared by every ChildSurface drawing with the same EGL context. Programs are keyed by
+// their shader sources, meshes by MeshId. Linked programs are written to |cacheDir| with
+// glGetProgramBinary, so the next start loads them with glProgramBinary and skips compiling.
+//
+// Depth/stencil renderbuffers are shared by the surfaces of the same size, drawing is sequential on
+// a context. A surface must clear depth/stencil before drawing and may not keep them across
+// draws, see ChildSurface::setDepthTestEnabled().
+//
+// Must be created, used and destroyed with the context current.
+class GLResourceCache {
+public:
+    struct Program {
+        GLuint id = 0;
+
+        // Resolved once when the program is linked or loaded. -1 if |name| is not active.
+        GLint uniformLocation(const char *name) const;
+
+        std::vector<std::pair<std::string, GLint>> uniforms;
+    };
+
+    enum class MeshId {
+        CUBE,
+    };
+
+    struct Mesh {
+        GLuint vao = 0;
+        GLuint vbo = 0;
+        GLuint ebo = 0;
+        GLsizei indexCount = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+    };
+
+    // An empty |cacheDir| disables persisting program binaries.
+    explicit GLResourceCache(std::string cacheDir);
+    ~GLResourceCache();
+
+    GLResourceCache(const GLResourceCache &) = delete;
+    GLResourceCache &operator=(const GLResourceCache &) = delete;
+
+    const Program *getProgram(const char *vertexShaderSource, const char *fragmentShaderSource);
+    const Mesh *getMesh(MeshId id);
+
+    // GL_DEPTH24_STENCIL8, reference counted, released with releaseDepthStencil().
+    GLuint acquireDepthStencil(int width, int height);
+    void releaseDepthStencil(GLuint renderbuffer);
+
+    struct DepthStencilStats {
+        int renderbuffers = 0;
+        int users = 0;
+        size_t bytes = 0;
+        // With a renderbuffer per user.
+        size_t unsharedBytes = 0;
+    };
+    DepthStencilStats depthStencilStats() const;
+
+private:
+    bool loadProgramBinary(GLuint program, const std::string &path);
+    void saveProgramBinary(GLuint program, const std::string &path);
+    std::string programBinaryPath(const std::string &key) const;
+
+    std::string mCacheDir;
+    std::unordered_map<std::string, std::unique_ptr<Program>> mPrograms;
+    std::unordered_map<MeshId, std::unique_ptr<Mesh>> mMeshes;
+
+    struct DepthStencil {
+        GLuint renderbuffer;
+        int width;
+        int height;
+        int users;
+    };
+    // A handful of sizes at most.
+    std::vector<DepthStencil> mDepthStencils;
+};
+
+
+#endif //HELLOSURFACECONTROL_GLRESOURCECACHE_H
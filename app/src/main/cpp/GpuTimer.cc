@@ -0,0 +1,131 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "GpuTimer.h"
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+namespace {
+
+// Resolved once, extension entry points do not depend on the context.
+struct TimerQueryFunctions {
+    PFNGLGENQUERIESEXTPROC genQueries = nullptr;
+    PFNGLDELETEQUERIESEXTPROC deleteQueries = nullptr;
+    PFNGLBEGINQUERYEXTPROC beginQuery = nullptr;
+    PFNGLENDQUERYEXTPROC endQuery = nullptr;
+    PFNGLGETQUERYOBJECTUIVEXTPROC getQueryObjectuiv = nullptr;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC getQueryObjectui64v = nullptr;
+
+    TimerQueryFunctions() {
+        genQueries = reinterpret_cast<PFNGLGENQUERIESEXTPROC>(
+                eglGetProcAddress("glGenQueriesEXT"));
+        deleteQueries = reinterpret_cast<PFNGLDELETEQUERIESEXTPROC>(
+                eglGetProcAddress("glDeleteQueriesEXT"));
+        beginQuery = reinterpret_cast<PFNGLBEGINQUERYEXTPROC>(
+                eglGetProcAddress("glBeginQueryEXT"));
+        endQuery = reinterpret_cast<PFNGLENDQUERYEXTPROC>(eglGetProcAddress("glEndQueryEXT"));
+        getQueryObjectuiv = reinterpret_cast<PFNGLGETQUERYOBJECTUIVEXTPROC>(
+                eglGetProcAddress("glGetQueryObjectuivEXT"));
+        getQueryObjectui64v = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(
+                eglGetProcAddress("glGetQueryObjectui64vEXT"));
+    }
+
+    bool isValid() const {
+        return genQueries && deleteQueries && beginQuery && endQuery && getQueryObjectuiv &&
+               getQueryObjectui64v;
+    }
+};
+
+const TimerQueryFunctions &timerQueryFunctions() {
+    static const TimerQueryFunctions functions;
+    return functions;
+}
+
+}  // namespace
+
+std::atomic<bool> GpuTimer::sEnabled{false};
+
+GpuTimer::~GpuTimer() {
+    if (mSupported == 1) {
+        timerQueryFunctions().deleteQueries(kQueryCount, mQueries.data());
+    }
+}
+
+bool GpuTimer::init() {
+    if (mSupported < 0) {
+        const auto *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+        mSupported = extensions && std::strstr(extensions, "GL_EXT_disjoint_timer_query") &&
+                     timerQueryFunctions().isValid();
+        if (mSupported) {
+            timerQueryFunctions().genQueries(kQueryCount, mQueries.data());
+        } else {
+            LOGW("EXT_disjoint_timer_query is not supported, GPU times are not measured");
+        }
+    }
+    return mSupported == 1;
+}
+
+bool GpuTimer::begin() {
+    if (!init() || mIssued - mCollected == kQueryCount) {
+        return false;
+    }
+    timerQueryFunctions().beginQuery(GL_TIME_ELAPSED_EXT, mQueries[mIssued % kQueryCount]);
+    mActive = true;
+    return true;
+}
+
+void GpuTimer::end() {
+    if (!mActive) {
+        return;
+    }
+    timerQueryFunctions().endQuery(GL_TIME_ELAPSED_EXT);
+    mIssued++;
+    mActive = false;
+}
+
+bool GpuTimer::poll(int64_t *nanos) {
+    if (mCollected == mIssued) {
+        return false;
+    }
+    const auto &functions = timerQueryFunctions();
+    GLuint query = mQueries[mCollected % kQueryCount];
+    GLuint available = GL_FALSE;
+    functions.getQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available) {
+        return false;
+    }
+    // Reading the flag clears it. A disjoint event makes every result in flight meaningless.
+    GLint disjoint = GL_FALSE;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        mCollected = mIssued;
+        return false;
+    }
+    GLuint64 elapsed = 0;
+    functions.getQueryObjectui64v(query, GL_QUERY_RESULT_EXT, &elapsed);
+    // Mesa's llvmpipe counts the very first query of a context from an arbitrary epoch, the
+    // first result of every timer is dropped rather than trusted.
+    if (mCollected++ == 0) {
+        return poll(nanos);
+    }
+    *nanos = static_cast<int64_t>(elapsed);
+    return true;
+}
+
+void RollingDuration::record(int64_t nanos) {
+    int64_t average = mAverage.load(std::memory_order_relaxed);
+    average = average == 0 ? nanos : average + (nanos - average) / kWindow;
+    mAverage.store(average, std::memory_order_relaxed);
+    int64_t peak = mPeak.load(std::memory_order_relaxed);
+    peak = std::max(nanos, peak - peak / kWindow);
+    mPeak.store(peak, std::memory_order_relaxed);
+}
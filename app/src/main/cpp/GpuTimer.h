@@ -0,0 +1,75 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_GPUTIMER_H
+#define HELLOSURFACECONTROL_GPUTIMER_H
+
+#include <GLES2/gl2.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Times the GPU work issued between begin() and end() with EXT_disjoint_timer_query. Queries are
+// read back by poll() a few frames later, once their results are available, so the CPU never waits
+// for the GPU. When every query is still in flight, begin() leaves the interval untimed.
+//
+// Timing is switched on process wide with SetEnabled(). While it is off, callers check IsEnabled()
+// and issue no queries at all. A timer must be used and destroyed on the thread of the context it
+// was first used with, like other GL objects of a ChildSurface.
+class GpuTimer {
+public:
+    static void SetEnabled(bool enabled) { sEnabled.store(enabled, std::memory_order_relaxed); }
+    static bool IsEnabled() { return sEnabled.load(std::memory_order_relaxed); }
+
+    GpuTimer() = default;
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    // Returns false, and end() does nothing, if the interval is not timed: the extension is
+    // missing or every query is still waiting for its result.
+    bool begin();
+    void end();
+
+    // Takes the oldest finished interval's GPU time, returns false if there is none yet. Results
+    // spanning a disjoint event (e.g. a GPU frequency change) are dropped.
+    bool poll(int64_t *nanos);
+
+private:
+    // Frames a result may take to come back before intervals go untimed.
+    static constexpr int kQueryCount = 4;
+
+    bool init();
+
+    static std::atomic<bool> sEnabled;
+
+    // -1 until the context's extensions were checked.
+    int mSupported = -1;
+    std::array<GLuint, kQueryCount> mQueries = {};
+    uint64_t mIssued = 0;
+    uint64_t mCollected = 0;
+    bool mActive = false;
+};
+
+// Rolling statistics of a stream of durations, in nanoseconds: an exponential moving average over
+// roughly the last kWindow samples and the largest recent sample, decaying at the same rate. Written
+// by one thread, readable from any.
+class RollingDuration {
+public:
+    static constexpr int kWindow = 16;
+
+    void record(int64_t nanos);
+
+    int64_t average() const { return mAverage.load(std::memory_order_relaxed); }
+    int64_t peak() const { return mPeak.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> mAverage{0};
+    std::atomic<int64_t> mPeak{0};
+};
+
+
+#endif //HELLOSURFACECONTROL_GPUTIMER_H
@@ -4,15 +4,28 @@
 
 #include "HelloSurfaceControl.h"
 
-#include <android/native_window.h>
+#include <future>
+
+#include "BufferPool.h"
+#include "FrameTracer.h"
+#include "GLFence.h"
+#include "GpuTimer.h"
 #include "Log.h"
 
 #define LOG_TAG "SurfaceControlApp"
 
-constexpr int kChildrenCount = 4;
-constexpr int kChildSize = 800;
+constexpr std::chrono::milliseconds kDefaultDrawOffset(8);
+constexpr uint32_t kFrameStatsInterval = 600;
+
+// The app's original geometry: the inset comes off the left and top edges and twice over off the
+// right and bottom ones. An inset of 0 gives the full bounds.
+static platform::Rect cropRect(const Scene &scene, int surface) {
+    int crop = static_cast<int>(scene.value(Scene::CROP, surface));
+    return {crop, crop, scene.width(surface) - crop * 2, scene.height(surface) - crop * 2};
+}
 
-HelloSurfaceControl::HelloSurfaceControl() {
+HelloSurfaceControl::HelloSurfaceControl(int renderWorkerCount)
+        : mRenderWorkerCount(renderWorkerCount), mFrameScheduler(kDefaultDrawOffset) {
     mThread.emplace([this] { runOnRT(); });
 }
 
@@ -30,7 +43,7 @@ HelloSurfaceControl::~HelloSurfaceControl() {
 
 bool HelloSurfaceControl::initEGLOnRT() {
     // Init EGL
-    mEGLDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    mEGLDisplay = platform::getEGLDisplay();
     if (mEGLDisplay == EGL_NO_DISPLAY) {
         LOGE("Failed to get EGL display");
         return false;
@@ -41,14 +54,14 @@ bool HelloSurfaceControl::initEGLOnRT() {
         return false;
     }
 
-    EGLConfig config;
     EGLint numConfigs;
     EGLint configAttribs[] = {
-            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            // Only surfaceless rendering into BufferQueue images.
+            EGL_SURFACE_TYPE, EGL_DONT_CARE,
             EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
             EGL_NONE
     };
-    if (!eglChooseConfig(mEGLDisplay, configAttribs, &config, 1, &numConfigs)) {
+    if (!eglChooseConfig(mEGLDisplay, configAttribs, &mEGLConfig, 1, &numConfigs)) {
         LOGE("Failed to choose EGL config");
         return false;
     }
@@ -58,7 +71,7 @@ bool HelloSurfaceControl::initEGLOnRT() {
             EGL_NONE
     };
 
-    mEGLContext = eglCreateContext(mEGLDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    mEGLContext = eglCreateContext(mEGLDisplay, mEGLConfig, EGL_NO_CONTEXT, contextAttribs);
     if (mEGLContext == EGL_NO_CONTEXT) {
         LOGE("Failed to create EGL context");
         return false;
@@ -75,6 +88,7 @@ bool HelloSurfaceControl::initEGLOnRT() {
 }
 
 bool HelloSurfaceControl::initVulkanOnRT() {
+#if defined(__ANDROID__)
     VkApplicationInfo appInfo = {};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     appInfo.pApplicationName = "HelloSurfaceControl";
@@ -131,9 +145,13 @@ bool HelloSurfaceControl::initVulkanOnRT() {
 
     LOGD("Vulkan initialized");
     return true;
+#else
+    return false;
+#endif
 }
 
-bool HelloSurfaceControl::initOnRT(ANativeWindow *window) {
+bool HelloSurfaceControl::initOnRT(platform::Window *window, const std::string &cacheDir,
+                                   const std::string &scenePath) {
     LOGD("HelloSurfaceControl::initOnRT()");
 
 //    if (!initVulkanOnRT()) {
@@ -148,33 +166,86 @@ bool HelloSurfaceControl::initOnRT(ANativeWindow *window) {
     assert(mSurfaceControl == nullptr);
 
     mWindow.reset(window);
-    mSurfaceControl.reset(ASurfaceControl_createFromWindow(mWindow.get(), "HelloSurfaceControl"));
+    mSurfaceControl.reset(platform::createSurfaceFromWindow(mWindow.get(), "HelloSurfaceControl"));
     if (mSurfaceControl == nullptr) {
         LOGE("Failed to create ASurfaceControl from ANativeWindow");
         return false;
     }
 
-    int x = 0;
-    int y = 0;
-    float delta = 1.0f;
-    for (int i = 0; i < kChildrenCount; i++) {
-        mChildSurfaces.emplace_back(std::make_shared<ChildSurface>(mDevice, mQueue));
-        mChildSurfaces.back()->init(mSurfaceControl.get(), "HelloSurfaceControlChild");
-        mChildSurfaces.back()->resize(kChildSize, kChildSize);
-        mChildSurfaces.back()->setPosition(x, y);
-        mChildSurfaces.back()->setAnimationDelta(delta);
+    if (mRenderWorkerCount > 0) {
+        mRenderWorkers = RenderWorkerPool::Create(mEGLDisplay, mEGLConfig, mEGLContext,
+                                                  mRenderWorkerCount);
+        if (mRenderWorkers == nullptr) {
+            LOGE("Failed to create %d render workers, drawing on the render thread",
+                 mRenderWorkerCount);
+        }
+    }
+
+    mResourceCaches.resize(renderContextCount());
+    for (int i = 0; i < renderContextCount(); i++) {
+        runOnRenderContext(i, [this, i, &cacheDir] {
+            mResourceCaches[i] = std::make_unique<GLResourceCache>(cacheDir);
+        });
+    }
 
-        x += 80;
-        y += 500;
-        delta *= 1.5f;
+    mTraceTrack = FrameTracer::Get().registerTrack("HelloSurfaceControl");
+
+    mScene = scenePath.empty() ? Scene::CreateDefault() : Scene::Load(scenePath);
+    if (mScene == nullptr) {
+        return false;
+    }
+    for (int i = 0; i < mScene->atlasCount(); i++) {
+        std::string name = "HelloSurfaceControlAtlas" + std::to_string(i);
+        mAtlases.push_back(std::make_shared<SurfaceAtlas>(name.c_str()));
+        mAtlases.back()->setPresentMode(mPresentMode);
+    }
+    mChildSurfaces.reserve(mScene->surfaceCount());
+    mAcquireFences.reserve(mScene->surfaceCount() + mScene->atlasCount());
+    for (int i = 0; i < mScene->surfaceCount(); i++) {
+        mChildSurfaces.emplace_back(std::make_shared<ChildSurface>(mDevice, mQueue));
+        auto &childSurface = mChildSurfaces.back();
+        std::string name = "HelloSurfaceControlChild" + std::to_string(i);
+        int index = drawIndexOf(i);
+        runOnRenderContext(index, [this, i, index, &childSurface, &name] {
+            childSurface->init(mSurfaceControl.get(), name.c_str(),
+                               *mResourceCaches[index % renderContextCount()]);
+            if (mScene->atlas(i) >= 0) {
+                mAtlases[mScene->atlas(i)]->addMember(childSurface);
+            }
+            childSurface->setFrameTimeBudget(mScene->frameTimeBudget(i));
+            childSurface->resize(mScene->width(i), mScene->height(i));
+        });
+        childSurface->setAnimationDelta(mScene->animationDelta(i));
+        childSurface->setBackgroundAnimated(mScene->backgroundAnimated(i));
+        childSurface->setFrameRate(mScene->frameRate(i));
+        childSurface->setDepthTestEnabled(mScene->depthTestEnabled(i));
+        childSurface->setSampleCount(mScene->sampleCount(i));
+        childSurface->setPresentMode(mPresentMode);
+    }
+    // Static properties are set once here, animated ones again by every frame.
+    for (int i = 0; i < mScene->surfaceCount(); i++) {
+        mChildSurfaces[i]->setPosition(static_cast<int>(mScene->value(Scene::X, i)),
+                                       static_cast<int>(mScene->value(Scene::Y, i)));
+        mChildSurfaces[i]->setScale(mScene->value(Scene::SCALE, i),
+                                    mScene->value(Scene::SCALE, i));
+        mChildSurfaces[i]->setAlpha(mScene->value(Scene::ALPHA, i));
+        if (mScene->value(Scene::CROP, i) > 0) {
+            mChildSurfaces[i]->setCrop(cropRect(*mScene, i));
+        }
     }
 
+    mVsyncSource.reset(platform::startVsync(onVsync, this));
+
     return true;
 }
 
-bool HelloSurfaceControl::init(ANativeWindow *window) {
+bool HelloSurfaceControl::init(platform::Window *window, std::string cacheDir,
+                               std::string scenePath) {
     std::unique_lock<std::mutex> lock(mMutex);
-    mTasks.emplace_back([this, window] { initOnRT(window); });
+    mTasks.emplace_back([this, window, cacheDir = std::move(cacheDir),
+                                scenePath = std::move(scenePath)] {
+        initOnRT(window, cacheDir, scenePath);
+    });
     mCondition.notify_one();
     return true;
 }
@@ -197,46 +268,329 @@ void HelloSurfaceControl::update(int format, int width, int height) {
     mCondition.notify_one();
 }
 
-void HelloSurfaceControl::drawOnRT() {
-    ASurfaceTransaction *transaction = ASurfaceTransaction_create();
+void HelloSurfaceControl::setAnimating(bool animating) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasks.emplace_back([this, animating] {
+        mAnimating = animating;
+        for (auto &childSurface: mChildSurfaces) {
+            childSurface->setAnimating(animating);
+        }
+    });
+    mCondition.notify_one();
+}
+
+void HelloSurfaceControl::setPresentMode(BufferQueue::PresentMode mode) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTasks.emplace_back([this, mode] {
+        mPresentMode = mode;
+        for (auto &childSurface: mChildSurfaces) {
+            childSurface->setPresentMode(mode);
+        }
+        for (auto &atlas: mAtlases) {
+            atlas->setPresentMode(mode);
+        }
+    });
+    mCondition.notify_one();
+}
 
-    ASurfaceTransaction_setVisibility(transaction, mSurfaceControl.get(),
-                                      ASurfaceTransactionVisibility::ASURFACE_TRANSACTION_VISIBILITY_SHOW);
+void HelloSurfaceControl::setDrawOffset(std::chrono::nanoseconds drawOffset) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mFrameScheduler.setDrawOffset(drawOffset);
+    mCondition.notify_one();
+}
 
-    const float kAnimationPeriod = 200.0f;
-    float factor = std::abs(
-            .5f - (mFrameCount % static_cast<uint32_t>(kAnimationPeriod)) / kAnimationPeriod);
+FrameScheduler::Stats HelloSurfaceControl::getFrameStats() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mFrameScheduler.stats();
+}
+
+std::vector<HelloSurfaceControl::SurfaceLatency> HelloSurfaceControl::getSurfaceLatencies() {
+    // The children belong to the render thread.
+    std::promise<std::vector<SurfaceLatency>> promise;
+    auto future = promise.get_future();
     {
-        float scale = factor + 0.5f;
-        mChildSurfaces[0]->setScale(scale, scale);
+        std::unique_lock<std::mutex> lock(mMutex);
+        mTasks.emplace_back([this, &promise] {
+            std::vector<SurfaceLatency> latencies;
+            for (const auto &childSurface: mChildSurfaces) {
+                const auto &stats = childSurface->bufferStats();
+                const auto &drawStats = childSurface->drawStats();
+                latencies.push_back({stats.produceToPresent.summary(),
+                                     stats.presentToRelease.summary(),
+                                     stats.starved.summary(),
+                                     stats.droppedFrames.load(std::memory_order_relaxed),
+                                     stats.throttledFrames.load(std::memory_order_relaxed),
+                                     stats.bufferCount.load(std::memory_order_relaxed),
+                                     stats.skippedFrames.load(std::memory_order_relaxed),
+                                     stats.fenceWait.summary(),
+                                     drawStats.cpuEncode.summary(),
+                                     drawStats.gpuTime.summary(),
+                                     drawStats.recentCpuEncode.average(),
+                                     drawStats.recentGpuTime.average(),
+                                     childSurface->resolutionScale()});
+            }
+            promise.set_value(std::move(latencies));
+        });
+        mCondition.notify_one();
     }
+    return future.get();
+}
+
+HelloSurfaceControl::DepthStencilUsage HelloSurfaceControl::getDepthStencilUsage() {
+    std::promise<DepthStencilUsage> promise;
+    auto future = promise.get_future();
     {
-        int crop = 200.0f * factor;
-        mChildSurfaces[1]->setCrop({crop, crop, kChildSize - crop * 2, kChildSize - crop * 2});
+        std::unique_lock<std::mutex> lock(mMutex);
+        mTasks.emplace_back([this, &promise] {
+            DepthStencilUsage usage = {};
+            for (const auto &resourceCache: mResourceCaches) {
+                auto stats = resourceCache->depthStencilStats();
+                usage.shared.renderbuffers += stats.renderbuffers;
+                usage.shared.users += stats.users;
+                usage.shared.bytes += stats.bytes;
+                usage.shared.unsharedBytes += stats.unsharedBytes;
+            }
+            for (const auto &childSurface: mChildSurfaces) {
+                if (!childSurface->depthTestEnabled() && !childSurface->atlas()) {
+                    usage.skippedBytes += static_cast<size_t>(childSurface->targetWidth()) *
+                                          childSurface->targetHeight() * 4;
+                }
+                usage.trafficAvoided += childSurface->depthTrafficAvoided();
+            }
+            promise.set_value(usage);
+        });
+        mCondition.notify_one();
     }
+    return future.get();
+}
+
+std::vector<SurfaceAtlas::Memory> HelloSurfaceControl::getAtlasMemory() {
+    std::promise<std::vector<SurfaceAtlas::Memory>> promise;
+    auto future = promise.get_future();
     {
-        float scale = factor * 2;
-        mChildSurfaces[2]->setAlpha(scale);
+        std::unique_lock<std::mutex> lock(mMutex);
+        mTasks.emplace_back([this, &promise] {
+            std::vector<SurfaceAtlas::Memory> memory;
+            for (const auto &atlas: mAtlases) {
+                memory.push_back(atlas->memory());
+            }
+            promise.set_value(std::move(memory));
+        });
+        mCondition.notify_one();
     }
-    {
-        int x = 600 * factor + 200;
-        int y = 600 * factor + 1100;
-        mChildSurfaces[3]->setPosition(x, y);
+    return future.get();
+}
+
+void HelloSurfaceControl::setTracingEnabled(bool enabled) {
+    FrameTracer::Get().setEnabled(enabled);
+}
+
+bool HelloSurfaceControl::dumpTrace(const std::string &path) {
+    return FrameTracer::Get().dump(path);
+}
+
+void HelloSurfaceControl::setGpuTimingEnabled(bool enabled) {
+    GpuTimer::SetEnabled(enabled);
+}
+
+// static
+void HelloSurfaceControl::onVsync(void *context, int64_t vsyncNanos, int64_t deadlineNanos) {
+    auto *self = reinterpret_cast<HelloSurfaceControl *>(context);
+    std::unique_lock<std::mutex> lock(self->mMutex);
+    self->mVsyncRequested = false;
+    self->mFrameScheduler.onVsync(vsyncNanos, deadlineNanos);
+    self->mCondition.notify_one();
+}
+
+namespace {
+
+struct AppliedTransaction {
+    int track;
+    int64_t applyTime;
+};
+
+}  // namespace
+
+// static
+void HelloSurfaceControl::onTransactionCompleted(void *context, int64_t latchNanos) {
+    // May run after HelloSurfaceControl is gone, so the context only carries trace data.
+    auto *applied = reinterpret_cast<AppliedTransaction *>(context);
+    FrameTracer::Get().slice("apply to latch", applied->track, applied->applyTime, latchNanos);
+    delete applied;
+}
+
+void HelloSurfaceControl::animateOnRT() {
+    mScene->update(mFrameCount);
+    const int count = mScene->surfaceCount();
+    for (int i = 0; i < count; i++) {
+        auto &childSurface = *mChildSurfaces[i];
+        // Off its frame rate's cadence the surface keeps its last state.
+        if (!mScene->isAnimated(i) || !childSurface.isFrameDue()) {
+            continue;
+        }
+        float scale = mScene->value(Scene::SCALE, i);
+        childSurface.setPosition(static_cast<int>(mScene->value(Scene::X, i)),
+                                 static_cast<int>(mScene->value(Scene::Y, i)));
+        childSurface.setScale(scale, scale);
+        childSurface.setAlpha(mScene->value(Scene::ALPHA, i));
+        // Also at an inset of 0, so the crop follows the animation back out.
+        if (mScene->isAnimated(Scene::CROP, i)) {
+            childSurface.setCrop(cropRect(*mScene, i));
+        }
     }
+}
 
+void HelloSurfaceControl::drawOnRT(int64_t vsyncNanos) {
     for (auto &childSurface: mChildSurfaces) {
-//        childSurface->setColor(1.0f, 0.0f, 0.0f, 0.0f);
-//        childSurface->setTransparent(true);
-        childSurface->draw();
-        childSurface->applyChanges(transaction);
+        childSurface->beginFrame(vsyncNanos);
+    }
+    if (mAnimating) {
+        animateOnRT();
+    }
+
+    if (mRenderWorkers) {
+        // Returns once every child is drawn, each child's GLFence carries its GPU work over to
+        // the transaction.
+        mRenderWorkers->parallelFor(drawCount(), [this](int i) { drawOnRenderContext(i); });
+    } else {
+        for (int i = 0; i < drawCount(); i++) {
+            drawOnRenderContext(i);
+        }
+    }
+
+    bool changed = !mRootShown;
+    for (auto &childSurface: mChildSurfaces) {
+        changed = changed || childSurface->hasPendingChanges();
+    }
+    for (auto &atlas: mAtlases) {
+        changed = changed || atlas->hasImageToPresent();
+    }
+    if (changed) {
+        platform::Transaction *transaction = platform::createTransaction();
+
+        if (!mRootShown) {
+            platform::setVisibility(transaction, mSurfaceControl.get(), true);
+            mRootShown = true;
+        }
+
+        // The transaction is latched once all of its buffers are ready, so every buffer can as
+        // well wait on one fence merged from all of theirs.
+        mAcquireFences.clear();
+        for (auto &atlas: mAtlases) {
+            mAcquireFences.push_back(atlas->takeImageToPresent());
+        }
+        for (auto &childSurface: mChildSurfaces) {
+            mAcquireFences.push_back(childSurface->takeImageToPresent());
+        }
+        ScopedFd acquireFence = GLFence::Merge(mAcquireFences.data(), mAcquireFences.size());
+        mAcquireFences.clear();
+
+        // Atlas buffers first, their members' own changes go on top.
+        for (auto &atlas: mAtlases) {
+            atlas->applyChanges(transaction, &acquireFence);
+        }
+        for (auto &childSurface: mChildSurfaces) {
+//            childSurface->setColor(1.0f, 0.0f, 0.0f, 0.0f);
+//            childSurface->setTransparent(true);
+            childSurface->applyChanges(transaction, &acquireFence);
+        }
+        auto &tracer = FrameTracer::Get();
+        if (tracer.isEnabled()) {
+            int64_t now = FrameTracer::now();
+            tracer.instant("apply", mTraceTrack, now);
+            platform::setOnComplete(transaction, new AppliedTransaction{mTraceTrack, now},
+                                    onTransactionCompleted);
+        }
+        platform::applyTransaction(transaction);
+        platform::deleteTransaction(transaction);
     }
-    ASurfaceTransaction_apply(transaction);
-    ASurfaceTransaction_delete(transaction);
     mFrameCount++;
 }
 
+bool HelloSurfaceControl::needsFrameOnRT() const {
+    if (mAnimating || !mRootShown) {
+        return true;
+    }
+    for (const auto &childSurface: mChildSurfaces) {
+        if (childSurface->needsRedraw() || childSurface->hasPendingChanges()) {
+            return true;
+        }
+    }
+    for (const auto &atlas: mAtlases) {
+        if (atlas->needsRedraw() || atlas->hasImageToPresent()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HelloSurfaceControl::trimBuffersOnRT() {
+    for (int i = 0; i < static_cast<int>(mChildSurfaces.size()); i++) {
+        runOnRenderContext(i, [this, i] { mChildSurfaces[i]->trimBuffers(); });
+    }
+    for (int i = 0; i < static_cast<int>(mAtlases.size()); i++) {
+        runOnRenderContext(static_cast<int>(mChildSurfaces.size()) + i,
+                           [this, i] { mAtlases[i]->trimBuffers(); });
+    }
+}
+
+int HelloSurfaceControl::drawIndexOf(int child) const {
+    int atlas = mScene->atlas(child);
+    return atlas < 0 ? child : static_cast<int>(mChildSurfaces.size()) + atlas;
+}
+
+int HelloSurfaceControl::drawCount() const {
+    return static_cast<int>(mChildSurfaces.size() + mAtlases.size());
+}
+
+void HelloSurfaceControl::drawOnRenderContext(int index) {
+    int childCount = static_cast<int>(mChildSurfaces.size());
+    if (index < childCount) {
+        auto &childSurface = mChildSurfaces[index];
+        if (!childSurface->atlas() && childSurface->isFrameDue() && childSurface->needsRedraw()) {
+            childSurface->draw();
+        }
+    } else {
+        auto &atlas = mAtlases[index - childCount];
+        if (atlas->isFrameDue() && atlas->needsRedraw()) {
+            atlas->draw();
+        }
+    }
+}
+
+int HelloSurfaceControl::renderContextCount() const {
+    return mRenderWorkers ? mRenderWorkers->size() : 1;
+}
+
+void HelloSurfaceControl::runOnRenderContext(int index, const std::function<void()> &task) {
+    if (mRenderWorkers) {
+        mRenderWorkers->run(index % mRenderWorkers->size(), task);
+    } else {
+        task();
+    }
+}
+
 void HelloSurfaceControl::releaseOnRT() {
+    mVsyncSource = nullptr;
+
+    // Children and caches own per-context GL objects, release them where they were created.
+    for (int i = 0; i < static_cast<int>(mChildSurfaces.size()); i++) {
+        runOnRenderContext(drawIndexOf(i), [this, i] { mChildSurfaces[i] = nullptr; });
+    }
+    // Atlases go last, they hold their members.
+    for (int i = 0; i < static_cast<int>(mAtlases.size()); i++) {
+        runOnRenderContext(static_cast<int>(mChildSurfaces.size()) + i,
+                           [this, i] { mAtlases[i] = nullptr; });
+    }
+    mAtlases.clear();
     mChildSurfaces.clear();
+    for (int i = 0; i < static_cast<int>(mResourceCaches.size()); i++) {
+        runOnRenderContext(i, [this, i] { mResourceCaches[i] = nullptr; });
+    }
+    mResourceCaches.clear();
+    mRenderWorkers = nullptr;
+    GLFence::TrimPool();
+    BufferPool::Get().clear();
 
     mSurfaceControl = nullptr;
     mWindow = nullptr;
@@ -247,20 +601,56 @@ void HelloSurfaceControl::runOnRT() {
     std::unique_lock<std::mutex> lock(mMutex);
     while (!mBeingDestroyed) {
         while (!mTasks.empty()) {
-            auto task = mTasks.front();
+            auto task = std::move(mTasks.front());
             mTasks.pop_front();
             lock.unlock();
             task();
             lock.lock();
         }
-        if (mReadyToDraw) {
+        if (!mReadyToDraw) {
+            mCondition.wait(lock);
+            continue;
+        }
+        if (auto frame = mFrameScheduler.beginFrame(FrameScheduler::Clock::now())) {
             lock.unlock();
-            drawOnRT();
+            int64_t drawStart = FrameTracer::now();
+            drawOnRT(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    frame->vsync.time_since_epoch()).count());
+            FrameTracer::Get().slice("frame", mTraceTrack, drawStart, FrameTracer::now());
             lock.lock();
+            mBuffersTrimmed = false;
+            mFrameScheduler.endFrame(*frame, FrameScheduler::Clock::now());
+            if (mFrameCount % kFrameStatsInterval == 0) {
+                const auto &stats = mFrameScheduler.stats();
+                LOGD("Frames %llu: %llu deadlines hit, %llu missed, %llu vsyncs dropped",
+                     static_cast<unsigned long long>(stats.frames),
+                     static_cast<unsigned long long>(stats.deadlinesHit),
+                     static_cast<unsigned long long>(stats.deadlinesMissed),
+                     static_cast<unsigned long long>(stats.vsyncsDropped));
+            }
+            continue;
         }
-        mCondition.wait_for(lock, std::chrono::milliseconds(16));
+        if (auto drawTime = mFrameScheduler.nextDrawTime()) {
+            mCondition.wait_until(lock, *drawTime);
+            continue;
+        }
+        // Vsync is only requested while there is something to draw, otherwise sleep until a task
+        // comes in.
+        if (mVsyncSource && !mVsyncRequested && needsFrameOnRT()) {
+            mVsyncRequested = true;
+            platform::requestVsync(mVsyncSource.get());
+        } else if (!mVsyncRequested && !mBuffersTrimmed) {
+            // Going idle, surfaces keep only the buffers they cannot present without.
+            lock.unlock();
+            trimBuffersOnRT();
+            lock.lock();
+            mBuffersTrimmed = true;
+            continue;
+        }
+        mCondition.wait(lock);
     }
 
+    // The vsync thread takes mMutex, stop it unlocked.
+    lock.unlock();
     releaseOnRT();
 }
-
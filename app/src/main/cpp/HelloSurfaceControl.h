@@ -5,64 +5,158 @@
 #ifndef HELLOSURFACECONTROL_HELLOSURFACECONTROL_H
 #define HELLOSURFACECONTROL_HELLOSURFACECONTROL_H
 
-#include <android/surface_control.h>
-#include <vulkan/vulkan.h>
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
 #include <EGL/egl.h>
 
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <optional>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "ChildSurface.h"
+#include "FrameScheduler.h"
+#include "GLResourceCache.h"
+#include "LatencyHistogram.h"
+#include "Platform.h"
+#include "RenderWorkerPool.h"
+#include "Scene.h"
+#include "SurfaceAtlas.h"
 
 class HelloSurfaceControl {
 public:
-    HelloSurfaceControl();
+    // With |renderWorkerCount| > 0 children are drawn in parallel on that many worker threads,
+    // otherwise they are all drawn on the render thread.
+    explicit HelloSurfaceControl(int renderWorkerCount = 0);
     ~HelloSurfaceControl();
 
-    bool init(ANativeWindow* window);
+    // |cacheDir| is where compiled shader programs are persisted, may be empty. The children are
+    // laid out and animated as the scene file at |scenePath| describes, see Scene, or as the
+    // default scene if it is empty.
+    bool init(platform::Window* window, std::string cacheDir, std::string scenePath = {});
     void update(int format, int width, int height);
 
+    // Stopping animations lets the render thread go idle once the last change is presented.
+    void setAnimating(bool animating);
+
+    // Applies to the buffer queues of all children.
+    void setPresentMode(BufferQueue::PresentMode mode);
+
+    // How long before the vsync deadline drawing starts.
+    void setDrawOffset(std::chrono::nanoseconds drawOffset);
+    FrameScheduler::Stats getFrameStats();
+
+    // Buffer lifecycle latencies of each child, in nanoseconds.
+    struct SurfaceLatency {
+        LatencyHistogram::Summary produceToPresent;
+        LatencyHistogram::Summary presentToRelease;
+        LatencyHistogram::Summary starved;
+        uint64_t droppedFrames;
+        uint64_t throttledFrames;
+        int bufferCount;
+        uint64_t skippedFrames;
+        LatencyHistogram::Summary fenceWait;
+        // Empty unless GPU timing is enabled or the surface has a frame time budget.
+        LatencyHistogram::Summary cpuEncode;
+        LatencyHistogram::Summary gpuTime;
+        int64_t recentCpuEncode;
+        int64_t recentGpuTime;
+        // Below 1 while a frame time budget has the surface render at a lower resolution.
+        float resolutionScale;
+    };
+    std::vector<SurfaceLatency> getSurfaceLatencies();
+    // Depth/stencil renderbuffers of the children, see ChildSurface::setDepthTestEnabled().
+    struct DepthStencilUsage {
+        // Shared renderbuffers, summed over the render contexts.
+        GLResourceCache::DepthStencilStats shared;
+        // What children drawing without depth test used to allocate.
+        size_t skippedBytes;
+        uint64_t trafficAvoided;
+    };
+    DepthStencilUsage getDepthStencilUsage();
+    // Buffer memory of each atlas against what its members would take on their own.
+    std::vector<SurfaceAtlas::Memory> getAtlasMemory();
+
+    // Records buffer transitions and transactions into FrameTracer, dumped as Chrome trace JSON.
+    void setTracingEnabled(bool enabled);
+    bool dumpTrace(const std::string& path);
+
+    // Times each child's draw on the GPU, see GpuTimer. Costs nothing while disabled.
+    void setGpuTimingEnabled(bool enabled);
+
 private:
+    static void onVsync(void* context, int64_t vsyncNanos, int64_t deadlineNanos);
+    static void onTransactionCompleted(void* context, int64_t latchNanos);
+
     void runOnRT();
 
     bool initEGLOnRT();
     bool initVulkanOnRT();
-    bool initOnRT(ANativeWindow* window);
+    bool initOnRT(platform::Window* window, const std::string& cacheDir,
+                  const std::string& scenePath);
     void releaseOnRT();
     void updateOnRT(int format, int width, int height);
-    void drawOnRT();
+    void drawOnRT(int64_t vsyncNanos);
+    // Applies the animated scene properties to the children.
+    void animateOnRT();
+    // Whether anything would be drawn or applied by the next frame.
+    bool needsFrameOnRT() const;
+    void trimBuffersOnRT();
+
+    // A child's GL objects live on render context |index % renderContextCount()|, which is a
+    // worker's context or the render thread's own one when there are no workers. Atlases are
+    // indexed after the children, atlas members are drawn with their atlas' index.
+    int renderContextCount() const;
+    int drawIndexOf(int child) const;
+    int drawCount() const;
+    // Draws child or atlas |index| if it needs a frame.
+    void drawOnRenderContext(int index);
+    void runOnRenderContext(int index, const std::function<void()>& task);
 
     std::mutex mMutex;
     std::condition_variable mCondition;
 
     EGLDisplay mEGLDisplay = EGL_NO_DISPLAY;
+    EGLConfig mEGLConfig = nullptr;
     EGLContext mEGLContext = EGL_NO_CONTEXT;
 
     VkInstance mInstance = VK_NULL_HANDLE;
     VkDevice mDevice = VK_NULL_HANDLE;
     VkQueue mQueue = VK_NULL_HANDLE;
 
-    struct ANativeWindowDeleter {
-        void operator()(ANativeWindow* window) const {
-            ANativeWindow_release(window);
-        }
-    };
-    std::unique_ptr<ANativeWindow, ANativeWindowDeleter> mWindow;
-    UniqueASurfaceControl mSurfaceControl;
+    platform::UniqueWindow mWindow;
+    platform::UniqueSurface mSurfaceControl;
 
     int mWidth = 0;
     int mHeight = 0;
 
+    const int mRenderWorkerCount;
+    std::unique_ptr<RenderWorkerPool> mRenderWorkers;
+    // One per render context, VAOs cannot be shared across contexts.
+    std::vector<std::unique_ptr<GLResourceCache>> mResourceCaches;
     std::vector<std::shared_ptr<ChildSurface>> mChildSurfaces;
+    std::unique_ptr<Scene> mScene;
+    std::vector<std::shared_ptr<SurfaceAtlas>> mAtlases;
+    // Fences of the images a frame presents, merged into the acquire fence of its transaction.
+    std::vector<std::shared_ptr<GLFence>> mAcquireFences;
 
     bool mBeingDestroyed = false;
     bool mReadyToDraw = false;
+    bool mAnimating = true;
+    // Whether idle surfaces were trimmed since the last frame.
+    bool mBuffersTrimmed = false;
+    BufferQueue::PresentMode mPresentMode = BufferQueue::PresentMode::FIFO;
+    bool mRootShown = false;
     uint32_t mFrameCount = 0;
+    int mTraceTrack = 0;
+
+    FrameScheduler mFrameScheduler;
+    platform::UniqueVsyncSource mVsyncSource;
+    // Guarded by mMutex, a vsync callback is on its way.
+    bool mVsyncRequested = false;
 
     std::deque<std::function<void()>> mTasks;
     std::optional<std::thread> mThread;
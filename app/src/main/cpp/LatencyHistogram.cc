@@ -0,0 +1,86 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+int highestBit(uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+}  // namespace
+
+// static
+int LatencyHistogram::bucketFor(int64_t nanos) {
+    constexpr int64_t kSubBuckets = 1 << kSubBucketBits;
+    if (nanos < kSubBuckets) {
+        return static_cast<int>(std::max<int64_t>(nanos, 0));
+    }
+    int bit = highestBit(static_cast<uint64_t>(nanos));
+    int subBucket = static_cast<int>((nanos >> (bit - kSubBucketBits)) & (kSubBuckets - 1));
+    return (bit << kSubBucketBits) + subBucket;
+}
+
+// static
+int64_t LatencyHistogram::bucketUpperBound(int bucket) {
+    constexpr int kSubBuckets = 1 << kSubBucketBits;
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    int bit = bucket >> kSubBucketBits;
+    int subBucket = bucket & (kSubBuckets - 1);
+    int64_t width = int64_t{1} << (bit - kSubBucketBits);
+    return (int64_t{1} << bit) + (subBucket + 1) * width - 1;
+}
+
+void LatencyHistogram::record(int64_t nanos) {
+    mBuckets[bucketFor(nanos)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    int64_t max = mMax.load(std::memory_order_relaxed);
+    while (nanos > max && !mMax.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
+    }
+}
+
+int64_t LatencyHistogram::percentile(double percentile) const {
+    // Concurrent record() calls may land in between, so rank against what the buckets hold.
+    uint64_t total = 0;
+    for (const auto &bucket: mBuckets) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(percentile / 100.0 * total));
+    rank = std::clamp<uint64_t>(rank, 1, total);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; i++) {
+        seen += mBuckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return bucketUpperBound(i);
+        }
+    }
+    return bucketUpperBound(kBucketCount - 1);
+}
+
+LatencyHistogram::Summary LatencyHistogram::summary() const {
+    Summary summary;
+    summary.count = count();
+    summary.p50 = percentile(50);
+    summary.p90 = percentile(90);
+    summary.p99 = percentile(99);
+    summary.max = mMax.load(std::memory_order_relaxed);
+    return summary;
+}
+
+void LatencyHistogram::reset() {
+    for (auto &bucket: mBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mMax.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,48 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_LATENCYHISTOGRAM_H
+#define HELLOSURFACECONTROL_LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Durations in nanoseconds, bucketed log-linearly: every power of two is split into 8 buckets, so
+// percentiles are accurate to 12.5%. record() is a couple of relaxed atomic adds, any number of
+// threads may record and read concurrently.
+class LatencyHistogram {
+public:
+    struct Summary {
+        uint64_t count = 0;
+        int64_t p50 = 0;
+        int64_t p90 = 0;
+        int64_t p99 = 0;
+        int64_t max = 0;
+    };
+
+    void record(int64_t nanos);
+
+    uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding the |percentile|th (0 to 100) sample, 0 if empty.
+    int64_t percentile(double percentile) const;
+    Summary summary() const;
+
+    void reset();
+
+private:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr int kBucketCount = 64 << kSubBucketBits;
+
+    static int bucketFor(int64_t nanos);
+    static int64_t bucketUpperBound(int bucket);
+
+    std::array<std::atomic<uint64_t>, kBucketCount> mBuckets{};
+    std::atomic<uint64_t> mCount{0};
+    std::atomic<int64_t> mMax{0};
+};
+
+
+#endif //HELLOSURFACECONTROL_LATENCYHISTOGRAM_H
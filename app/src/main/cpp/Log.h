@@ -5,12 +5,29 @@
 #ifndef HELLOSURFACECONTROL_LOG_H
 #define HELLOSURFACECONTROL_LOG_H
 
-#include <android/log.h>
 #include <cassert>
 
+#if defined(__ANDROID__)
+#include <android/log.h>
+
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 #define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#else
+#include <cstdio>
+
+#define HOST_LOG(level, ...)                                 \
+    do {                                                     \
+        std::fprintf(stderr, level "/" LOG_TAG ": ");        \
+        std::fprintf(stderr, __VA_ARGS__);                   \
+        std::fputc('\n', stderr);                            \
+    } while (0)
+
+#define LOGE(...) HOST_LOG("E", __VA_ARGS__)
+#define LOGW(...) HOST_LOG("W", __VA_ARGS__)
+#define LOGI(...) HOST_LOG("I", __VA_ARGS__)
+#define LOGD(...) HOST_LOG("D", __VA_ARGS__)
+#endif
 
 #endif //HELLOSURFACECONTROL_LOG_H
@@ -6,11 +6,29 @@
 #define HELLOSURFACECONTROL_MATRIX_H
 
 #include <cmath>
+#include <cstddef>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+// Picks the scalar path while constant evaluating, so the builders and operator* stay constexpr.
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define MATRIX_IS_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#endif
+#ifndef MATRIX_IS_CONSTANT_EVALUATED
+#define MATRIX_IS_CONSTANT_EVALUATED() true
+#endif
+
+// Row-major, data[row * 4 + column].
 struct Matrix4x4 {
-    float data[16];
+    alignas(16) float data[16];
 
-    static Matrix4x4 Identity() {
+    static constexpr Matrix4x4 Identity() {
         Matrix4x4 matrix = {
                 .data = {1.0f, 0.0f, 0.0f, 0.0f,
                          0.0f, 1.0f, 0.0f, 0.0f,
@@ -60,11 +78,12 @@ struct Matrix4x4 {
         return matrix;
     }
 
+    // RotateX(angleX) * RotateY(angleY) * RotateZ(angleZ).
     static Matrix4x4 Rotate(float angleX, float angleY, float angleZ) {
-        return RotateX(angleX) * RotateY(angleY) * RotateZ(angleZ);
+        return TranslateRotateScale(0.0f, 0.0f, 0.0f, angleX, angleY, angleZ, 1.0f, 1.0f, 1.0f);
     }
 
-    static Matrix4x4 Translate(float x, float y, float z) {
+    static constexpr Matrix4x4 Translate(float x, float y, float z) {
         Matrix4x4 matrix = {
                 .data = {1.0f, 0.0f, 0.0f, x,
                          0.0f, 1.0f, 0.0f, y,
@@ -74,7 +93,7 @@ struct Matrix4x4 {
         return matrix;
     }
 
-    static Matrix4x4 Scale(float x, float y, float z) {
+    static constexpr Matrix4x4 Scale(float x, float y, float z) {
         Matrix4x4 matrix = {
                 .data = {x, 0.0f, 0.0f, 0.0f,
                          0.0f, y, 0.0f, 0.0f,
@@ -84,22 +103,159 @@ struct Matrix4x4 {
         return matrix;
     }
 
-    Matrix4x4 operator*(const Matrix4x4 &other) const {
+    // Translate(t) * RotateX(a.x) * RotateY(a.y) * RotateZ(a.z) * Scale(s) in closed form, from the
+    // sines and cosines of the angles so it can be constant evaluated.
+    static constexpr Matrix4x4 TranslateRotateScale(float tx, float ty, float tz,
+                                                    float sinX, float cosX,
+                                                    float sinY, float cosY,
+                                                    float sinZ, float cosZ,
+                                                    float sx, float sy, float sz) {
+        Matrix4x4 matrix = {
+                .data = {cosY * cosZ * sx,
+                         -cosY * sinZ * sy,
+                         sinY * sz,
+                         tx,
+
+                         (sinX * sinY * cosZ + cosX * sinZ) * sx,
+                         (cosX * cosZ - sinX * sinY * sinZ) * sy,
+                         -sinX * cosY * sz,
+                         ty,
+
+                         (sinX * sinZ - cosX * sinY * cosZ) * sx,
+                         (cosX * sinY * sinZ + sinX * cosZ) * sy,
+                         cosX * cosY * sz,
+                         tz,
+
+                         0.0f, 0.0f, 0.0f, 1.0f}
+        };
+        return matrix;
+    }
+
+    static Matrix4x4 TranslateRotateScale(float tx, float ty, float tz,
+                                          float angleX, float angleY, float angleZ,
+                                          float sx, float sy, float sz) {
+        return TranslateRotateScale(tx, ty, tz,
+                                    std::sin(angleX), std::cos(angleX),
+                                    std::sin(angleY), std::cos(angleY),
+                                    std::sin(angleZ), std::cos(angleZ),
+                                    sx, sy, sz);
+    }
+
+    constexpr Matrix4x4 operator*(const Matrix4x4 &other) const {
+        if (MATRIX_IS_CONSTANT_EVALUATED()) {
+            return MultiplyScalar(*this, other);
+        }
+        Matrix4x4 result = {};
+        Multiply(*this, other, result);
+        return result;
+    }
+
+    Matrix4x4 &operator*=(const Matrix4x4 &other) {
+        Multiply(*this, other, *this);
+        return *this;
+    }
+
+    // out[i] = lhs * rhs[i]. |out| may alias |rhs|. |lhs| is split into broadcast lanes once for
+    // the whole batch.
+    static void MultiplyBatch(const Matrix4x4 &lhs, const Matrix4x4 *rhs, Matrix4x4 *out,
+                              size_t count) {
+#if defined(__ARM_NEON)
+        float32x4_t l[4];
+        for (int i = 0; i < 4; i++) {
+            l[i] = vld1q_f32(lhs.data + i * 4);
+        }
+        for (size_t n = 0; n < count; n++) {
+            float32x4_t row0 = vld1q_f32(rhs[n].data);
+            float32x4_t row1 = vld1q_f32(rhs[n].data + 4);
+            float32x4_t row2 = vld1q_f32(rhs[n].data + 8);
+            float32x4_t row3 = vld1q_f32(rhs[n].data + 12);
+            for (int i = 0; i < 4; i++) {
+                float32x4_t r = vmulq_lane_f32(row0, vget_low_f32(l[i]), 0);
+                r = vmlaq_lane_f32(r, row1, vget_low_f32(l[i]), 1);
+                r = vmlaq_lane_f32(r, row2, vget_high_f32(l[i]), 0);
+                r = vmlaq_lane_f32(r, row3, vget_high_f32(l[i]), 1);
+                vst1q_f32(out[n].data + i * 4, r);
+            }
+        }
+#elif defined(__SSE__) || defined(_M_X64)
+        __m128 l[16];
+        for (int i = 0; i < 16; i++) {
+            l[i] = _mm_set1_ps(lhs.data[i]);
+        }
+        for (size_t n = 0; n < count; n++) {
+            __m128 row0 = _mm_load_ps(rhs[n].data);
+            __m128 row1 = _mm_load_ps(rhs[n].data + 4);
+            __m128 row2 = _mm_load_ps(rhs[n].data + 8);
+            __m128 row3 = _mm_load_ps(rhs[n].data + 12);
+            for (int i = 0; i < 4; i++) {
+                __m128 r = _mm_mul_ps(l[i * 4], row0);
+                r = _mm_add_ps(r, _mm_mul_ps(l[i * 4 + 1], row1));
+                r = _mm_add_ps(r, _mm_mul_ps(l[i * 4 + 2], row2));
+                r = _mm_add_ps(r, _mm_mul_ps(l[i * 4 + 3], row3));
+                _mm_store_ps(out[n].data + i * 4, r);
+            }
+        }
+#else
+        for (size_t n = 0; n < count; n++) {
+            out[n] = MultiplyScalar(lhs, rhs[n]);
+        }
+#endif
+    }
+
+    static constexpr Matrix4x4 MultiplyScalar(const Matrix4x4 &lhs, const Matrix4x4 &rhs) {
         Matrix4x4 result = {};
         for (int i = 0; i < 4; i++) {
             for (int j = 0; j < 4; j++) {
-                result.data[i * 4 + j] = 0;
+                float sum = 0.0f;
                 for (int k = 0; k < 4; k++) {
-                    result.data[i * 4 + j] += data[i * 4 + k] * other.data[k * 4 + j];
+                    sum += lhs.data[i * 4 + k] * rhs.data[k * 4 + j];
                 }
+                result.data[i * 4 + j] = sum;
             }
         }
         return result;
     }
 
-    Matrix4x4 &operator*=(const Matrix4x4 &other) {
-        *this = *this * other;
-        return *this;
+private:
+    // Each result row is a linear combination of |rhs|'s rows. |out| may alias either input.
+    static void Multiply(const Matrix4x4 &lhs, const Matrix4x4 &rhs, Matrix4x4 &out) {
+#if defined(__ARM_NEON)
+        float32x4_t row0 = vld1q_f32(rhs.data);
+        float32x4_t row1 = vld1q_f32(rhs.data + 4);
+        float32x4_t row2 = vld1q_f32(rhs.data + 8);
+        float32x4_t row3 = vld1q_f32(rhs.data + 12);
+        float32x4_t result[4];
+        for (int i = 0; i < 4; i++) {
+            float32x4_t l = vld1q_f32(lhs.data + i * 4);
+            float32x4_t r = vmulq_lane_f32(row0, vget_low_f32(l), 0);
+            r = vmlaq_lane_f32(r, row1, vget_low_f32(l), 1);
+            r = vmlaq_lane_f32(r, row2, vget_high_f32(l), 0);
+            r = vmlaq_lane_f32(r, row3, vget_high_f32(l), 1);
+            result[i] = r;
+        }
+        for (int i = 0; i < 4; i++) {
+            vst1q_f32(out.data + i * 4, result[i]);
+        }
+#elif defined(__SSE__) || defined(_M_X64)
+        __m128 row0 = _mm_load_ps(rhs.data);
+        __m128 row1 = _mm_load_ps(rhs.data + 4);
+        __m128 row2 = _mm_load_ps(rhs.data + 8);
+        __m128 row3 = _mm_load_ps(rhs.data + 12);
+        __m128 result[4];
+        for (int i = 0; i < 4; i++) {
+            const float *l = lhs.data + i * 4;
+            __m128 r = _mm_mul_ps(_mm_set1_ps(l[0]), row0);
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(l[1]), row1));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(l[2]), row2));
+            r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(l[3]), row3));
+            result[i] = r;
+        }
+        for (int i = 0; i < 4; i++) {
+            _mm_store_ps(out.data + i * 4, result[i]);
+        }
+#else
+        out = MultiplyScalar(lhs, rhs);
+#endif
     }
 };
 
@@ -0,0 +1,155 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "MultisampleTarget.h"
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+namespace {
+
+// Resolved once, extension entry points do not depend on the context.
+struct RenderToTextureFunctions {
+    PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC framebufferTexture2DMultisample = nullptr;
+    PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC renderbufferStorageMultisample = nullptr;
+
+    RenderToTextureFunctions() {
+        framebufferTexture2DMultisample =
+                reinterpret_cast<PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC>(
+                        eglGetProcAddress("glFramebufferTexture2DMultisampleEXT"));
+        renderbufferStorageMultisample =
+                reinterpret_cast<PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC>(
+                        eglGetProcAddress("glRenderbufferStorageMultisampleEXT"));
+    }
+
+    bool isValid() const {
+        return framebufferTexture2DMultisample && renderbufferStorageMultisample;
+    }
+};
+
+const RenderToTextureFunctions &renderToTextureFunctions() {
+    static const RenderToTextureFunctions functions;
+    return functions;
+}
+
+GLuint createRenderbuffer(MultisampleTarget::Mode mode, GLenum format, int samples, int width,
+                          int height) {
+    GLuint renderbuffer = 0;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    // Attachments of a render-to-texture framebuffer must be multisampled the same way.
+    if (mode == MultisampleTarget::Mode::RENDER_TO_TEXTURE) {
+        renderToTextureFunctions().renderbufferStorageMultisample(GL_RENDERBUFFER, samples, format,
+                                                                  width, height);
+    } else {
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, format, width, height);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    return renderbuffer;
+}
+
+}  // namespace
+
+// static
+MultisampleTarget::Mode MultisampleTarget::SupportedMode() {
+    const auto *extensions = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    return extensions && std::strstr(extensions, "GL_EXT_multisampled_render_to_texture") &&
+           renderToTextureFunctions().isValid() ? Mode::RENDER_TO_TEXTURE : Mode::RESOLVE_BLIT;
+}
+
+// static
+int MultisampleTarget::MaxSamples() {
+    GLint samples = 1;
+    glGetIntegerv(SupportedMode() == Mode::RENDER_TO_TEXTURE ? GL_MAX_SAMPLES_EXT : GL_MAX_SAMPLES,
+                  &samples);
+    return std::max(samples, 1);
+}
+
+// static
+void MultisampleTarget::AttachTexture(GLenum target, GLuint texture, int samples) {
+    if (samples > 0) {
+        renderToTextureFunctions().framebufferTexture2DMultisample(
+                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, texture, 0, samples);
+    } else {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, texture, 0);
+    }
+}
+
+MultisampleTarget::MultisampleTarget(BufferQueue &bufferQueue, int samples, int width, int height,
+                                     bool depthStencil)
+        : mBufferQueue(bufferQueue), mMode(SupportedMode()),
+          mSamples(std::min(samples, MaxSamples())), mWidth(width), mHeight(height) {
+    if (depthStencil) {
+        mDepthStencil = createRenderbuffer(mMode, GL_DEPTH24_STENCIL8, mSamples, width, height);
+    }
+    if (mMode == Mode::RENDER_TO_TEXTURE) {
+        mBufferQueue.setRenderToTextureSamples(mSamples);
+        mBufferQueue.attachDepthStencil(mDepthStencil);
+        return;
+    }
+
+    mColor = createRenderbuffer(mMode, GL_RGBA8, mSamples, width, height);
+    glGenFramebuffers(1, &mFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColor);
+    if (mDepthStencil != 0) {
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                                  mDepthStencil);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        LOGE("Multisampled framebuffer is not complete");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+MultisampleTarget::~MultisampleTarget() {
+    if (mMode == Mode::RENDER_TO_TEXTURE) {
+        mBufferQueue.attachDepthStencil(0);
+        mBufferQueue.setRenderToTextureSamples(0);
+    }
+    glDeleteFramebuffers(1, &mFramebuffer);
+    glDeleteRenderbuffers(1, &mColor);
+    glDeleteRenderbuffers(1, &mDepthStencil);
+}
+
+GLuint MultisampleTarget::framebuffer(const BufferQueue::Image &image) const {
+    return mMode == Mode::RENDER_TO_TEXTURE ? image.framebuffer : mFramebuffer;
+}
+
+void MultisampleTarget::resolve(const BufferQueue::Image &image, const platform::Rect &region) {
+    if (mMode == Mode::RENDER_TO_TEXTURE) {
+        return;
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, image.framebuffer);
+    // Multisampled blits must not scale, source and destination rects are the same.
+    glBlitFramebuffer(region.left, region.top, region.right, region.bottom, region.left,
+                      region.top, region.right, region.bottom, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    // The samples are not needed past the resolve.
+    const GLenum attachments[] = {GL_COLOR_ATTACHMENT0};
+    glInvalidateFramebuffer(GL_READ_FRAMEBUFFER, 1, attachments);
+    glBindFramebuffer(GL_FRAMEBUFFER, image.framebuffer);
+}
+
+size_t MultisampleTarget::bytes() const {
+    if (mMode == Mode::RENDER_TO_TEXTURE) {
+        return 0;
+    }
+    size_t sampleBytes = static_cast<size_t>(mWidth) * mHeight * mSamples * 4;
+    return mDepthStencil != 0 ? sampleBytes * 2 : sampleBytes;
+}
+
+size_t MultisampleTarget::resolveTraffic(size_t pixels) const {
+    if (mMode == Mode::RENDER_TO_TEXTURE) {
+        return 0;
+    }
+    return pixels * 4 * (2 * mSamples + 1);
+}
@@ -0,0 +1,77 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_MULTISAMPLETARGET_H
+#define HELLOSURFACECONTROL_MULTISAMPLETARGET_H
+
+#include <GLES3/gl3.h>
+
+#include <cstddef>
+
+#include "BufferQueue.h"
+#include "Platform.h"
+
+// Multisampled drawing into a BufferQueue's images, in one of two ways:
+//
+//   RENDER_TO_TEXTURE  With EXT_multisampled_render_to_texture the queue attaches each image's
+//                      texture multisampled, see BufferQueue::setRenderToTextureSamples(). Tilers
+//                      keep the samples on chip and resolve them as tiles are written out, so the
+//                      frame costs no extra memory nor bandwidth beyond the shading.
+//   RESOLVE_BLIT       Otherwise frames are drawn into multisampled renderbuffers, resolved into the
+//                      image with glBlitFramebuffer and then invalidated.
+//
+// Must be created, used and destroyed with the context of the queue's images current.
+class MultisampleTarget {
+public:
+    enum class Mode {
+        RENDER_TO_TEXTURE,
+        RESOLVE_BLIT,
+    };
+
+    // What the current context supports. Samples are clamped to MaxSamples().
+    static Mode SupportedMode();
+    static int MaxSamples();
+
+    // Attaches |texture| to the bound framebuffer's first color attachment with |samples| using
+    // EXT_multisampled_render_to_texture, or without multisampling if |samples| is 0.
+    static void AttachTexture(GLenum target, GLuint texture, int samples);
+
+    // |depthStencil| adds a multisampled GL_DEPTH24_STENCIL8 attachment.
+    MultisampleTarget(BufferQueue &bufferQueue, int samples, int width, int height,
+                      bool depthStencil);
+    // Back to single sampled images.
+    ~MultisampleTarget();
+
+    MultisampleTarget(const MultisampleTarget &) = delete;
+    MultisampleTarget &operator=(const MultisampleTarget &) = delete;
+
+    Mode mode() const { return mMode; }
+    int samples() const { return mSamples; }
+
+    // The framebuffer to draw |image| into.
+    GLuint framebuffer(const BufferQueue::Image &image) const;
+    // Resolves |region| of the frame just drawn into |image|, if the mode needs it. Leaves the
+    // image's framebuffer bound.
+    void resolve(const BufferQueue::Image &image, const platform::Rect &region);
+
+    // Memory of the multisampled renderbuffers, nothing is allocated for RENDER_TO_TEXTURE.
+    size_t bytes() const;
+    // Estimated memory traffic of resolving |pixels|: writing out, reading back every sample and
+    // writing the result. None for RENDER_TO_TEXTURE.
+    size_t resolveTraffic(size_t pixels) const;
+
+private:
+    BufferQueue &mBufferQueue;
+    Mode mMode;
+    int mSamples;
+    int mWidth;
+    int mHeight;
+    GLuint mColor = 0;
+    GLuint mDepthStencil = 0;
+    // RESOLVE_BLIT only, the images' framebuffers otherwise.
+    GLuint mFramebuffer = 0;
+};
+
+
+#endif //HELLOSURFACECONTROL_MULTISAMPLETARGET_H
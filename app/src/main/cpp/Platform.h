@@ -0,0 +1,177 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_PLATFORM_H
+#define HELLOSURFACECONTROL_PLATFORM_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#if defined(__ANDROID__)
+#include <vulkan/vulkan.h>
+
+struct ANativeWindow;
+#else
+// Vulkan interop is only wired up on Android, host builds just carry the handles around.
+#define VK_NULL_HANDLE nullptr
+typedef struct VkInstance_T *VkInstance;
+typedef struct VkDevice_T *VkDevice;
+typedef struct VkQueue_T *VkQueue;
+typedef struct VkImage_T *VkImage;
+#endif
+
+// Thin backend over the compositor (surfaces and transactions), the graphics buffer allocator and
+// native fences. PlatformAndroid.cc forwards to ASurfaceControl, AHardwareBuffer and the Android
+// EGL extensions. PlatformLinux.cc runs on surfaceless EGL (e.g. Mesa llvmpipe) with an in-process
+// compositor stand-in that latches transactions on a simulated vsync and fires release callbacks
+// from its own thread, the same way the binder thread does on device.
+namespace platform {
+
+struct Window;
+struct Surface;
+struct Transaction;
+struct Buffer;
+struct VsyncSource;
+
+struct Rect {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+};
+
+using BufferReleaseCallback = void (*)(void *context, int releaseFenceFd);
+// |latchNanos| is when the compositor picked the transaction up.
+using TransactionCompletedCallback = void (*)(void *context, int64_t latchNanos);
+// Times are CLOCK_MONOTONIC (std::chrono::steady_clock) nanoseconds. |deadlineNanos| is the latest
+// time a transaction can be applied to be presented in the frame started by this vsync.
+using VsyncCallback = void (*)(void *context, int64_t vsyncNanos, int64_t deadlineNanos);
+
+#if defined(__ANDROID__)
+constexpr GLenum kBufferTextureTarget = GL_TEXTURE_EXTERNAL_OES;
+// Using GL_TEXTURE_EXTERNAL_OES causes problem on Android Emulator.
+//constexpr GLenum kBufferTextureTarget = GL_TEXTURE_2D;
+#else
+// Mesa refuses to attach GL_TEXTURE_EXTERNAL_OES textures to a framebuffer.
+constexpr GLenum kBufferTextureTarget = GL_TEXTURE_2D;
+#endif
+
+// Window
+#if defined(__ANDROID__)
+// Takes over the reference held on |window|.
+Window *windowFromANativeWindow(ANativeWindow *window);
+#else
+Window *createHostWindow(int32_t width, int32_t height);
+// Benchmarks run the host compositor faster than 60Hz so latching does not throttle them.
+void setHostRefreshPeriod(std::chrono::nanoseconds period);
+#endif
+void releaseWindow(Window *window);
+
+// Surface
+Surface *createSurface(Surface *parent, const char *debugName);
+Surface *createSurfaceFromWindow(Window *window, const char *debugName);
+void releaseSurface(Surface *surface);
+
+// Transaction
+Transaction *createTransaction();
+void deleteTransaction(Transaction *transaction);
+void applyTransaction(Transaction *transaction);
+// |callback| is called once on any thread after the applied transaction was latched.
+void setOnComplete(Transaction *transaction, void *context, TransactionCompletedCallback callback);
+
+// |acquireFenceFd| is owned by the transaction. |callback| may be called on any thread.
+void setBuffer(Transaction *transaction, Surface *surface, Buffer *buffer, int acquireFenceFd,
+               void *context, BufferReleaseCallback callback);
+void setVisibility(Transaction *transaction, Surface *surface, bool visible);
+void setCrop(Transaction *transaction, Surface *surface, const Rect &crop);
+void setPosition(Transaction *transaction, Surface *surface, int32_t x, int32_t y);
+void setBufferTransform(Transaction *transaction, Surface *surface, int32_t transform);
+void setScale(Transaction *transaction, Surface *surface, float xScale, float yScale);
+void setBufferAlpha(Transaction *transaction, Surface *surface, float alpha);
+void setColor(Transaction *transaction, Surface *surface, float r, float g, float b, float a);
+void setBufferTransparency(Transaction *transaction, Surface *surface, bool transparent);
+// Rate the surface's content updates at, for the compositor to pick a display rate. 0 is none.
+void setFrameRate(Transaction *transaction, Surface *surface, float frameRate);
+// |rects| are in buffer coordinates and mark what changed since the previously set buffer.
+void setDamageRegion(Transaction *transaction, Surface *surface, const Rect *rects,
+                     uint32_t count);
+
+// Buffer, RGBA8888 usable as a GPU framebuffer, a sampled image and a compositor overlay.
+Buffer *allocateBuffer(uint32_t width, uint32_t height);
+void releaseBuffer(Buffer *buffer);
+
+// Must be called with a current EGL context.
+EGLImageKHR createEGLImage(EGLDisplay display, Buffer *buffer);
+void destroyEGLImage(EGLDisplay display, EGLImageKHR image);
+void bindEGLImageAsTexture(GLenum target, EGLImageKHR image);
+
+// EGL
+EGLDisplay getEGLDisplay();
+
+// Vsync
+// Like Choreographer, |callback| is called once on a platform owned thread for the first vsync after
+// each requestVsync(), so an idle client gets no wakeups. No callback runs after stopVsync().
+VsyncSource *startVsync(VsyncCallback callback, void *context);
+void requestVsync(VsyncSource *source);
+void stopVsync(VsyncSource *source);
+
+// Fence
+// Inserts a fence into the current context's command stream.
+EGLSyncKHR createFence(EGLDisplay display);
+// Takes ownership of |fenceFd|.
+EGLSyncKHR importFence(EGLDisplay display, int fenceFd);
+// Returns -1 if the fence cannot be exported as a native fence fd.
+int dupFenceFd(EGLDisplay display, EGLSyncKHR sync);
+// Makes the GPU wait on |sync| without blocking the calling thread. The host has no native fence
+// syncs, it blocks the calling thread on imported fences.
+bool waitFence(EGLDisplay display, EGLSyncKHR sync);
+void destroyFence(EGLDisplay display, EGLSyncKHR sync);
+// Returns a new fence fd that signals once both have, like SYNC_IOC_MERGE. Neither fd is taken
+// over, -1 stands for a signaled fence and is returned if both are.
+int mergeFenceFds(const char *name, int fenceFd1, int fenceFd2);
+#if !defined(__ANDROID__)
+// Fake sync_file fds, readable once signaled like real ones, so fence handling can be exercised
+// without a GPU exporting fences.
+int createHostFenceFd();
+void signalHostFenceFd(int fenceFd);
+#endif
+
+struct WindowDeleter {
+    void operator()(Window *window) const {
+        releaseWindow(window);
+    }
+};
+
+struct SurfaceDeleter {
+    void operator()(Surface *surface) const {
+        releaseSurface(surface);
+    }
+};
+
+struct VsyncSourceDeleter {
+    void operator()(VsyncSource *source) const {
+        stopVsync(source);
+    }
+};
+
+struct BufferDeleter {
+    void operator()(Buffer *buffer) const {
+        releaseBuffer(buffer);
+    }
+};
+
+using UniqueWindow = std::unique_ptr<Window, WindowDeleter>;
+using UniqueSurface = std::unique_ptr<Surface, SurfaceDeleter>;
+using UniqueBuffer = std::unique_ptr<Buffer, BufferDeleter>;
+using UniqueVsyncSource = std::unique_ptr<VsyncSource, VsyncSourceDeleter>;
+
+}  // namespace platform
+
+#endif //HELLOSURFACECONTROL_PLATFORM_H
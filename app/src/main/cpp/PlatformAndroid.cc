@@ -0,0 +1,362 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "Platform.h"
+
+#include <android/choreographer.h>
+#include <android/hardware_buffer.h>
+#include <android/looper.h>
+#include <android/native_window.h>
+#include <android/surface_control.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <linux/sync_file.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+namespace platform {
+
+namespace {
+
+ANativeWindow *toNative(Window *window) {
+    return reinterpret_cast<ANativeWindow *>(window);
+}
+
+ASurfaceControl *toNative(Surface *surface) {
+    return reinterpret_cast<ASurfaceControl *>(surface);
+}
+
+ASurfaceTransaction *toNative(Transaction *transaction) {
+    return reinterpret_cast<ASurfaceTransaction *>(transaction);
+}
+
+AHardwareBuffer *toNative(Buffer *buffer) {
+    return reinterpret_cast<AHardwareBuffer *>(buffer);
+}
+
+void *gLibAndroid = nullptr;
+using PFN_OnBufferRelease = void (*)(void *_Null_unspecified context,
+                                     int release_fence_fd);
+using PFN_ASurfaceTransaction_setBufferWithRelease = void (*)(
+        ASurfaceTransaction *_Nonnull transaction,
+        ASurfaceControl *_Nonnull surface_control,
+        AHardwareBuffer *_Nonnull buffer,
+        int acquire_fence_fd, void *_Null_unspecified context,
+        PFN_OnBufferRelease _Nonnull func);
+PFN_ASurfaceTransaction_setBufferWithRelease ASurfaceTransaction_setBufferWithReleaseFn = nullptr;
+
+PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROIDFn = nullptr;
+
+struct CompletedCallback {
+    void *context;
+    TransactionCompletedCallback callback;
+
+    static void onComplete(void *context, ASurfaceTransactionStats *stats) {
+        auto *completed = reinterpret_cast<CompletedCallback *>(context);
+        completed->callback(completed->context, ASurfaceTransactionStats_getLatchTime(stats));
+        delete completed;
+    }
+};
+
+}  // namespace
+
+// AChoreographer needs a looper, so vsync is delivered on a dedicated looper thread.
+struct VsyncSource {
+    VsyncCallback callback = nullptr;
+    void *context = nullptr;
+
+    std::mutex mutex;
+    ALooper *looper = nullptr;
+    bool stop = false;
+    bool requested = false;
+    std::thread thread;
+
+    // Only touched on the looper thread.
+    bool posted = false;
+
+    static void onVsync(const AChoreographerFrameCallbackData *data, void *context) {
+        auto *source = reinterpret_cast<VsyncSource *>(context);
+        source->posted = false;
+        int64_t vsyncNanos = AChoreographerFrameCallbackData_getFrameTimeNanos(data);
+        size_t timeline = AChoreographerFrameCallbackData_getPreferredFrameTimelineIndex(data);
+        int64_t deadlineNanos = AChoreographerFrameCallbackData_getFrameTimelineDeadlineNanos(
+                data, timeline);
+        source->callback(source->context, vsyncNanos, deadlineNanos);
+    }
+
+    void run() {
+        ALooper *threadLooper = ALooper_prepare(0);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            looper = threadLooper;
+            ALooper_acquire(looper);
+        }
+        for (;;) {
+            bool post = false;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (stop) {
+                    break;
+                }
+                if (requested && !posted) {
+                    requested = false;
+                    post = true;
+                }
+            }
+            // The choreographer belongs to this thread's looper, so requests are posted from here.
+            if (post) {
+                posted = true;
+                AChoreographer_postVsyncCallback(AChoreographer_getInstance(), onVsync, this);
+            }
+            ALooper_pollOnce(-1, nullptr, nullptr, nullptr);
+        }
+    }
+};
+
+Window *windowFromANativeWindow(ANativeWindow *window) {
+    return reinterpret_cast<Window *>(window);
+}
+
+void releaseWindow(Window *window) {
+    ANativeWindow_release(toNative(window));
+}
+
+Surface *createSurface(Surface *parent, const char *debugName) {
+    return reinterpret_cast<Surface *>(ASurfaceControl_create(toNative(parent), debugName));
+}
+
+Surface *createSurfaceFromWindow(Window *window, const char *debugName) {
+    return reinterpret_cast<Surface *>(
+            ASurfaceControl_createFromWindow(toNative(window), debugName));
+}
+
+void releaseSurface(Surface *surface) {
+    ASurfaceControl_release(toNative(surface));
+}
+
+Transaction *createTransaction() {
+    return reinterpret_cast<Transaction *>(ASurfaceTransaction_create());
+}
+
+void deleteTransaction(Transaction *transaction) {
+    ASurfaceTransaction_delete(toNative(transaction));
+}
+
+void applyTransaction(Transaction *transaction) {
+    ASurfaceTransaction_apply(toNative(transaction));
+}
+
+void setOnComplete(Transaction *transaction, void *context, TransactionCompletedCallback callback) {
+    ASurfaceTransaction_setOnComplete(toNative(transaction),
+                                      new CompletedCallback{context, callback},
+                                      CompletedCallback::onComplete);
+}
+
+void setBuffer(Transaction *transaction, Surface *surface, Buffer *buffer, int acquireFenceFd,
+               void *context, BufferReleaseCallback callback) {
+    if (!gLibAndroid) {
+        gLibAndroid = dlopen("libandroid.so", RTLD_NOW);
+        ASurfaceTransaction_setBufferWithReleaseFn = reinterpret_cast<PFN_ASurfaceTransaction_setBufferWithRelease>(dlsym(
+                gLibAndroid, "ASurfaceTransaction_setBufferWithRelease"));
+        if (!ASurfaceTransaction_setBufferWithReleaseFn) {
+            LOGE("Failed to find ASurfaceTransaction_setBufferWithRelease which is available in Android SDK API level 36+");
+        }
+    }
+    ASurfaceTransaction_setBufferWithReleaseFn(toNative(transaction), toNative(surface),
+                                               toNative(buffer), acquireFenceFd, context,
+                                               callback);
+}
+
+void setVisibility(Transaction *transaction, Surface *surface, bool visible) {
+    ASurfaceTransaction_setVisibility(toNative(transaction), toNative(surface),
+                                      visible
+                                      ? ASurfaceTransactionVisibility::ASURFACE_TRANSACTION_VISIBILITY_SHOW
+                                      : ASurfaceTransactionVisibility::ASURFACE_TRANSACTION_VISIBILITY_HIDE);
+}
+
+void setCrop(Transaction *transaction, Surface *surface, const Rect &crop) {
+    ASurfaceTransaction_setCrop(toNative(transaction), toNative(surface),
+                                {crop.left, crop.top, crop.right, crop.bottom});
+}
+
+void setPosition(Transaction *transaction, Surface *surface, int32_t x, int32_t y) {
+    ASurfaceTransaction_setPosition(toNative(transaction), toNative(surface), x, y);
+}
+
+void setBufferTransform(Transaction *transaction, Surface *surface, int32_t transform) {
+    ASurfaceTransaction_setBufferTransform(toNative(transaction), toNative(surface), transform);
+}
+
+void setScale(Transaction *transaction, Surface *surface, float xScale, float yScale) {
+    ASurfaceTransaction_setScale(toNative(transaction), toNative(surface), xScale, yScale);
+}
+
+void setBufferAlpha(Transaction *transaction, Surface *surface, float alpha) {
+    ASurfaceTransaction_setBufferAlpha(toNative(transaction), toNative(surface), alpha);
+}
+
+void setColor(Transaction *transaction, Surface *surface, float r, float g, float b, float a) {
+    ASurfaceTransaction_setColor(toNative(transaction), toNative(surface), r, g, b, a,
+                                 ADataSpace::ADATASPACE_UNKNOWN);
+}
+
+void setBufferTransparency(Transaction *transaction, Surface *surface, bool transparent) {
+    ASurfaceTransaction_setBufferTransparency(toNative(transaction), toNative(surface),
+                                              transparent
+                                              ? ASURFACE_TRANSACTION_TRANSPARENCY_TRANSPARENT
+                                              : ASURFACE_TRANSACTION_TRANSPARENCY_OPAQUE);
+}
+
+void setFrameRate(Transaction *transaction, Surface *surface, float frameRate) {
+    ASurfaceTransaction_setFrameRate(toNative(transaction), toNative(surface), frameRate,
+                                     ANATIVEWINDOW_FRAME_RATE_COMPATIBILITY_DEFAULT);
+}
+
+void setDamageRegion(Transaction *transaction, Surface *surface, const Rect *rects,
+                     uint32_t count) {
+    static_assert(sizeof(Rect) == sizeof(ARect), "Rect must match ARect");
+    ASurfaceTransaction_setDamageRegion(toNative(transaction), toNative(surface),
+                                        reinterpret_cast<const ARect *>(rects), count);
+}
+
+Buffer *allocateBuffer(uint32_t width, uint32_t height) {
+    AHardwareBuffer *buffer = nullptr;
+    AHardwareBuffer_Desc desc = {};
+    desc.width = width;
+    desc.height = height;
+    desc.layers = 1;
+    desc.format = AHARDWAREBUFFER_FORMAT_R8G8B8A8_UNORM;
+    desc.usage =
+            AHARDWAREBUFFER_USAGE_GPU_SAMPLED_IMAGE | AHARDWAREBUFFER_USAGE_GPU_FRAMEBUFFER |
+            AHARDWAREBUFFER_USAGE_COMPOSER_OVERLAY;
+    if (AHardwareBuffer_allocate(&desc, &buffer) != 0) {
+        LOGE("Failed to allocate AHardwareBuffer");
+        return nullptr;
+    }
+    return reinterpret_cast<Buffer *>(buffer);
+}
+
+void releaseBuffer(Buffer *buffer) {
+    AHardwareBuffer_release(toNative(buffer));
+}
+
+EGLImageKHR createEGLImage(EGLDisplay display, Buffer *buffer) {
+    // Import the AHardwareBuffer to the EGLImage
+    EGLClientBuffer clientBuffer = eglGetNativeClientBufferANDROID(toNative(buffer));
+    EGLImageKHR eglImage = eglCreateImageKHR(display, EGL_NO_CONTEXT,
+                                             EGL_NATIVE_BUFFER_ANDROID,
+                                             clientBuffer, nullptr);
+    if (eglImage == EGL_NO_IMAGE_KHR) {
+        LOGE("Failed to create EGL image");
+    }
+    return eglImage;
+}
+
+void destroyEGLImage(EGLDisplay display, EGLImageKHR image) {
+    eglDestroyImageKHR(display, image);
+}
+
+void bindEGLImageAsTexture(GLenum target, EGLImageKHR image) {
+    glEGLImageTargetTexture2DOES(target, image);
+}
+
+EGLDisplay getEGLDisplay() {
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+VsyncSource *startVsync(VsyncCallback callback, void *context) {
+    auto *source = new VsyncSource();
+    source->callback = callback;
+    source->context = context;
+    source->thread = std::thread([source] { source->run(); });
+    return source;
+}
+
+void requestVsync(VsyncSource *source) {
+    std::unique_lock<std::mutex> lock(source->mutex);
+    source->requested = true;
+    if (source->looper) {
+        ALooper_wake(source->looper);
+    }
+}
+
+void stopVsync(VsyncSource *source) {
+    {
+        std::unique_lock<std::mutex> lock(source->mutex);
+        source->stop = true;
+        if (source->looper) {
+            ALooper_wake(source->looper);
+        }
+    }
+    source->thread.join();
+    if (source->looper) {
+        ALooper_release(source->looper);
+    }
+    delete source;
+}
+
+EGLSyncKHR createFence(EGLDisplay display) {
+    return eglCreateSyncKHR(display, EGL_SYNC_NATIVE_FENCE_ANDROID, nullptr);
+}
+
+EGLSyncKHR importFence(EGLDisplay display, int fenceFd) {
+    EGLint attribs[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fenceFd, EGL_NONE};
+    return eglCreateSyncKHR(display, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+}
+
+int dupFenceFd(EGLDisplay display, EGLSyncKHR sync) {
+    if (eglDupNativeFenceFDANDROIDFn == nullptr) {
+        eglDupNativeFenceFDANDROIDFn = reinterpret_cast<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>(
+                eglGetProcAddress("eglDupNativeFenceFDANDROID"));
+        if (eglDupNativeFenceFDANDROIDFn == nullptr) {
+            LOGE("Failed to eglGetProcAddress eglDupNativeFenceFDANDROID");
+            return -1;
+        }
+    }
+    EGLint fd = eglDupNativeFenceFDANDROIDFn(display, sync);
+    if (fd == EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+        LOGE("Failed to eglDupNativeFenceFDANDROID");
+        return -1;
+    }
+    return fd;
+}
+
+bool waitFence(EGLDisplay display, EGLSyncKHR sync) {
+    return eglWaitSyncKHR(display, sync, 0) == EGL_TRUE;
+}
+
+void destroyFence(EGLDisplay display, EGLSyncKHR sync) {
+    eglDestroySyncKHR(display, sync);
+}
+
+int mergeFenceFds(const char *name, int fenceFd1, int fenceFd2) {
+    if (fenceFd1 < 0 || fenceFd2 < 0) {
+        int fenceFd = std::max(fenceFd1, fenceFd2);
+        return fenceFd < 0 ? -1 : fcntl(fenceFd, F_DUPFD_CLOEXEC, 0);
+    }
+    sync_merge_data data = {};
+    strncpy(data.name, name, sizeof(data.name) - 1);
+    data.fd2 = fenceFd2;
+    int result;
+    do {
+        result = ioctl(fenceFd1, SYNC_IOC_MERGE, &data);
+    } while (result < 0 && (errno == EINTR || errno == EAGAIN));
+    if (result < 0) {
+        LOGE("Failed to merge fences: %s", strerror(errno));
+        return -1;
+    }
+    return data.fence;
+}
+
+}  // namespace platform
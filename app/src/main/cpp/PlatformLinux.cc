@@ -0,0 +1,789 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "Platform.h"
+
+#include <GLES3/gl3.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Log.h"
+#include "ScopedFd.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+namespace platform {
+
+struct Window {
+    int32_t width = 0;
+    int32_t height = 0;
+};
+
+struct Buffer {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLImage image = EGL_NO_IMAGE;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Held by the producer and by every transaction or layer that references the buffer.
+    std::atomic<int> refCount{1};
+};
+
+struct LayerState {
+    Buffer *buffer = nullptr;
+    void *releaseContext = nullptr;
+    BufferReleaseCallback releaseCallback = nullptr;
+
+    bool visible = true;
+    Rect crop = {};
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t transform = 0;
+    float xScale = 1.0f;
+    float yScale = 1.0f;
+    float alpha = 1.0f;
+    float color[4] = {};
+    bool transparent = false;
+    // Recorded only, the host panel does not switch rates.
+    float frameRate = 0.0f;
+    // Bounds of the part of the buffer that changed since the previous one, empty means all of it.
+    // Recorded only, nothing is composited on the host.
+    Rect damage = {};
+};
+
+// Only touched on the compositor thread once created.
+struct Surface : public std::enable_shared_from_this<Surface> {
+    explicit Surface(const char *debugName) : name(debugName) {}
+
+    std::string name;
+    LayerState state;
+};
+
+struct Change {
+    enum : int {
+        BUFFER_CHANGED,
+        VISIBILITY_CHANGED,
+        CROP_CHANGED,
+        POSITION_CHANGED,
+        TRANSFORM_CHANGED,
+        SCALE_CHANGED,
+        ALPHA_CHANGED,
+        COLOR_CHANGED,
+        TRANSPARENT_CHANGED,
+        FRAME_RATE_CHANGED,
+        DAMAGE_CHANGED,
+        REMOVED,
+        MAX_CHANGED_FLAGS,
+    };
+
+    std::shared_ptr<Surface> surface;
+    std::bitset<MAX_CHANGED_FLAGS> flags;
+    LayerState state;
+};
+
+struct CompletedCallback {
+    void *context;
+    TransactionCompletedCallback callback;
+};
+
+struct Transaction {
+    std::vector<Change> changes;
+    std::vector<CompletedCallback> completedCallbacks;
+};
+
+namespace {
+
+// 60Hz panel unless changed by setHostRefreshPeriod().
+std::atomic<int64_t> gRefreshPeriodNanos{16'666'667};
+
+std::chrono::nanoseconds refreshPeriod() {
+    return std::chrono::nanoseconds(gRefreshPeriodNanos.load(std::memory_order_relaxed));
+}
+
+// The compositor and VsyncSource share this clock, like SurfaceFlinger and Choreographer share the
+// hardware vsync.
+std::chrono::steady_clock::time_point nextVsyncAfter(std::chrono::steady_clock::time_point time) {
+    static const auto kEpoch = std::chrono::steady_clock::now();
+    auto period = refreshPeriod();
+    return kEpoch + ((time - kEpoch) / period + 1) * period;
+}
+
+int64_t toNanos(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+struct PendingRelease {
+    Buffer *buffer;
+    void *context;
+    BufferReleaseCallback callback;
+};
+
+void addRelease(const LayerState &state, std::vector<PendingRelease> &releases) {
+    if (state.buffer) {
+        releases.push_back({state.buffer, state.releaseContext, state.releaseCallback});
+    }
+}
+
+// Stand-in for SurfaceFlinger. Applied transactions are latched together on the next simulated
+// vsync, and a buffer is released (with an already signaled fence) once a newer buffer replaces it
+// or its layer goes away.
+class HostCompositor {
+public:
+    static HostCompositor &Get() {
+        static HostCompositor compositor;
+        return compositor;
+    }
+
+    std::shared_ptr<Surface> createSurface(const char *debugName) {
+        auto surface = std::make_shared<Surface>(debugName);
+        std::unique_lock<std::mutex> lock(mMutex);
+        mSurfaces.emplace(surface.get(), surface);
+        return surface;
+    }
+
+    void releaseSurface(Surface *surface) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto it = mSurfaces.find(surface);
+        assert(it != mSurfaces.end());
+        Change change;
+        change.surface = std::move(it->second);
+        change.flags[Change::REMOVED] = true;
+        mPendingChanges.push_back(std::move(change));
+        mSurfaces.erase(it);
+    }
+
+    // Copies, so the transaction keeps its storage for the next frame.
+    void apply(const std::vector<Change> &changes,
+               const std::vector<CompletedCallback> &completedCallbacks) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mPendingChanges.insert(mPendingChanges.end(), changes.begin(), changes.end());
+        mPendingCallbacks.insert(mPendingCallbacks.end(), completedCallbacks.begin(),
+                                 completedCallbacks.end());
+    }
+
+private:
+    HostCompositor() {
+        mThread = std::thread([this] { run(); });
+    }
+
+    ~HostCompositor() {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mQuit = true;
+            mCondition.notify_one();
+        }
+        mThread.join();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mQuit) {
+            auto nextVsync = nextVsyncAfter(std::chrono::steady_clock::now());
+            mCondition.wait_until(lock, nextVsync, [this] { return mQuit; });
+
+            // Swapped with the previous vsync's vectors, which keeps the capacity of both and
+            // lets apply() append without allocating.
+            mLatchingChanges.swap(mPendingChanges);
+            mLatchingCallbacks.swap(mPendingCallbacks);
+            lock.unlock();
+            int64_t latchTime = toNanos(std::chrono::steady_clock::now());
+            size_t latchedChanges = mLatchingChanges.size();
+            size_t latchedCallbacks = mLatchingCallbacks.size();
+            latch(mLatchingChanges);
+            for (const auto &callback: mLatchingCallbacks) {
+                callback.callback(callback.context, latchTime);
+            }
+            mLatchingCallbacks.clear();
+            // The vectors come back as the next pending ones. A client whose transactions pile
+            // up while a vsync is late must still be able to append without allocating.
+            mLatchingChanges.reserve(latchedChanges * kPendingVsyncs);
+            mLatchingCallbacks.reserve(latchedCallbacks * kPendingVsyncs);
+            lock.lock();
+        }
+    }
+
+    static void latch(std::vector<Change> &changes) {
+        std::vector<PendingRelease> releases;
+        for (auto &change: changes) {
+            LayerState &state = change.surface->state;
+            const LayerState &newState = change.state;
+            if (change.flags[Change::BUFFER_CHANGED]) {
+                addRelease(state, releases);
+                state.buffer = newState.buffer;
+                state.releaseContext = newState.releaseContext;
+                state.releaseCallback = newState.releaseCallback;
+            }
+            if (change.flags[Change::VISIBILITY_CHANGED]) {
+                state.visible = newState.visible;
+            }
+            if (change.flags[Change::CROP_CHANGED]) {
+                state.crop = newState.crop;
+            }
+            if (change.flags[Change::POSITION_CHANGED]) {
+                state.x = newState.x;
+                state.y = newState.y;
+            }
+            if (change.flags[Change::TRANSFORM_CHANGED]) {
+                state.transform = newState.transform;
+            }
+            if (change.flags[Change::SCALE_CHANGED]) {
+                state.xScale = newState.xScale;
+                state.yScale = newState.yScale;
+            }
+            if (change.flags[Change::ALPHA_CHANGED]) {
+                state.alpha = newState.alpha;
+            }
+            if (change.flags[Change::COLOR_CHANGED]) {
+                std::copy(std::begin(newState.color), std::end(newState.color), state.color);
+            }
+            if (change.flags[Change::TRANSPARENT_CHANGED]) {
+                state.transparent = newState.transparent;
+            }
+            if (change.flags[Change::FRAME_RATE_CHANGED]) {
+                state.frameRate = newState.frameRate;
+            }
+            if (change.flags[Change::DAMAGE_CHANGED]) {
+                state.damage = newState.damage;
+            }
+            if (change.flags[Change::REMOVED]) {
+                addRelease(state, releases);
+                state.buffer = nullptr;
+            }
+        }
+        changes.clear();
+
+        for (const auto &release: releases) {
+            if (release.callback) {
+                release.callback(release.context, -1);
+            }
+            releaseBuffer(release.buffer);
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    bool mQuit = false;
+    std::unordered_map<Surface *, std::shared_ptr<Surface>> mSurfaces;
+    // How many vsyncs of transactions the pending vectors hold before apply() has to grow them.
+    static constexpr size_t kPendingVsyncs = 4;
+    std::vector<Change> mPendingChanges;
+    std::vector<CompletedCallback> mPendingCallbacks;
+    // Only touched by the compositor thread.
+    std::vector<Change> mLatchingChanges;
+    std::vector<CompletedCallback> mLatchingCallbacks;
+    std::thread mThread;
+};
+
+// Deleted transactions are kept with their storage, so one per frame does not allocate once the
+// vectors have grown.
+class TransactionPool {
+public:
+    static TransactionPool &Get() {
+        static TransactionPool pool;
+        return pool;
+    }
+
+    Transaction *obtain() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mFree.empty()) {
+            mTransactions.push_back(std::make_unique<Transaction>());
+            return mTransactions.back().get();
+        }
+        Transaction *transaction = mFree.back();
+        mFree.pop_back();
+        return transaction;
+    }
+
+    void recycle(Transaction *transaction) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mFree.push_back(transaction);
+    }
+
+private:
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<Transaction>> mTransactions;
+    std::vector<Transaction *> mFree;
+};
+
+Change &changeFor(Transaction *transaction, Surface *surface) {
+    for (auto &change: transaction->changes) {
+        if (change.surface.get() == surface) {
+            return change;
+        }
+    }
+    transaction->changes.emplace_back();
+    transaction->changes.back().surface = surface->shared_from_this();
+    return transaction->changes.back();
+}
+
+PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOESFn = nullptr;
+
+bool isFenceSignaled(int fenceFd) {
+    pollfd fd = {fenceFd, POLLIN, 0};
+    return poll(&fd, 1, 0) > 0;
+}
+
+void signalFence(int fenceFd) {
+    uint64_t value = 1;
+    (void) !write(fenceFd, &value, sizeof(value));
+}
+
+// Host fences are eventfds, readable once written. A merged fence is signaled by a watcher thread
+// once all of its inputs are, the way the kernel signals a merged sync_file.
+class FakeSyncFiles {
+public:
+    static FakeSyncFiles &Get() {
+        static FakeSyncFiles syncFiles;
+        return syncFiles;
+    }
+
+    ~FakeSyncFiles() {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        signalFence(mWake.get());
+        mThread.join();
+    }
+
+    int merge(int fenceFd1, int fenceFd2) {
+        int merged = eventfd(0, EFD_CLOEXEC);
+        if (isFenceSignaled(fenceFd1) && isFenceSignaled(fenceFd2)) {
+            signalFence(merged);
+            return merged;
+        }
+        Merge merge;
+        merge.inputs[0] = ScopedFd(fcntl(fenceFd1, F_DUPFD_CLOEXEC, 0));
+        merge.inputs[1] = ScopedFd(fcntl(fenceFd2, F_DUPFD_CLOEXEC, 0));
+        merge.output = ScopedFd(fcntl(merged, F_DUPFD_CLOEXEC, 0));
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mMerges.push_back(std::move(merge));
+        }
+        signalFence(mWake.get());
+        return merged;
+    }
+
+private:
+    struct Merge {
+        ScopedFd inputs[2];
+        ScopedFd output;
+    };
+
+    FakeSyncFiles() : mWake(eventfd(0, EFD_CLOEXEC)), mThread([this] { run(); }) {}
+
+    void run() {
+        std::vector<pollfd> fds;
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStop) {
+            // Signaled inputs stay readable, only wait on the pending ones.
+            fds.clear();
+            fds.push_back({mWake.get(), POLLIN, 0});
+            for (auto it = mMerges.begin(); it != mMerges.end();) {
+                bool signaled = true;
+                for (const auto &input: it->inputs) {
+                    if (!isFenceSignaled(input.get())) {
+                        fds.push_back({input.get(), POLLIN, 0});
+                        signaled = false;
+                    }
+                }
+                if (signaled) {
+                    signalFence(it->output.get());
+                    it = mMerges.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            lock.unlock();
+            poll(fds.data(), fds.size(), -1);
+            uint64_t value;
+            if (fds[0].revents & POLLIN) {
+                (void) !read(mWake.get(), &value, sizeof(value));
+            }
+            lock.lock();
+        }
+    }
+
+    std::mutex mMutex;
+    std::vector<Merge> mMerges;
+    bool mStop = false;
+    ScopedFd mWake;
+    std::thread mThread;
+};
+
+// There are no native fence syncs on host. An imported fence is a plain EGL fence sync standing
+// for its fd, which it keeps so it can be exported again and waited on.
+class ImportedFences {
+public:
+    static ImportedFences &Get() {
+        static ImportedFences fences;
+        return fences;
+    }
+
+    void add(EGLSyncKHR sync, int fenceFd) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mFds[sync] = ScopedFd(fenceFd);
+    }
+
+    // Returns -1 if |sync| was not imported.
+    int dup(EGLSyncKHR sync) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto it = mFds.find(sync);
+        return it == mFds.end() ? -1 : fcntl(it->second.get(), F_DUPFD_CLOEXEC, 0);
+    }
+
+    void remove(EGLSyncKHR sync) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mFds.erase(sync);
+    }
+
+private:
+    std::mutex mMutex;
+    std::unordered_map<EGLSyncKHR, ScopedFd> mFds;
+};
+
+}  // namespace
+
+struct VsyncSource {
+    VsyncCallback callback = nullptr;
+    void *context = nullptr;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stop = false;
+    bool requested = false;
+    std::thread thread;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stop) {
+            condition.wait(lock, [this] { return stop || requested; });
+            if (stop) {
+                break;
+            }
+            auto vsync = nextVsyncAfter(std::chrono::steady_clock::now());
+            if (condition.wait_until(lock, vsync, [this] { return stop; })) {
+                break;
+            }
+            requested = false;
+            lock.unlock();
+            // The compositor latches on the next vsync.
+            callback(context, toNanos(vsync), toNanos(vsync + refreshPeriod()));
+            lock.lock();
+        }
+    }
+};
+
+Window *createHostWindow(int32_t width, int32_t height) {
+    return new Window{width, height};
+}
+
+void releaseWindow(Window *window) {
+    delete window;
+}
+
+void setHostRefreshPeriod(std::chrono::nanoseconds period) {
+    gRefreshPeriodNanos.store(period.count(), std::memory_order_relaxed);
+}
+
+Surface *createSurface(Surface * /* parent */, const char *debugName) {
+    return HostCompositor::Get().createSurface(debugName).get();
+}
+
+Surface *createSurfaceFromWindow(Window * /* window */, const char *debugName) {
+    return HostCompositor::Get().createSurface(debugName).get();
+}
+
+void releaseSurface(Surface *surface) {
+    HostCompositor::Get().releaseSurface(surface);
+}
+
+Transaction *createTransaction() {
+    return TransactionPool::Get().obtain();
+}
+
+void deleteTransaction(Transaction *transaction) {
+    // Buffers of a transaction which was never applied go straight back to the producer.
+    for (auto &change: transaction->changes) {
+        if (change.flags[Change::BUFFER_CHANGED] && change.state.buffer) {
+            if (change.state.releaseCallback) {
+                change.state.releaseCallback(change.state.releaseContext, -1);
+            }
+            releaseBuffer(change.state.buffer);
+        }
+    }
+    transaction->changes.clear();
+    transaction->completedCallbacks.clear();
+    TransactionPool::Get().recycle(transaction);
+}
+
+void applyTransaction(Transaction *transaction) {
+    HostCompositor::Get().apply(transaction->changes, transaction->completedCallbacks);
+    transaction->changes.clear();
+    transaction->completedCallbacks.clear();
+}
+
+void setOnComplete(Transaction *transaction, void *context, TransactionCompletedCallback callback) {
+    transaction->completedCallbacks.push_back({context, callback});
+}
+
+void setBuffer(Transaction *transaction, Surface *surface, Buffer *buffer, int acquireFenceFd,
+               void *context, BufferReleaseCallback callback) {
+    // Host fences are never exported as fds, the GL work has already been flushed by createFence().
+    ScopedFd acquireFence(acquireFenceFd);
+
+    auto &change = changeFor(transaction, surface);
+    if (change.flags[Change::BUFFER_CHANGED] && change.state.buffer) {
+        if (change.state.releaseCallback) {
+            change.state.releaseCallback(change.state.releaseContext, -1);
+        }
+        releaseBuffer(change.state.buffer);
+    }
+    if (buffer) {
+        buffer->refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    change.flags[Change::BUFFER_CHANGED] = true;
+    change.state.buffer = buffer;
+    change.state.releaseContext = context;
+    change.state.releaseCallback = callback;
+}
+
+void setVisibility(Transaction *transaction, Surface *surface, bool visible) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::VISIBILITY_CHANGED] = true;
+    change.state.visible = visible;
+}
+
+void setCrop(Transaction *transaction, Surface *surface, const Rect &crop) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::CROP_CHANGED] = true;
+    change.state.crop = crop;
+}
+
+void setPosition(Transaction *transaction, Surface *surface, int32_t x, int32_t y) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::POSITION_CHANGED] = true;
+    change.state.x = x;
+    change.state.y = y;
+}
+
+void setBufferTransform(Transaction *transaction, Surface *surface, int32_t transform) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::TRANSFORM_CHANGED] = true;
+    change.state.transform = transform;
+}
+
+void setScale(Transaction *transaction, Surface *surface, float xScale, float yScale) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::SCALE_CHANGED] = true;
+    change.state.xScale = xScale;
+    change.state.yScale = yScale;
+}
+
+void setBufferAlpha(Transaction *transaction, Surface *surface, float alpha) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::ALPHA_CHANGED] = true;
+    change.state.alpha = alpha;
+}
+
+void setColor(Transaction *transaction, Surface *surface, float r, float g, float b, float a) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::COLOR_CHANGED] = true;
+    change.state.color[0] = r;
+    change.state.color[1] = g;
+    change.state.color[2] = b;
+    change.state.color[3] = a;
+}
+
+void setBufferTransparency(Transaction *transaction, Surface *surface, bool transparent) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::TRANSPARENT_CHANGED] = true;
+    change.state.transparent = transparent;
+}
+
+void setFrameRate(Transaction *transaction, Surface *surface, float frameRate) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::FRAME_RATE_CHANGED] = true;
+    change.state.frameRate = frameRate;
+}
+
+void setDamageRegion(Transaction *transaction, Surface *surface, const Rect *rects,
+                     uint32_t count) {
+    auto &change = changeFor(transaction, surface);
+    change.flags[Change::DAMAGE_CHANGED] = true;
+    Rect bounds = {};
+    for (uint32_t i = 0; i < count; i++) {
+        const Rect &rect = rects[i];
+        if (rect.left >= rect.right || rect.top >= rect.bottom) {
+            continue;
+        }
+        bool empty = bounds.left >= bounds.right || bounds.top >= bounds.bottom;
+        bounds = empty ? rect : Rect{std::min(bounds.left, rect.left), std::min(bounds.top, rect.top),
+                                     std::max(bounds.right, rect.right),
+                                     std::max(bounds.bottom, rect.bottom)};
+    }
+    change.state.damage = bounds;
+}
+
+Buffer *allocateBuffer(uint32_t width, uint32_t height) {
+    // There is no gralloc on the host, so buffers are GL textures exported as EGLImages.
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLContext context = eglGetCurrentContext();
+    if (context == EGL_NO_CONTEXT) {
+        LOGE("Host buffers can only be allocated with a current EGL context");
+        return nullptr;
+    }
+
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, static_cast<GLsizei>(width),
+                   static_cast<GLsizei>(height));
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    EGLImage image = eglCreateImage(display, context, EGL_GL_TEXTURE_2D,
+                                    reinterpret_cast<EGLClientBuffer>(static_cast<uintptr_t>(texture)),
+                                    nullptr);
+    // The EGLImage keeps the texture storage alive.
+    glDeleteTextures(1, &texture);
+    if (image == EGL_NO_IMAGE) {
+        LOGE("Failed to create EGL image for host buffer");
+        return nullptr;
+    }
+
+    auto *buffer = new Buffer();
+    buffer->display = display;
+    buffer->image = image;
+    buffer->width = width;
+    buffer->height = height;
+    return buffer;
+}
+
+void releaseBuffer(Buffer *buffer) {
+    if (buffer->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    eglDestroyImage(buffer->display, buffer->image);
+    delete buffer;
+}
+
+EGLImageKHR createEGLImage(EGLDisplay /* display */, Buffer *buffer) {
+    // The buffer already is an EGLImage and owns it.
+    return buffer->image;
+}
+
+void destroyEGLImage(EGLDisplay /* display */, EGLImageKHR /* image */) {}
+
+void bindEGLImageAsTexture(GLenum target, EGLImageKHR image) {
+    if (glEGLImageTargetTexture2DOESFn == nullptr) {
+        glEGLImageTargetTexture2DOESFn = reinterpret_cast<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>(
+                eglGetProcAddress("glEGLImageTargetTexture2DOES"));
+        if (glEGLImageTargetTexture2DOESFn == nullptr) {
+            LOGE("Failed to eglGetProcAddress glEGLImageTargetTexture2DOES");
+            return;
+        }
+    }
+    glEGLImageTargetTexture2DOESFn(target, image);
+}
+
+EGLDisplay getEGLDisplay() {
+    EGLDisplay display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                               reinterpret_cast<void *>(EGL_DEFAULT_DISPLAY),
+                                               nullptr);
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    return display;
+}
+
+VsyncSource *startVsync(VsyncCallback callback, void *context) {
+    auto *source = new VsyncSource();
+    source->callback = callback;
+    source->context = context;
+    source->thread = std::thread([source] { source->run(); });
+    return source;
+}
+
+void requestVsync(VsyncSource *source) {
+    std::unique_lock<std::mutex> lock(source->mutex);
+    source->requested = true;
+    source->condition.notify_one();
+}
+
+void stopVsync(VsyncSource *source) {
+    {
+        std::unique_lock<std::mutex> lock(source->mutex);
+        source->stop = true;
+        source->condition.notify_one();
+    }
+    source->thread.join();
+    delete source;
+}
+
+EGLSyncKHR createFence(EGLDisplay display) {
+    EGLSync sync = eglCreateSync(display, EGL_SYNC_FENCE, nullptr);
+    // Exporting a native fence fd flushes on Android, do the same so the frame gets submitted.
+    glFlush();
+    return sync;
+}
+
+EGLSyncKHR importFence(EGLDisplay display, int fenceFd) {
+    ScopedFd fd(fenceFd);
+    EGLSync sync = eglCreateSync(display, EGL_SYNC_FENCE, nullptr);
+    if (sync != EGL_NO_SYNC) {
+        ImportedFences::Get().add(sync, fd.release());
+    }
+    return sync;
+}
+
+int dupFenceFd(EGLDisplay /* display */, EGLSyncKHR sync) {
+    // Fences created here cannot be exported, only imported ones have an fd.
+    return ImportedFences::Get().dup(sync);
+}
+
+bool waitFence(EGLDisplay display, EGLSyncKHR sync) {
+    // The GPU cannot wait on an imported fd, the calling thread does.
+    ScopedFd fenceFd(ImportedFences::Get().dup(sync));
+    if (fenceFd.isValid()) {
+        pollfd fd = {fenceFd.get(), POLLIN, 0};
+        poll(&fd, 1, -1);
+    }
+    return eglWaitSync(display, sync, 0) == EGL_TRUE;
+}
+
+void destroyFence(EGLDisplay display, EGLSyncKHR sync) {
+    ImportedFences::Get().remove(sync);
+    eglDestroySync(display, sync);
+}
+
+int mergeFenceFds(const char * /* name */, int fenceFd1, int fenceFd2) {
+    if (fenceFd1 < 0 || fenceFd2 < 0) {
+        int fenceFd = std::max(fenceFd1, fenceFd2);
+        return fenceFd < 0 ? -1 : fcntl(fenceFd, F_DUPFD_CLOEXEC, 0);
+    }
+    return FakeSyncFiles::Get().merge(fenceFd1, fenceFd2);
+}
+
+int createHostFenceFd() {
+    return eventfd(0, EFD_CLOEXEC);
+}
+
+void signalHostFenceFd(int fenceFd) {
+    signalFence(fenceFd);
+}
+
+}  // namespace platform
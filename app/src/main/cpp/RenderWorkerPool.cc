@@ -0,0 +1,122 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "RenderWorkerPool.h"
+
+#include <EGL/eglext.h>
+
+#include "GLFence.h"
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+// static
+std::unique_ptr<RenderWorkerPool> RenderWorkerPool::Create(EGLDisplay display, EGLConfig config,
+                                                           EGLContext shareContext,
+                                                           int workerCount) {
+    std::unique_ptr<RenderWorkerPool> pool(new RenderWorkerPool(display, config, shareContext));
+    {
+        std::unique_lock<std::mutex> lock(pool->mMutex);
+        pool->mPending = workerCount;
+        for (int i = 0; i < workerCount; i++) {
+            pool->mThreads.emplace_back([raw = pool.get(), i] { raw->runOnWorker(i); });
+        }
+        // Wait for every worker to set up its context.
+        pool->mDoneCondition.wait(lock, [&pool] { return pool->mPending == 0; });
+        if (pool->mFailedWorkers > 0) {
+            lock.unlock();
+            return nullptr;
+        }
+    }
+    return pool;
+}
+
+RenderWorkerPool::RenderWorkerPool(EGLDisplay display, EGLConfig config, EGLContext shareContext)
+        : mDisplay(display), mConfig(config), mShareContext(shareContext) {}
+
+RenderWorkerPool::~RenderWorkerPool() {
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mQuit = true;
+        mWorkCondition.notify_all();
+    }
+    for (auto &thread: mThreads) {
+        thread.join();
+    }
+}
+
+void RenderWorkerPool::run(int worker, const std::function<void()> &task) {
+    std::function<void(int)> wrapper = [&task](int) { task(); };
+    dispatch(&wrapper, 1, worker);
+}
+
+void RenderWorkerPool::parallelFor(int count, const std::function<void(int)> &task) {
+    dispatch(&task, count, -1);
+}
+
+void RenderWorkerPool::dispatch(const std::function<void(int)> *task, int count, int worker) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mTask = task;
+    mTaskCount = count;
+    mTaskWorker = worker;
+    mPending = worker < 0 ? size() : 1;
+    mGeneration++;
+    mWorkCondition.notify_all();
+    // Join barrier, the caller's task objects have to outlive the job.
+    mDoneCondition.wait(lock, [this] { return mPending == 0; });
+    mTask = nullptr;
+}
+
+void RenderWorkerPool::runOnWorker(int worker) {
+    EGLint contextAttribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 3,
+            EGL_NONE
+    };
+    EGLContext context = eglCreateContext(mDisplay, mConfig, mShareContext, contextAttribs);
+    bool ready = context != EGL_NO_CONTEXT &&
+                 eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+    if (!ready) {
+        LOGE("Failed to create shared EGL context for render worker %d", worker);
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!ready) {
+        mFailedWorkers++;
+    }
+    if (--mPending == 0) {
+        mDoneCondition.notify_one();
+    }
+
+    uint64_t generation = mGeneration;
+    while (true) {
+        mWorkCondition.wait(lock, [&] { return mQuit || mGeneration != generation; });
+        if (mQuit) {
+            break;
+        }
+        generation = mGeneration;
+        if (mTaskWorker >= 0 && mTaskWorker != worker) {
+            continue;
+        }
+
+        const auto *task = mTask;
+        int count = mTaskWorker >= 0 ? 1 : mTaskCount;
+        int first = mTaskWorker >= 0 ? 0 : worker;
+        int step = mTaskWorker >= 0 ? 1 : size();
+        lock.unlock();
+        for (int i = first; i < count; i += step) {
+            (*task)(i);
+        }
+        lock.lock();
+        if (--mPending == 0) {
+            mDoneCondition.notify_one();
+        }
+    }
+    lock.unlock();
+
+    GLFence::TrimPool();
+    if (context != EGL_NO_CONTEXT) {
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(mDisplay, context);
+    }
+}
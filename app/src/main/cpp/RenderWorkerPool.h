@@ -0,0 +1,65 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_RENDERWORKERPOOL_H
+#define HELLOSURFACECONTROL_RENDERWORKERPOOL_H
+
+#include <EGL/egl.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads with an EGL context each, all sharing |shareContext|'s objects. Container objects
+// (framebuffers, VAOs) are not shared between contexts, so work on a given GL object has to keep
+// going to the same worker: parallelFor() always hands index i to worker i % size().
+class RenderWorkerPool {
+public:
+    static std::unique_ptr<RenderWorkerPool> Create(EGLDisplay display, EGLConfig config,
+                                                    EGLContext shareContext, int workerCount);
+    ~RenderWorkerPool();
+
+    RenderWorkerPool(const RenderWorkerPool &) = delete;
+    RenderWorkerPool &operator=(const RenderWorkerPool &) = delete;
+
+    int size() const { return static_cast<int>(mThreads.size()); }
+
+    // Runs |task| on |worker| and waits for it.
+    void run(int worker, const std::function<void()> &task);
+
+    // Runs task(i) for every i in [0, count) and returns once all of them finished.
+    void parallelFor(int count, const std::function<void(int)> &task);
+
+private:
+    RenderWorkerPool(EGLDisplay display, EGLConfig config, EGLContext shareContext);
+
+    void runOnWorker(int worker);
+    void dispatch(const std::function<void(int)> *task, int count, int worker);
+
+    EGLDisplay mDisplay;
+    EGLConfig mConfig;
+    EGLContext mShareContext;
+
+    std::mutex mMutex;
+    std::condition_variable mWorkCondition;
+    std::condition_variable mDoneCondition;
+    bool mQuit = false;
+    uint64_t mGeneration = 0;
+    int mPending = 0;
+    int mFailedWorkers = 0;
+
+    // Current job, worker -1 means every worker takes its share of [0, count).
+    const std::function<void(int)> *mTask = nullptr;
+    int mTaskCount = 0;
+    int mTaskWorker = -1;
+
+    std::vector<std::thread> mThreads;
+};
+
+
+#endif //HELLOSURFACECONTROL_RENDERWORKERPOOL_H
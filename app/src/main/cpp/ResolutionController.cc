@@ -0,0 +1,102 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Each level renders at this fraction of the previous one's width and height, the last at about
+// half of the full size.
+constexpr float kScaleStep = 0.85f;
+// Of the exponential moving average of frame times.
+constexpr int kWindow = 8;
+// Ignored after a change, more than the GPU timer queries in flight.
+constexpr int kSettleSamples = 8;
+// Consecutive samples over budget before scaling down, and under the headroom before scaling up.
+constexpr int kDownSamples = 4;
+constexpr int kUpSamples = 60;
+// Scaling up is held off twice as long, up to this, each time a level did not last that long.
+constexpr int kMaxUpSamples = 960;
+// Scaling up needs the next level's estimated frame time under this fraction of the budget.
+constexpr float kHeadroom = 0.8f;
+
+}  // namespace
+
+// static
+float ResolutionController::Scale(int level) {
+    return std::pow(kScaleStep, static_cast<float>(level));
+}
+
+bool ResolutionController::setBudget(int64_t nanos) {
+    mBudget = nanos;
+    mUpSamples = kUpSamples;
+    mSamplesSinceUp = -1;
+    resetSamples();
+    if (nanos > 0 || mLevel.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    mLevel.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+bool ResolutionController::record(int64_t nanos) {
+    if (!isEnabled()) {
+        return false;
+    }
+    if (mSamples > 0) {
+        // Settling.
+        mSamples--;
+        return false;
+    }
+    mAverage = mAverage == 0 ? nanos : mAverage + (nanos - mAverage) / kWindow;
+
+    if (mSamplesSinceUp >= 0) {
+        mSamplesSinceUp++;
+    }
+    int level = mLevel.load(std::memory_order_relaxed);
+    // Frame time relative to the current level's, if it follows the pixel count.
+    auto cost = [level](int other) {
+        float ratio = Scale(other) / Scale(level);
+        return ratio * ratio;
+    };
+    if (mAverage > mBudget) {
+        mUnderBudget = 0;
+        if (++mOverBudget < kDownSamples || level == kLevelCount - 1) {
+            return false;
+        }
+        int newLevel = level + 1;
+        while (newLevel < kLevelCount - 1 && mAverage * cost(newLevel) > mBudget) {
+            newLevel++;
+        }
+        mLevel.store(newLevel, std::memory_order_relaxed);
+        if (mSamplesSinceUp >= 0 && mSamplesSinceUp < mUpSamples) {
+            // Scaled up too early, the estimate was off.
+            mUpSamples = std::min(mUpSamples * 2, kMaxUpSamples);
+        }
+        mSamplesSinceUp = -1;
+    } else if (level > 0 && mAverage * cost(level - 1) < mBudget * kHeadroom) {
+        mOverBudget = 0;
+        if (++mUnderBudget < mUpSamples) {
+            return false;
+        }
+        mLevel.store(level - 1, std::memory_order_relaxed);
+        mSamplesSinceUp = 0;
+    } else {
+        mOverBudget = 0;
+        mUnderBudget = 0;
+        return false;
+    }
+    resetSamples();
+    return true;
+}
+
+void ResolutionController::resetSamples() {
+    mSamples = kSettleSamples;
+    mAverage = 0;
+    mOverBudget = 0;
+    mUnderBudget = 0;
+}
@@ -0,0 +1,57 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_RESOLUTIONCONTROLLER_H
+#define HELLOSURFACECONTROL_RESOLUTIONCONTROLLER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Picks the resolution a surface renders at, so that the GPU time of its frames stays within a
+// budget. The scale steps through a few fixed levels, which keeps the number of buffer sizes small
+// enough for BufferPool to reuse them.
+//
+// Frame time is taken to grow with the pixel count. Over budget, the scale drops right away to the
+// level the average frame time says fits. It only goes back up one level at a time, after frames
+// stayed well enough under budget for the larger size to fit with room to spare, so it does not
+// oscillate around the budget. A level that has to be left again soon after scaling up to it makes
+// the next scale up wait longer. Samples right after a change are ignored, they may still measure
+// frames of the previous size.
+//
+// Used on the drawing thread, scale() is readable from any.
+class ResolutionController {
+public:
+    static constexpr int kLevelCount = 5;
+
+    // 0, the default, disables the controller and goes back to full resolution. Returns whether
+    // scale() changed.
+    bool setBudget(int64_t nanos);
+    bool isEnabled() const { return mBudget > 0; }
+
+    // Records the GPU time of a frame drawn at scale(), returns whether scale() changed.
+    bool record(int64_t nanos);
+
+    float scale() const { return Scale(mLevel.load(std::memory_order_relaxed)); }
+    // Of the frames since the last change, 0 while settling.
+    int64_t average() const { return mAverage; }
+
+private:
+    static float Scale(int level);
+    void resetSamples();
+
+    int64_t mBudget = 0;
+    std::atomic<int> mLevel{0};
+    int64_t mAverage = 0;
+    // Left to ignore.
+    int mSamples = 0;
+    int mOverBudget = 0;
+    int mUnderBudget = 0;
+    // Under budget samples needed to scale up.
+    int mUpSamples = 0;
+    // -1 unless the last change scaled up.
+    int mSamplesSinceUp = -1;
+};
+
+
+#endif //HELLOSURFACECONTROL_RESOLUTIONCONTROLLER_H
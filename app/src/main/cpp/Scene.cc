@@ -0,0 +1,261 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "Scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+namespace {
+
+// The children HelloSurfaceControl used to hard-code: staggered down the screen, each one
+// exercising a different surface property, the last one with a static background.
+const char *kDefaultScene = R"(
+surface size=800x800 position=0,0 delta=1
+animate scale 0.5 1 200
+surface size=800x800 position=80,500 delta=1.5
+animate crop 0 100 200
+surface size=800x800 position=160,1000 delta=2.25
+animate alpha 0 1 200
+surface size=800x800 position=240,1500 delta=3.375 background=static
+animate x 200 500 200
+animate y 1100 1400 200
+)";
+
+constexpr const char *kPropertyNames[] = {"x", "y", "scale", "alpha", "crop"};
+
+bool parsePair(const std::string &value, char separator, float *first, float *second) {
+    char *end = nullptr;
+    *first = std::strtof(value.c_str(), &end);
+    if (*end != separator) {
+        return false;
+    }
+    const char *secondStart = end + 1;
+    *second = std::strtof(secondStart, &end);
+    return end != secondStart && *end == '\0';
+}
+
+bool parseFloat(const std::string &value, float *result) {
+    char *end = nullptr;
+    *result = std::strtof(value.c_str(), &end);
+    return !value.empty() && *end == '\0';
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<Scene> Scene::CreateDefault() {
+    return Parse(kDefaultScene, "default scene");
+}
+
+// static
+std::unique_ptr<Scene> Scene::Load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        LOGE("Failed to open scene %s", path.c_str());
+        return nullptr;
+    }
+    std::stringstream text;
+    text << file.rdbuf();
+    return Parse(text.str(), path.c_str());
+}
+
+// static
+std::unique_ptr<Scene> Scene::Parse(const std::string &text, const char *name) {
+    std::unique_ptr<Scene> scene(new Scene());
+    std::istringstream lines(text);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::vector<std::string> tokens;
+        for (std::string word; words >> word;) {
+            tokens.push_back(std::move(word));
+        }
+        if (tokens.empty()) {
+            continue;
+        }
+        bool parsed = false;
+        if (tokens[0] == "surface") {
+            parsed = scene->parseSurface(tokens);
+        } else if (tokens[0] == "animate") {
+            parsed = scene->parseAnimation(tokens);
+        }
+        if (!parsed) {
+            LOGE("%s:%d: cannot parse \"%s\"", name, lineNumber, line.c_str());
+            return nullptr;
+        }
+    }
+    if (scene->surfaceCount() == 0) {
+        LOGE("%s has no surfaces", name);
+        return nullptr;
+    }
+    scene->update(0);
+    return scene;
+}
+
+bool Scene::parseSurface(const std::vector<std::string> &tokens) {
+    float width = 800, height = 800;
+    float values[PROPERTY_COUNT] = {0, 0, 1, 1, 0};
+    float delta = 1;
+    bool backgroundAnimated = true;
+    float columns = 1, rows = 1;
+    float spacingX = -1, spacingY = -1;
+    float stagger = 0;
+    float atlasId = -1;
+    float budgetMillis = 0;
+    float frameRate = 0;
+    bool depthTestEnabled = false;
+    float samples = 1;
+    for (size_t i = 1; i < tokens.size(); i++) {
+        auto equals = tokens[i].find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+        std::string key = tokens[i].substr(0, equals);
+        std::string value = tokens[i].substr(equals + 1);
+        bool valid;
+        if (key == "size") {
+            valid = parsePair(value, 'x', &width, &height) && width > 0 && height > 0;
+        } else if (key == "position") {
+            valid = parsePair(value, ',', &values[X], &values[Y]);
+        } else if (key == "scale") {
+            valid = parseFloat(value, &values[SCALE]);
+        } else if (key == "alpha") {
+            valid = parseFloat(value, &values[ALPHA]);
+        } else if (key == "crop") {
+            valid = parseFloat(value, &values[CROP]);
+        } else if (key == "delta") {
+            valid = parseFloat(value, &delta) && delta > 0;
+        } else if (key == "background") {
+            valid = value == "static" || value == "animated";
+            backgroundAnimated = value == "animated";
+        } else if (key == "grid") {
+            valid = parsePair(value, ',', &columns, &rows) && columns >= 1 && rows >= 1;
+        } else if (key == "spacing") {
+            valid = parsePair(value, ',', &spacingX, &spacingY);
+        } else if (key == "stagger") {
+            valid = parseFloat(value, &stagger) && stagger >= 0;
+        } else if (key == "atlas") {
+            valid = parseFloat(value, &atlasId) && atlasId >= 0;
+        } else if (key == "budget") {
+            valid = parseFloat(value, &budgetMillis) && budgetMillis > 0;
+        } else if (key == "fps") {
+            valid = parseFloat(value, &frameRate) && frameRate > 0;
+        } else if (key == "depth") {
+            valid = value == "on" || value == "off";
+            depthTestEnabled = value == "on";
+        } else if (key == "samples") {
+            valid = parseFloat(value, &samples) && samples >= 1;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            return false;
+        }
+    }
+    if (spacingX < 0) {
+        spacingX = width;
+        spacingY = height;
+    }
+
+    int atlas = -1;
+    if (atlasId >= 0) {
+        auto id = std::find(mAtlasIds.begin(), mAtlasIds.end(), static_cast<int>(atlasId));
+        atlas = static_cast<int>(id - mAtlasIds.begin());
+        if (id == mAtlasIds.end()) {
+            mAtlasIds.push_back(static_cast<int>(atlasId));
+        }
+    }
+
+    mLastFirstSurface = surfaceCount();
+    mLastStagger = static_cast<int>(stagger);
+    for (int row = 0; row < static_cast<int>(rows); row++) {
+        for (int column = 0; column < static_cast<int>(columns); column++) {
+            mWidth.push_back(static_cast<int>(width));
+            mHeight.push_back(static_cast<int>(height));
+            mDelta.push_back(delta);
+            mBackgroundAnimated.push_back(backgroundAnimated);
+            mAnimated.push_back(0);
+            mAtlas.push_back(atlas);
+            mFrameTimeBudget.push_back(static_cast<int64_t>(budgetMillis * 1e6));
+            mFrameRate.push_back(frameRate);
+            mDepthTestEnabled.push_back(depthTestEnabled);
+            mSampleCount.push_back(static_cast<int>(samples));
+            for (int property = 0; property < PROPERTY_COUNT; property++) {
+                mValues[property].push_back(values[property]);
+            }
+            mValues[X].back() += column * spacingX;
+            mValues[Y].back() += row * spacingY;
+        }
+    }
+    return true;
+}
+
+bool Scene::parseAnimation(const std::vector<std::string> &tokens) {
+    if (surfaceCount() == 0 || tokens.size() < 5 || tokens.size() > 6) {
+        return false;
+    }
+    int property = 0;
+    while (property < PROPERTY_COUNT && tokens[1] != kPropertyNames[property]) {
+        property++;
+    }
+    float from, to, period;
+    if (property == PROPERTY_COUNT || !parseFloat(tokens[2], &from) ||
+        !parseFloat(tokens[3], &to) || !parseFloat(tokens[4], &period) || period < 1) {
+        return false;
+    }
+    Curve curve = Curve::TRIANGLE;
+    if (tokens.size() == 6) {
+        if (tokens[5] == "sine") {
+            curve = Curve::SINE;
+        } else if (tokens[5] == "sawtooth") {
+            curve = Curve::SAWTOOTH;
+        } else if (tokens[5] != "triangle") {
+            return false;
+        }
+    }
+    for (int surface = mLastFirstSurface; surface < surfaceCount(); surface++) {
+        mTrackProperty.push_back(static_cast<Property>(property));
+        mTrackSurface.push_back(surface);
+        mTrackFrom.push_back(from);
+        mTrackRange.push_back(to - from);
+        mTrackPeriod.push_back(static_cast<uint32_t>(period));
+        mTrackOffset.push_back((surface - mLastFirstSurface) * mLastStagger);
+        mTrackCurve.push_back(curve);
+        mAnimated[surface] |= 1u << property;
+    }
+    return true;
+}
+
+void Scene::update(uint32_t frame) {
+    const size_t trackCount = mTrackSurface.size();
+    for (size_t track = 0; track < trackCount; track++) {
+        uint32_t period = mTrackPeriod[track];
+        float phase = static_cast<float>((frame + mTrackOffset[track]) % period) / period;
+        float progress = phase;
+        switch (mTrackCurve[track]) {
+            case Curve::TRIANGLE:
+                progress = 2.0f * std::abs(0.5f - phase);
+                break;
+            case Curve::SINE:
+                progress = 0.5f - 0.5f * std::cos(2.0f * static_cast<float>(M_PI) * phase);
+                break;
+            case Curve::SAWTOOTH:
+                progress = phase;
+                break;
+        }
+        mValues[mTrackProperty[track]][mTrackSurface[track]] =
+                mTrackFrom[track] + mTrackRange[track] * progress;
+    }
+}
@@ -0,0 +1,130 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_SCENE_H
+#define HELLOSURFACECONTROL_SCENE_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Layout and animation of the child surfaces, loaded from a scene description:
+//
+//   # '#' starts a comment.
+//   surface size=800x800 position=0,0 delta=1.5
+//   animate scale 0.5 1 200 triangle
+//
+// A "surface" line adds a child. Its keys, all optional:
+//   size=WxH            buffer size, 800x800 by default
+//   position=X,Y        in the parent, 0,0 by default
+//   scale=S alpha=A     1 by default
+//   crop=INSET          pixels cropped off the left and top, twice that off the right and
+//                       bottom like the original app, 0 (no crop) by default
+//   delta=D             content animation speed, see ChildSurface::setAnimationDelta()
+//   background=static   only the cube moves, so frames are redrawn partially
+//   grid=COLUMNS,ROWS   adds COLUMNS * ROWS copies, spaced by
+//   spacing=DX,DY       pixels, the surface's own size by default
+//   stagger=FRAMES      animation offset between consecutive copies
+//   atlas=ID            shares buffers with the other surfaces of the same ID, see SurfaceAtlas
+//   budget=MS           GPU time per frame to scale the resolution down for, none by default
+//   fps=RATE            frame rate the surface is drawn at, the display's by default
+//   depth=on            draws with depth test, see ChildSurface::setDepthTestEnabled()
+//   samples=N           anti-aliases with N samples per pixel, see ChildSurface::setSampleCount()
+// "animate PROPERTY FROM TO PERIOD [CURVE]" lines animate a property of the surface above, and of
+// each of its copies, between FROM and TO every PERIOD frames. PROPERTY is x, y, scale, alpha or
+// crop, CURVE is triangle (the default, at TO when the period starts and ends), sine or sawtooth.
+//
+// Properties live in a structure of arrays indexed by surface, and update() evaluates every
+// animation track in one pass over flat arrays, so a scene of hundreds of surfaces costs a few
+// microseconds per frame.
+class Scene {
+public:
+    enum Property : uint8_t {
+        X,
+        Y,
+        SCALE,
+        ALPHA,
+        CROP,
+        PROPERTY_COUNT,
+    };
+
+    enum class Curve : uint8_t {
+        TRIANGLE,
+        SINE,
+        SAWTOOTH,
+    };
+
+    // The four children the app always had.
+    static std::unique_ptr<Scene> CreateDefault();
+    // Returns null and logs the offending line if |path| cannot be read or parsed.
+    static std::unique_ptr<Scene> Load(const std::string &path);
+    static std::unique_ptr<Scene> Parse(const std::string &text, const char *name);
+
+    int surfaceCount() const { return static_cast<int>(mWidth.size()); }
+
+    int width(int surface) const { return mWidth[surface]; }
+    int height(int surface) const { return mHeight[surface]; }
+    float animationDelta(int surface) const { return mDelta[surface]; }
+    bool backgroundAnimated(int surface) const { return mBackgroundAnimated[surface]; }
+    // Index of the surface's atlas in [0, atlasCount()), -1 if it has buffers of its own.
+    int atlas(int surface) const { return mAtlas[surface]; }
+    int atlasCount() const { return static_cast<int>(mAtlasIds.size()); }
+    // See ChildSurface::setFrameTimeBudget(), 0 for none.
+    int64_t frameTimeBudget(int surface) const { return mFrameTimeBudget[surface]; }
+    // See ChildSurface::setFrameRate(), 0 to follow the display.
+    float frameRate(int surface) const { return mFrameRate[surface]; }
+    bool depthTestEnabled(int surface) const { return mDepthTestEnabled[surface]; }
+    int sampleCount(int surface) const { return mSampleCount[surface]; }
+    // Whether update() changes any of the surface's properties, or |property|.
+    bool isAnimated(int surface) const { return mAnimated[surface] != 0; }
+    bool isAnimated(Property property, int surface) const {
+        return (mAnimated[surface] & (1u << property)) != 0;
+    }
+
+    float value(Property property, int surface) const { return mValues[property][surface]; }
+
+    // Evaluates every animation track at |frame|.
+    void update(uint32_t frame);
+
+private:
+    Scene() = default;
+
+    bool parseSurface(const std::vector<std::string> &tokens);
+    bool parseAnimation(const std::vector<std::string> &tokens);
+
+    // Per surface.
+    std::vector<int> mWidth;
+    std::vector<int> mHeight;
+    std::vector<float> mDelta;
+    std::vector<uint8_t> mBackgroundAnimated;
+    // Bit per animated Property.
+    std::vector<uint8_t> mAnimated;
+    std::vector<int> mAtlas;
+    std::vector<int64_t> mFrameTimeBudget;
+    std::vector<float> mFrameRate;
+    std::vector<uint8_t> mDepthTestEnabled;
+    std::vector<int> mSampleCount;
+    std::array<std::vector<float>, PROPERTY_COUNT> mValues;
+
+    // Per animation track.
+    std::vector<Property> mTrackProperty;
+    std::vector<int> mTrackSurface;
+    std::vector<float> mTrackFrom;
+    std::vector<float> mTrackRange;
+    std::vector<uint32_t> mTrackPeriod;
+    std::vector<uint32_t> mTrackOffset;
+    std::vector<Curve> mTrackCurve;
+
+    // The IDs of the scene description, indexed by atlas.
+    std::vector<int> mAtlasIds;
+
+    // Surfaces added by the last "surface" line, which "animate" lines apply to.
+    int mLastFirstSurface = 0;
+    int mLastStagger = 0;
+};
+
+
+#endif //HELLOSURFACECONTROL_SCENE_H
@@ -0,0 +1,294 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#include "SurfaceAtlas.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "ChildSurface.h"
+#include "FrameTracer.h"
+#include "GLFence.h"
+#include "Log.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+namespace {
+
+// Widest atlas pack() aims for, GLES3 guarantees 2048 texels.
+constexpr int kMaxAtlasWidth = 2048;
+// Bilinear filtering of a scaled member reads one texel past its crop.
+constexpr int kPadding = 1;
+// The usual gralloc row alignment in pixels.
+constexpr int kStrideAlignment = 64;
+
+// What an RGBA8888 allocation takes, with rows aligned to kStrideAlignment and allocations
+// rounded up to whole pages.
+size_t allocationBytes(int width, int height) {
+    constexpr size_t kPageSize = 4096;
+    size_t stride = (static_cast<size_t>(width) + kStrideAlignment - 1) / kStrideAlignment *
+                    kStrideAlignment;
+    return (stride * height * 4 + kPageSize - 1) / kPageSize * kPageSize;
+}
+
+}  // namespace
+
+SurfaceAtlas::SurfaceAtlas(const char *debugName)
+        : mDebugName(debugName), mBufferQueue(VK_NULL_HANDLE),
+          mReleaseContexts(std::make_shared<ReleaseContextPool>()) {
+    mBufferQueue.setTraceTrack(FrameTracer::Get().registerTrack(debugName));
+}
+
+SurfaceAtlas::~SurfaceAtlas() {
+    mMembers.clear();
+    glDeleteRenderbuffers(1, &mDepthStencil);
+}
+
+void SurfaceAtlas::addMember(std::shared_ptr<ChildSurface> member) {
+    if (mMembers.empty()) {
+        // Not in the constructor, weak_from_this() is empty there.
+        for (auto &releaseContext: mReleaseContexts->contexts) {
+            releaseContext.owner = weak_from_this();
+        }
+    }
+    member->setAtlas(this);
+    mMembers.push_back(std::move(member));
+    mLayoutDirty = true;
+}
+
+bool SurfaceAtlas::needsRedraw() const {
+    if (mLayoutDirty || mLayoutPending) {
+        return true;
+    }
+    return std::any_of(mMembers.begin(), mMembers.end(),
+                       [](const auto &member) { return member->needsRedraw(); });
+}
+
+bool SurfaceAtlas::isFrameDue() const {
+    if (mLayoutDirty || mLayoutPending) {
+        return true;
+    }
+    return std::any_of(mMembers.begin(), mMembers.end(), [](const auto &member) {
+        return member->isFrameDue() && member->needsRedraw();
+    });
+}
+
+// static
+SurfaceAtlas::Size SurfaceAtlas::Pack(const std::vector<Size> &sizes, int maxWidth, int padding,
+                                      std::vector<platform::Rect> *regions) {
+    regions->assign(sizes.size(), {});
+    std::vector<size_t> order(sizes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sizes](size_t a, size_t b) {
+        return sizes[a].height > sizes[b].height;
+    });
+
+    // Rows about as wide as the atlas is tall, unless a region is wider, and using all of the
+    // aligned stride the atlas pays for anyway.
+    int64_t area = 0;
+    int widest = 0;
+    for (const auto &size: sizes) {
+        area += static_cast<int64_t>(size.width + padding) * (size.height + padding);
+        widest = std::max(widest, size.width);
+    }
+    int rowWidth = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(area))));
+    rowWidth = (rowWidth + kStrideAlignment - 1) / kStrideAlignment * kStrideAlignment;
+    rowWidth = std::max(std::min(rowWidth, maxWidth), widest);
+
+    Size atlasSize = {0, 0};
+    int x = 0;
+    int y = 0;
+    int shelfHeight = 0;
+    for (size_t index: order) {
+        const auto &size = sizes[index];
+        if (x > 0 && x + size.width > rowWidth) {
+            y += shelfHeight + padding;
+            x = 0;
+            shelfHeight = 0;
+        }
+        (*regions)[index] = {x, y, x + size.width, y + size.height};
+        atlasSize.width = std::max(atlasSize.width, x + size.width);
+        atlasSize.height = std::max(atlasSize.height, y + size.height);
+        shelfHeight = std::max(shelfHeight, size.height);
+        x += size.width + padding;
+    }
+    return atlasSize;
+}
+
+void SurfaceAtlas::updateLayout() {
+    if (mLayoutDirty) {
+        std::vector<Size> sizes;
+        sizes.reserve(mMembers.size());
+        for (const auto &member: mMembers) {
+            sizes.push_back({member->targetWidth(), member->targetHeight()});
+        }
+        mPendingSize = Pack(sizes, kMaxAtlasWidth, kPadding, &mPendingRegions);
+        mBufferQueue.resizeAsync(mPendingSize.width, mPendingSize.height);
+        mLayoutDirty = false;
+        mLayoutPending = true;
+    }
+
+    // Depth/stencil only when a member draws with the depth test.
+    bool depthNeeded = std::any_of(mMembers.begin(), mMembers.end(),
+                                   [](const auto &member) { return member->depthTestEnabled(); });
+    bool resized = mBufferQueue.updateSize();
+    if (mDepthStencil != 0 && (!depthNeeded || resized)) {
+        glDeleteRenderbuffers(1, &mDepthStencil);
+        mDepthStencil = 0;
+        mBufferQueue.attachDepthStencil(0);
+    }
+    if (depthNeeded && mDepthStencil == 0 && mBufferQueue.bufferCount() > 0) {
+        glGenRenderbuffers(1, &mDepthStencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, mDepthStencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, mBufferQueue.width(),
+                              mBufferQueue.height());
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        mBufferQueue.attachDepthStencil(mDepthStencil);
+    }
+
+    // A repack that kept the atlas size switches right away, there is nothing to wait for.
+    if (mLayoutPending && mBufferQueue.width() == mPendingSize.width &&
+        mBufferQueue.height() == mPendingSize.height) {
+        for (size_t i = 0; i < mMembers.size(); i++) {
+            mMembers[i]->setAtlasRect(mPendingRegions[i]);
+        }
+        mLayoutPending = false;
+    }
+}
+
+void SurfaceAtlas::draw() {
+    updateLayout();
+    if (mBufferQueue.bufferCount() == 0) {
+        // The first buffers are still being allocated.
+        return;
+    }
+    mBufferQueue.updateBufferCount();
+    const auto *image = mBufferQueue.produceImage();
+    if (!image) {
+        return;
+    }
+    if (image->fence) {
+        image->fence->wait();
+    }
+    for (const auto &member: mMembers) {
+        member->drawIntoAtlas(image->framebuffer);
+    }
+    if (mDepthStencil != 0) {
+        // The framebuffer is still bound.
+        const GLenum attachments[] = {GL_DEPTH_ATTACHMENT, GL_STENCIL_ATTACHMENT};
+        glInvalidateFramebuffer(GL_FRAMEBUFFER, 2, attachments);
+    }
+    mBufferQueue.enqueueProducedImage(GLFence::Create());
+}
+
+SurfaceAtlas::ReleaseContext *SurfaceAtlas::obtainReleaseContext() {
+    for (auto &releaseContext: mReleaseContexts->contexts) {
+        if (!releaseContext.inUse.load(std::memory_order_acquire)) {
+            releaseContext.inUse.store(true, std::memory_order_relaxed);
+            releaseContext.pool = mReleaseContexts;
+            return &releaseContext;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<GLFence> SurfaceAtlas::takeImageToPresent() {
+    mImageToPresentTaken = true;
+    mImageToPresent = nullptr;
+    mImageReleaseContext = nullptr;
+    if (!mBufferQueue.hasImageToPresent()) {
+        return nullptr;
+    }
+    ReleaseContext *releaseContext = obtainReleaseContext();
+    if (releaseContext == nullptr) {
+        LOGE("%s is out of buffer release contexts, presenting next frame", mDebugName.c_str());
+        return nullptr;
+    }
+    const auto *image = mBufferQueue.presentImage();
+    if (!image) {
+        releaseContext->pool = nullptr;
+        releaseContext->inUse.store(false, std::memory_order_release);
+        return nullptr;
+    }
+    mImageToPresent = image;
+    mImageReleaseContext = releaseContext;
+    return image->fence;
+}
+
+void SurfaceAtlas::applyChanges(platform::Transaction *transaction,
+                                const ScopedFd *acquireFence) {
+    if (!mImageToPresentTaken) {
+        takeImageToPresent();
+    }
+    mImageToPresentTaken = false;
+    const auto *image = mImageToPresent;
+    if (!image) {
+        return;
+    }
+    ReleaseContext *releaseContext = mImageReleaseContext;
+    releaseContext->generation = image->generation;
+    releaseContext->pendingReleases = static_cast<int>(mMembers.size());
+    releaseContext->fenceFd.reset();
+    for (const auto &member: mMembers) {
+        int acquireFenceFd = -1;
+        if (acquireFence) {
+            acquireFenceFd = acquireFence->isValid() ?
+                             fcntl(acquireFence->get(), F_DUPFD_CLOEXEC, 0) : -1;
+        } else if (image->fence) {
+            acquireFenceFd = image->fence->getFd().release();
+        }
+        platform::setBuffer(transaction, member->surfaceControl(), image->buffer, acquireFenceFd,
+                            releaseContext, SurfaceAtlas::bufferReleasedCallback);
+    }
+}
+
+// static
+void SurfaceAtlas::bufferReleasedCallback(void *context, int fenceFd) {
+    auto *releaseContext = reinterpret_cast<ReleaseContext *>(context);
+    ScopedFd releaseFence(fenceFd);
+    {
+        std::unique_lock<std::mutex> lock(releaseContext->mutex);
+        if (releaseFence.isValid()) {
+            releaseContext->fenceFd = releaseContext->fenceFd.isValid() ?
+                    ScopedFd(platform::mergeFenceFds("SurfaceAtlas", releaseContext->fenceFd.get(),
+                                                     releaseFence.get())) :
+                    std::move(releaseFence);
+        }
+        if (--releaseContext->pendingReleases > 0) {
+            return;
+        }
+    }
+    // Keeps the contexts alive until this returns, even if the SurfaceAtlas is gone.
+    auto pool = std::move(releaseContext->pool);
+    if (auto self = releaseContext->owner.lock()) {
+        self->mBufferQueue.releasePresentImage(releaseContext->generation,
+                                               releaseContext->fenceFd.release());
+    } else {
+        releaseContext->fenceFd.reset();
+        LOGD("SurfaceAtlas is already destroyed");
+    }
+    releaseContext->inUse.store(false, std::memory_order_release);
+}
+
+SurfaceAtlas::Memory SurfaceAtlas::memory() const {
+    Memory memory;
+    memory.width = mBufferQueue.width();
+    memory.height = mBufferQueue.height();
+    memory.bufferCount = mBufferQueue.bufferCount();
+    // Each image, plus a depth/stencil renderbuffer of the same size if drawn with depth test.
+    int allocations = memory.bufferCount + (mDepthStencil != 0 ? 1 : 0);
+    memory.atlasBytes = allocationBytes(memory.width, memory.height) * allocations;
+    memory.atlasAllocations = allocations;
+    for (const auto &member: mMembers) {
+        int memberAllocations = memory.bufferCount + (member->depthTestEnabled() ? 1 : 0);
+        memory.separateBytes += allocationBytes(member->targetWidth(), member->targetHeight()) *
+                                memberAllocations;
+        memory.separateAllocations += memberAllocations;
+    }
+    return memory;
+}
@@ -0,0 +1,129 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_SURFACEATLAS_H
+#define HELLOSURFACECONTROL_SURFACEATLAS_H
+
+#include <GLES3/gl3.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BufferQueue.h"
+#include "Platform.h"
+#include "ScopedFd.h"
+
+class ChildSurface;
+
+// Several small ChildSurfaces sharing one BufferQueue: each frame they all draw into their own
+// region of one image, which every member's surface is then given, cropped and positioned to show
+// just its region. Saves the per-surface buffers and their allocations, at the cost of redrawing
+// every member whenever one of them needs a frame.
+//
+// Regions are packed into shelves by Pack(). A member's resize() repacks, and the members keep
+// drawing into their old regions until buffers of the new atlas size are allocated.
+//
+// Members must be initialized on, and the atlas used on, the same render context.
+class SurfaceAtlas : public std::enable_shared_from_this<SurfaceAtlas> {
+public:
+    explicit SurfaceAtlas(const char *debugName);
+    ~SurfaceAtlas();
+
+    SurfaceAtlas(const SurfaceAtlas &) = delete;
+    SurfaceAtlas &operator=(const SurfaceAtlas &) = delete;
+
+    // Takes |member| out of its own buffers, its size is that of its last resize().
+    void addMember(std::shared_ptr<ChildSurface> member);
+    const std::vector<std::shared_ptr<ChildSurface>> &members() const { return mMembers; }
+
+    // Repacks before the next frame.
+    void invalidateLayout() { mLayoutDirty = true; }
+
+    bool needsRedraw() const;
+    // Whether a member needing a frame is on its frame rate's cadence, see
+    // ChildSurface::beginFrame(). Every member is redrawn then.
+    bool isFrameDue() const;
+    void draw();
+
+    bool hasImageToPresent() const { return mBufferQueue.hasImageToPresent(); }
+    // Like ChildSurface::takeImageToPresent().
+    std::shared_ptr<GLFence> takeImageToPresent();
+    // Gives the latest image to every member's surface. Members still apply their own changes.
+    // |acquireFence| is like ChildSurface::applyChanges()'s.
+    void applyChanges(platform::Transaction *transaction, const ScopedFd *acquireFence = nullptr);
+
+    void setPresentMode(BufferQueue::PresentMode mode) { mBufferQueue.setPresentMode(mode); }
+    void trimBuffers() { mBufferQueue.trim(); }
+    const BufferQueue::Stats &bufferStats() const { return mBufferQueue.stats(); }
+
+    // Buffer bytes and allocations of the atlas, and what its members would take with buffers of
+    // their own at the same buffer count. Depth/stencil renderbuffers of members drawing with depth
+    // test are included, and bytes are rounded up the way gralloc does.
+    struct Memory {
+        size_t atlasBytes = 0;
+        size_t separateBytes = 0;
+        int atlasAllocations = 0;
+        int separateAllocations = 0;
+        int width = 0;
+        int height = 0;
+        int bufferCount = 0;
+    };
+    Memory memory() const;
+
+    // Shelf packing: regions sorted by height are placed left to right in rows no wider than
+    // |maxWidth| or the widest region, with |padding| pixels between them so filtering does not
+    // bleed across. Returns the atlas size, regions come back in the order of |sizes|.
+    struct Size {
+        int width;
+        int height;
+    };
+    static Size Pack(const std::vector<Size> &sizes, int maxWidth, int padding,
+                     std::vector<platform::Rect> *regions);
+
+private:
+    // Shared by the release callbacks of every member's surface for one presented image, which
+    // goes back to the queue once all of them released it, with their fences merged.
+    struct ReleaseContextPool;
+    struct ReleaseContext {
+        std::weak_ptr<SurfaceAtlas> owner;
+        std::shared_ptr<ReleaseContextPool> pool;
+        uint32_t generation = 0;
+        std::mutex mutex;
+        int pendingReleases = 0;
+        ScopedFd fenceFd;
+        std::atomic<bool> inUse{false};
+    };
+    struct ReleaseContextPool {
+        std::array<ReleaseContext, BufferQueue::kMaxBufferCount * 2> contexts;
+    };
+
+    ReleaseContext *obtainReleaseContext();
+    static void bufferReleasedCallback(void *context, int fenceFd);
+
+    void updateLayout();
+
+    std::string mDebugName;
+    BufferQueue mBufferQueue;
+    std::shared_ptr<ReleaseContextPool> mReleaseContexts;
+    GLuint mDepthStencil = 0;
+    std::vector<std::shared_ptr<ChildSurface>> mMembers;
+    // Set by takeImageToPresent() for the next applyChanges().
+    bool mImageToPresentTaken = false;
+    const BufferQueue::Image *mImageToPresent = nullptr;
+    ReleaseContext *mImageReleaseContext = nullptr;
+
+    bool mLayoutDirty = false;
+    // Layout waiting for buffers of its size.
+    bool mLayoutPending = false;
+    std::vector<platform::Rect> mPendingRegions;
+    Size mPendingSize = {};
+};
+
+
+#endif //HELLOSURFACECONTROL_SURFACEATLAS_H
@@ -0,0 +1,75 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_ALLOCATIONCOUNTER_H
+#define HELLOSURFACECONTROL_ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new with one counting the allocations of threads that asked for it.
+// Defines the replacement operators, so only the source file with main() may include it.
+namespace allocation_counter {
+
+// Only the frame loop's own thread is counted, the compositor thread stands in for another
+// process.
+inline thread_local bool tCounting = false;
+inline thread_local size_t tAllocations = 0;
+
+inline void start() {
+    tCounting = true;
+}
+
+inline void stop() {
+    tCounting = false;
+}
+
+// Allocations of the calling thread while it was counting.
+inline size_t count() {
+    return tAllocations;
+}
+
+inline void *allocate(std::size_t size) {
+    if (tCounting) {
+        tAllocations++;
+    }
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+inline void *allocateAligned(std::size_t size, std::align_val_t alignment) {
+    if (tCounting) {
+        tAllocations++;
+    }
+    auto align = static_cast<std::size_t>(alignment);
+    if (void *p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+}  // namespace allocation_counter
+
+void *operator new(std::size_t size) { return allocation_counter::allocate(size); }
+void *operator new[](std::size_t size) { return allocation_counter::allocate(size); }
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    return allocation_counter::allocateAligned(size, alignment);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocation_counter::allocateAligned(size, alignment);
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+
+#endif //HELLOSURFACECONTROL_ALLOCATIONCOUNTER_H
@@ -0,0 +1,83 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Resizes BufferQueues back and forth between a few sizes, as rotation and split screen do, and
+// creates and destroys queues as surfaces come and go. Compares the time per resize with
+// BufferPool on and with its memory cap at 0, which allocates and imports every buffer anew.
+//
+// Usage: bufferpool_benchmark [resizes]
+
+#include <GLES3/gl3.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#include "BufferPool.h"
+#include "BufferQueue.h"
+#include "HeadlessEGL.h"
+
+namespace {
+
+constexpr int kSizes[][2] = {{1080, 600}, {600, 1080}, {540, 600}};
+constexpr size_t kDefaultCap = 64 * 1024 * 1024;
+
+double microsPerResize(int resizes) {
+    BufferQueue queue(VK_NULL_HANDLE);
+    queue.resize(kSizes[0][0], kSizes[0][1]);
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 1; i <= resizes; i++) {
+        const auto &size = kSizes[i % std::size(kSizes)];
+        queue.resize(size[0], size[1]);
+    }
+    glFinish();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / resizes;
+}
+
+double microsPerSurface(int surfaces) {
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < surfaces; i++) {
+        auto queue = std::make_unique<BufferQueue>(VK_NULL_HANDLE);
+        queue->resize(kSizes[0][0], kSizes[0][1]);
+    }
+    glFinish();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() / surfaces;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int resizes = argc > 1 ? std::atoi(argv[1]) : 300;
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    auto &pool = BufferPool::Get();
+    pool.setMemoryCap(0);
+    double unpooledResize = microsPerResize(resizes);
+    double unpooledSurface = microsPerSurface(resizes);
+
+    pool.setMemoryCap(kDefaultCap);
+    double pooledResize = microsPerResize(resizes);
+    double pooledSurface = microsPerSurface(resizes);
+    auto stats = pool.stats();
+
+    std::printf("resize:          %8.1f us -> %8.1f us (%.2fx)\n", unpooledResize, pooledResize,
+                unpooledResize / pooledResize);
+    std::printf("surface churn:   %8.1f us -> %8.1f us (%.2fx)\n", unpooledSurface,
+                pooledSurface, unpooledSurface / pooledSurface);
+    std::printf("pool: %llu hits, %llu misses, %llu evictions, %zu idle bytes\n",
+                static_cast<unsigned long long>(stats.hits),
+                static_cast<unsigned long long>(stats.misses),
+                static_cast<unsigned long long>(stats.evictions), stats.idleBytes);
+    pool.clear();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Pushes images through produce/enqueue/present on the calling thread while one or more release
+// threads play the binder thread, and compares BufferQueue against the mutex and std::deque
+// implementation it replaced.
+//
+// Usage: bufferqueue_benchmark [frames] [release threads]
+// With 0 release threads images are released inline, which measures the uncontended cost.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "BufferQueue.h"
+#include "GLFence.h"
+#include "HeadlessEGL.h"
+
+namespace {
+
+// The previous BufferQueue, minus buffer allocation.
+class MutexBufferQueue {
+public:
+    using Image = BufferQueue::Image;
+
+    explicit MutexBufferQueue(int bufferCount) {
+        for (int i = 0; i < bufferCount; i++) {
+            mAvailableImages.push_back(std::make_unique<Image>());
+        }
+    }
+
+    const Image *produceImage() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mAvailableImages.empty()) {
+            return nullptr;
+        }
+        mCurrentProduceImage = std::move(mAvailableImages.front());
+        mAvailableImages.pop_front();
+        if (mCurrentProduceImage->fenceFd.isValid()) {
+            mCurrentProduceImage->fence = GLFence::CreateFromFenceFd(
+                    std::move(mCurrentProduceImage->fenceFd));
+        }
+        return mCurrentProduceImage.get();
+    }
+
+    void enqueueProducedImage(std::shared_ptr<GLFence> fence) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCurrentProduceImage->fence = std::move(fence);
+        mProducedImages.push_back(std::move(mCurrentProduceImage));
+    }
+
+    const Image *presentImage() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mProducedImages.empty()) {
+            return nullptr;
+        }
+        auto image = std::move(mProducedImages.front());
+        mProducedImages.pop_front();
+        mInPresentImages.push_back(std::move(image));
+        return mInPresentImages.back().get();
+    }
+
+    void releasePresentImage(uint32_t /* generation */, int fenceFd) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        auto image = std::move(mInPresentImages.front());
+        mInPresentImages.pop_front();
+        image->fenceFd = ScopedFd(fenceFd);
+        mAvailableImages.push_back(std::move(image));
+    }
+
+private:
+    std::mutex mMutex;
+    std::deque<std::unique_ptr<Image>> mAvailableImages;
+    std::deque<std::unique_ptr<Image>> mProducedImages;
+    std::deque<std::unique_ptr<Image>> mInPresentImages;
+    std::unique_ptr<Image> mCurrentProduceImage;
+};
+
+struct Result {
+    double nsPerFrame = 0;
+    uint64_t starvedProduces = 0;
+};
+
+template<typename Queue>
+Result run(Queue &queue, uint64_t frames, int releaseThreads) {
+    std::atomic<uint64_t> presented{0};
+    std::atomic<uint64_t> released{0};
+
+    std::vector<std::thread> releasers;
+    for (int i = 0; i < releaseThreads; i++) {
+        releasers.emplace_back([&] {
+            for (;;) {
+                uint64_t ticket = released.load(std::memory_order_relaxed);
+                if (ticket == frames) {
+                    return;
+                }
+                if (ticket == presented.load(std::memory_order_acquire) ||
+                    !released.compare_exchange_weak(ticket, ticket + 1,
+                                                    std::memory_order_relaxed)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                queue.releasePresentImage(1, -1);
+            }
+        });
+    }
+
+    Result result;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        while (!queue.produceImage()) {
+            result.starvedProduces++;
+            std::this_thread::yield();
+        }
+        queue.enqueueProducedImage(nullptr);
+        queue.presentImage();
+        if (releaseThreads == 0) {
+            queue.releasePresentImage(1, -1);
+        }
+        presented.store(frame + 1, std::memory_order_release);
+    }
+    for (auto &releaser: releasers) {
+        releaser.join();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    result.nsPerFrame = std::chrono::duration<double, std::nano>(elapsed).count() / frames;
+    return result;
+}
+
+void print(const char *name, const Result &result) {
+    std::printf("%-18s %10.1f ns/frame %12llu starved produces\n", name, result.nsPerFrame,
+                static_cast<unsigned long long>(result.starvedProduces));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    uint64_t frames = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+    int releaseThreads = argc > 2 ? std::atoi(argv[2]) : 1;
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%llu frames, %d release thread(s)\n", static_cast<unsigned long long>(frames),
+                releaseThreads);
+
+    MutexBufferQueue mutexQueue(3);
+    print("mutex + deque", run(mutexQueue, frames, releaseThreads));
+
+    BufferQueue queue(VK_NULL_HANDLE);
+    queue.resize(64, 64);
+    print("slot ring", run(queue, frames, releaseThreads));
+
+    return EXIT_SUCCESS;
+}
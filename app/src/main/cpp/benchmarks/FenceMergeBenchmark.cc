@@ -0,0 +1,100 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Merges host fake sync_file fences into one with GLFence::Merge(), as a transaction carrying a
+// single acquire fence for several surfaces would, checks the merged fence signals only once all
+// inputs have, and reports the cost of merging and how long the merged fence takes to signal after
+// the last input. Each merge also gets a null fence and one that cannot be exported, which it must
+// skip, and every input's fd is exported again to check the cached one is handed out.
+//
+// Usage: fencemerge_benchmark [iterations] [fences per merge]
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include "GLFence.h"
+#include "HeadlessEGL.h"
+#include "LatencyHistogram.h"
+#include "Platform.h"
+#include "ScopedFd.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+bool isSignaled(const ScopedFd &fenceFd, int timeoutMs = 0) {
+    pollfd fd = {fenceFd.get(), POLLIN, 0};
+    return poll(&fd, 1, timeoutMs) > 0;
+}
+
+int64_t nanosSince(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 1000;
+    int fenceCount = argc > 2 ? std::atoi(argv[2]) : 4;
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    LatencyHistogram mergeTime;
+    LatencyHistogram signalLatency;
+    int failures = 0;
+    std::vector<ScopedFd> fences(fenceCount);
+    // The inputs, then a null fence and one created on the GPU, which the host cannot export.
+    std::vector<std::shared_ptr<GLFence>> glFences(fenceCount + 2);
+    for (int i = 0; i < iterations; i++) {
+        for (int j = 0; j < fenceCount; j++) {
+            fences[j] = ScopedFd(platform::createHostFenceFd());
+            glFences[j] = GLFence::CreateFromFenceFd(
+                    ScopedFd(fcntl(fences[j].get(), F_DUPFD_CLOEXEC, 0)));
+        }
+        glFences[fenceCount] = nullptr;
+        glFences[fenceCount + 1] = GLFence::Create();
+        auto start = Clock::now();
+        ScopedFd merged = GLFence::Merge(glFences.data(), glFences.size());
+        mergeTime.record(nanosSince(start));
+        for (int j = 0; j < fenceCount; j++) {
+            if (!glFences[j] || !glFences[j]->getFd().isValid()) {
+                failures++;
+            }
+        }
+
+        for (int j = 0; j + 1 < fenceCount; j++) {
+            platform::signalHostFenceFd(fences[j].get());
+        }
+        // Give the watcher a chance to get it wrong.
+        if (isSignaled(merged, 1)) {
+            failures++;
+        }
+        start = Clock::now();
+        platform::signalHostFenceFd(fences.back().get());
+        if (!isSignaled(merged, 1000)) {
+            failures++;
+        }
+        signalLatency.record(nanosSince(start));
+    }
+
+    glFences.clear();
+    GLFence::TrimPool();
+
+    auto merge = mergeTime.summary();
+    auto latency = signalLatency.summary();
+    std::printf("%d fences: merge p50 %7.1f us p99 %7.1f us, last signal to merged signaled "
+                "p50 %7.1f us p99 %7.1f us, %d failures\n", fenceCount, merge.p50 / 1e3,
+                merge.p99 / 1e3, latency.p50 / 1e3, latency.p99 / 1e3, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Replaces the global operator new with a counting one and fails if drawing and presenting
+// ChildSurfaces still allocates on the render thread once the first frames have warmed up buffer
+// queues, fence and transaction pools. Runs as part of the host build.
+//
+// Usage: frame_allocation_check [frames] [children]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "ChildSurface.h"
+#include "GLResourceCache.h"
+#include "HeadlessEGL.h"
+#include "Platform.h"
+
+namespace {
+
+constexpr std::chrono::milliseconds kCompositorPeriod(1);
+constexpr int kWarmUpFrames = 32;
+constexpr int kSurfaceSize = 128;
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 100;
+    int childCount = argc > 2 ? std::atoi(argv[2]) : 4;
+
+    platform::setHostRefreshPeriod(kCompositorPeriod);
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+    platform::UniqueWindow window(platform::createHostWindow(kSurfaceSize, kSurfaceSize));
+    platform::UniqueSurface root(
+            platform::createSurfaceFromWindow(window.get(), "FrameAllocationCheck"));
+
+    GLResourceCache cache("");
+    std::vector<std::shared_ptr<ChildSurface>> children;
+    for (int i = 0; i < childCount; i++) {
+        children.push_back(std::make_shared<ChildSurface>(VK_NULL_HANDLE, VK_NULL_HANDLE));
+        children[i]->init(root.get(), "FrameAllocationCheck", cache);
+        children[i]->resize(kSurfaceSize, kSurfaceSize);
+        children[i]->setAnimationDelta(1.0f + i);
+        // Cover both full and partial redraws.
+        children[i]->setBackgroundAnimated(i % 2 == 0);
+        // Adding and removing images goes through BufferPool, which is not meant to be free.
+        children[i]->setBufferCountRange(3, 3);
+    }
+
+    auto drawFrame = [&children](int frame) {
+        for (auto &child: children) {
+            child->setPosition(frame % 64, 0);
+            child->draw();
+        }
+        platform::Transaction *transaction = platform::createTransaction();
+        for (auto &child: children) {
+            child->applyChanges(transaction);
+        }
+        platform::applyTransaction(transaction);
+        platform::deleteTransaction(transaction);
+        // Let the compositor latch and release.
+        std::this_thread::sleep_for(kCompositorPeriod * 2);
+    };
+
+    auto resizePending = [&children] {
+        for (auto &child: children) {
+            if (child->isResizePending()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (int i = 0; i < kWarmUpFrames || resizePending(); i++) {
+        drawFrame(i);
+    }
+    allocation_counter::start();
+    for (int i = 0; i < frames; i++) {
+        drawFrame(kWarmUpFrames + i);
+    }
+    allocation_counter::stop();
+
+    std::printf("%zu allocations in %d frames of %d children\n", allocation_counter::count(),
+                frames, childCount);
+    children.clear();
+    return allocation_counter::count() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,71 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+#ifndef HELLOSURFACECONTROL_HEADLESSEGL_H
+#define HELLOSURFACECONTROL_HEADLESSEGL_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdio>
+
+#include "Platform.h"
+
+// Makes a surfaceless GLES3 context current on the calling thread for the lifetime of the object.
+class HeadlessEGL {
+public:
+    HeadlessEGL() {
+        mDisplay = platform::getEGLDisplay();
+        if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, nullptr, nullptr)) {
+            std::fprintf(stderr, "Failed to initialize EGL\n");
+            return;
+        }
+
+        EGLint numConfigs = 0;
+        EGLint configAttribs[] = {
+                EGL_SURFACE_TYPE, EGL_DONT_CARE,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+                EGL_NONE
+        };
+        if (!eglChooseConfig(mDisplay, configAttribs, &mConfig, 1, &numConfigs) ||
+            numConfigs == 0) {
+            mConfig = EGL_NO_CONFIG_KHR;
+        }
+
+        EGLint contextAttribs[] = {
+                EGL_CONTEXT_CLIENT_VERSION, 3,
+                EGL_NONE
+        };
+        mContext = eglCreateContext(mDisplay, mConfig, EGL_NO_CONTEXT, contextAttribs);
+        if (mContext == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, mContext)) {
+            std::fprintf(stderr, "Failed to create EGL context\n");
+        }
+    }
+
+    ~HeadlessEGL() {
+        if (mContext != EGL_NO_CONTEXT) {
+            eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(mDisplay, mContext);
+        }
+    }
+
+    HeadlessEGL(const HeadlessEGL &) = delete;
+    HeadlessEGL &operator=(const HeadlessEGL &) = delete;
+
+    bool isValid() const { return mContext != EGL_NO_CONTEXT; }
+
+    EGLDisplay display() const { return mDisplay; }
+
+    EGLConfig config() const { return mConfig; }
+
+    EGLContext context() const { return mContext; }
+
+private:
+    EGLDisplay mDisplay = EGL_NO_DISPLAY;
+    EGLConfig mConfig = EGL_NO_CONFIG_KHR;
+    EGLContext mContext = EGL_NO_CONTEXT;
+};
+
+#endif //HELLOSURFACECONTROL_HEADLESSEGL_H
@@ -0,0 +1,195 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Checks Matrix4x4 against the scalar implementation it replaced and times both: a single
+// multiply, building the per-frame cube transform and transforming a batch of matrices.
+//
+// Usage: matrix_benchmark [iterations]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Matrix.h"
+
+namespace {
+
+// The previous Matrix4x4: a triple loop multiply and rotation as three multiplied matrices.
+struct LegacyMatrix4x4 {
+    float data[16];
+
+    static LegacyMatrix4x4 RotateX(float angle) {
+        float c = std::cos(angle), s = std::sin(angle);
+        return {{1, 0, 0, 0, 0, c, -s, 0, 0, s, c, 0, 0, 0, 0, 1}};
+    }
+
+    static LegacyMatrix4x4 RotateY(float angle) {
+        float c = std::cos(angle), s = std::sin(angle);
+        return {{c, 0, s, 0, 0, 1, 0, 0, -s, 0, c, 0, 0, 0, 0, 1}};
+    }
+
+    static LegacyMatrix4x4 RotateZ(float angle) {
+        float c = std::cos(angle), s = std::sin(angle);
+        return {{c, -s, 0, 0, s, c, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1}};
+    }
+
+    static LegacyMatrix4x4 Rotate(float angleX, float angleY, float angleZ) {
+        return RotateX(angleX) * RotateY(angleY) * RotateZ(angleZ);
+    }
+
+    static LegacyMatrix4x4 Translate(float x, float y, float z) {
+        return {{1, 0, 0, x, 0, 1, 0, y, 0, 0, 1, z, 0, 0, 0, 1}};
+    }
+
+    static LegacyMatrix4x4 Scale(float x, float y, float z) {
+        return {{x, 0, 0, 0, 0, y, 0, 0, 0, 0, z, 0, 0, 0, 0, 1}};
+    }
+
+    LegacyMatrix4x4 operator*(const LegacyMatrix4x4 &other) const {
+        LegacyMatrix4x4 result = {};
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                result.data[i * 4 + j] = 0;
+                for (int k = 0; k < 4; k++) {
+                    result.data[i * 4 + j] += data[i * 4 + k] * other.data[k * 4 + j];
+                }
+            }
+        }
+        return result;
+    }
+};
+
+// The builders are usable in constant expressions.
+constexpr Matrix4x4 kModel = Matrix4x4::Translate(1.0f, 2.0f, 3.0f) *
+                             Matrix4x4::Scale(2.0f, 2.0f, 2.0f);
+static_assert(kModel.data[0] == 2.0f && kModel.data[3] == 1.0f && kModel.data[11] == 3.0f,
+              "constexpr Translate * Scale");
+constexpr Matrix4x4 kQuarterTurnZ = Matrix4x4::TranslateRotateScale(
+        0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f);
+static_assert(kQuarterTurnZ.data[1] == -1.0f && kQuarterTurnZ.data[4] == 1.0f,
+              "constexpr rotation from sin/cos");
+
+template<typename A, typename B>
+float maxDifference(const A &a, const B &b) {
+    float result = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        result = std::max(result, std::abs(a.data[i] - b.data[i]));
+    }
+    return result;
+}
+
+// Best of a few runs, to filter out preemption.
+template<typename Fn>
+double nanosPerIteration(int iterations, Fn &&fn) {
+    constexpr int kRuns = 5;
+    double best = 0.0;
+    for (int run = 0; run < kRuns; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            fn(i);
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double nanos = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+        best = run == 0 ? nanos : std::min(best, nanos);
+    }
+    return best;
+}
+
+// Keeps the optimizer from dropping results.
+volatile float gSink;
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    constexpr float kTolerance = 1e-5f;
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> distribution(-3.2f, 3.2f);
+    constexpr int kInputCount = 256;
+    std::vector<Matrix4x4> inputs(kInputCount);
+    std::vector<LegacyMatrix4x4> legacyInputs(kInputCount);
+    std::vector<float> angles(kInputCount * 3);
+    for (int i = 0; i < kInputCount; i++) {
+        for (int j = 0; j < 16; j++) {
+            inputs[i].data[j] = legacyInputs[i].data[j] = distribution(random);
+        }
+        for (int j = 0; j < 3; j++) {
+            angles[i * 3 + j] = distribution(random);
+        }
+    }
+
+    // Correctness.
+    float multiplyError = 0.0f;
+    float transformError = 0.0f;
+    for (int i = 0; i < kInputCount; i++) {
+        int j = (i + 1) % kInputCount;
+        multiplyError = std::max(multiplyError, maxDifference(inputs[i] * inputs[j],
+                                                              legacyInputs[i] * legacyInputs[j]));
+        const float *a = &angles[i * 3];
+        transformError = std::max(transformError, maxDifference(
+                Matrix4x4::TranslateRotateScale(1.0f, 2.0f, 3.0f, a[0], a[1], a[2],
+                                                0.5f, 0.75f, 1.5f),
+                LegacyMatrix4x4::Translate(1.0f, 2.0f, 3.0f) *
+                LegacyMatrix4x4::Rotate(a[0], a[1], a[2]) *
+                LegacyMatrix4x4::Scale(0.5f, 0.75f, 1.5f)));
+    }
+    std::vector<Matrix4x4> batch(inputs);
+    Matrix4x4::MultiplyBatch(inputs[0], batch.data(), batch.data(), batch.size());
+    float batchError = 0.0f;
+    for (int i = 0; i < kInputCount; i++) {
+        batchError = std::max(batchError,
+                              maxDifference(batch[i], legacyInputs[0] * legacyInputs[i]));
+    }
+    // Products of random entries in [-3.2, 3.2] reach ~40, compare relative to that.
+    bool correct = multiplyError < kTolerance * 40 && batchError < kTolerance * 40 &&
+                   transformError < kTolerance;
+    std::printf("max error: multiply %g, transform %g, batch %g: %s\n", multiplyError,
+                transformError, batchError, correct ? "OK" : "MISMATCH");
+
+    constexpr int kMask = kInputCount - 1;
+    double legacyMultiply = nanosPerIteration(iterations, [&](int i) {
+        gSink = (legacyInputs[i & kMask] * legacyInputs[(i + 1) & kMask]).data[i & 15];
+    });
+    double multiply = nanosPerIteration(iterations, [&](int i) {
+        gSink = (inputs[i & kMask] * inputs[(i + 1) & kMask]).data[i & 15];
+    });
+    std::printf("multiply:      %7.2f ns -> %7.2f ns (%.2fx)\n", legacyMultiply, multiply,
+                legacyMultiply / multiply);
+
+    double legacyTransform = nanosPerIteration(iterations, [&](int i) {
+        const float *a = &angles[(i & kMask) * 3];
+        gSink = (LegacyMatrix4x4::Rotate(a[0], a[1], a[2]) *
+                 LegacyMatrix4x4::Scale(0.5f, 0.5f, 0.5f)).data[i & 15];
+    });
+    double transform = nanosPerIteration(iterations, [&](int i) {
+        const float *a = &angles[(i & kMask) * 3];
+        gSink = Matrix4x4::TranslateRotateScale(0.0f, 0.0f, 0.0f, a[0], a[1], a[2],
+                                                0.5f, 0.5f, 0.5f).data[i & 15];
+    });
+    std::printf("rotate*scale:  %7.2f ns -> %7.2f ns (%.2fx)\n", legacyTransform, transform,
+                legacyTransform / transform);
+
+    std::vector<LegacyMatrix4x4> legacyBatch(legacyInputs);
+    int batches = std::max(1, iterations / kInputCount);
+    double legacyBatchTime = nanosPerIteration(batches, [&](int i) {
+        const LegacyMatrix4x4 &lhs = legacyInputs[i & kMask];
+        for (int j = 0; j < kInputCount; j++) {
+            legacyBatch[j] = lhs * legacyInputs[j];
+        }
+        gSink = legacyBatch[i & kMask].data[0];
+    }) / kInputCount;
+    double batchTime = nanosPerIteration(batches, [&](int i) {
+        Matrix4x4::MultiplyBatch(inputs[i & kMask], inputs.data(), batch.data(), kInputCount);
+        gSink = batch[i & kMask].data[0];
+    }) / kInputCount;
+    std::printf("batch (each):  %7.2f ns -> %7.2f ns (%.2fx)\n", legacyBatchTime, batchTime,
+                legacyBatchTime / batchTime);
+
+    return correct ? EXIT_SUCCESS : EXIT_FAILURE;
+}
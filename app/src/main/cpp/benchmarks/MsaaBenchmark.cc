@@ -0,0 +1,175 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Draws the same children single sampled and then with every supported sample count, through the
+// whole pipeline like pipeline_benchmark. Prints one JSON object with a result per sample count to
+// stdout, logs go to stderr.
+//
+// Usage: msaa_benchmark [surfaces] [buffer size] [frames]
+//
+// "mode" is render_to_texture with EXT_multisampled_render_to_texture, resolve_blit otherwise (see
+// MultisampleTarget). "gpu_time_ms" is the median GPU time of one child's draw, resolve included,
+// "frame_time_ms" the time between frame ends. "extra_bytes" are the multisampled renderbuffers of
+// all children, "resolve_traffic_bytes_per_frame" the estimated memory traffic of their resolves.
+
+#include <GLES3/gl3.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BufferPool.h"
+#include "ChildSurface.h"
+#include "GLFence.h"
+#include "GLResourceCache.h"
+#include "GpuTimer.h"
+#include "HeadlessEGL.h"
+#include "LatencyHistogram.h"
+#include "MultisampleTarget.h"
+#include "Platform.h"
+
+namespace {
+
+constexpr int kWindowWidth = 1080;
+constexpr int kWindowHeight = 2400;
+constexpr int kWarmUpFrames = 32;
+constexpr std::chrono::microseconds kRetryInterval(50);
+constexpr std::chrono::microseconds kCompositorPeriod(1000);
+
+struct Result {
+    int samples;
+    double fps;
+    LatencyHistogram::Summary frameTime;
+    LatencyHistogram::Summary gpuTime;
+    size_t extraBytes;
+    size_t resolveTraffic;
+};
+
+Result run(platform::Surface *root, GLResourceCache &cache, int samples, int surfaceCount,
+           int bufferSize, int frames) {
+    std::vector<std::shared_ptr<ChildSurface>> children;
+    int columns = std::max(1, kWindowWidth / bufferSize);
+    for (int i = 0; i < surfaceCount; i++) {
+        children.push_back(std::make_shared<ChildSurface>(VK_NULL_HANDLE, VK_NULL_HANDLE));
+        auto &child = children.back();
+        std::string name = "MsaaBenchmark" + std::to_string(i);
+        child->init(root, name.c_str(), cache);
+        child->resize(bufferSize, bufferSize);
+        child->setPosition(i % columns * bufferSize, i / columns * bufferSize);
+        child->setSampleCount(samples);
+    }
+
+    auto drawFrame = [&children] {
+        for (auto &child: children) {
+            const auto &skippedFrames = child->bufferStats().skippedFrames;
+            while (child->needsRedraw()) {
+                uint64_t skipped = skippedFrames.load(std::memory_order_relaxed);
+                child->draw();
+                if (skippedFrames.load(std::memory_order_relaxed) == skipped) {
+                    break;
+                }
+                std::this_thread::sleep_for(kRetryInterval);
+            }
+        }
+        platform::Transaction *transaction = platform::createTransaction();
+        for (auto &child: children) {
+            child->applyChanges(transaction);
+        }
+        platform::applyTransaction(transaction);
+        platform::deleteTransaction(transaction);
+    };
+    for (int i = 0; i < kWarmUpFrames || children[0]->isResizePending(); i++) {
+        drawFrame();
+    }
+    glFinish();
+
+    LatencyHistogram frameTimes;
+    auto start = std::chrono::steady_clock::now();
+    auto frameStart = start;
+    for (int i = 0; i < frames; i++) {
+        drawFrame();
+        auto frameEnd = std::chrono::steady_clock::now();
+        frameTimes.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                frameEnd - frameStart).count());
+        frameStart = frameEnd;
+    }
+    glFinish();
+    double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Result result = {1, frames / seconds, frameTimes.summary(),
+                     children[0]->drawStats().gpuTime.summary(), 0, 0};
+    for (const auto &child: children) {
+        if (const auto *target = child->multisampleTarget()) {
+            result.samples = target->samples();
+            result.extraBytes += target->bytes();
+            result.resolveTraffic += target->resolveTraffic(
+                    static_cast<size_t>(bufferSize) * bufferSize);
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int surfaceCount = argc > 1 ? std::atoi(argv[1]) : 4;
+    int bufferSize = argc > 2 ? std::atoi(argv[2]) : 512;
+    int frames = argc > 3 ? std::atoi(argv[3]) : 300;
+    if (surfaceCount <= 0 || bufferSize <= 0 || frames <= 0) {
+        std::fprintf(stderr, "Usage: %s [surfaces] [buffer size] [frames]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    platform::setHostRefreshPeriod(kCompositorPeriod);
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+    BufferQueue::SetMemoryBudget(static_cast<size_t>(surfaceCount) *
+                                 BufferQueue::kMaxBufferCount * bufferSize * bufferSize * 4);
+    GpuTimer::SetEnabled(true);
+
+    platform::UniqueWindow window(platform::createHostWindow(kWindowWidth, kWindowHeight));
+    platform::UniqueSurface root(platform::createSurfaceFromWindow(window.get(), "MsaaBenchmark"));
+    GLResourceCache cache("");
+
+    const bool renderToTexture =
+            MultisampleTarget::SupportedMode() == MultisampleTarget::Mode::RENDER_TO_TEXTURE;
+    std::vector<Result> results;
+    for (int samples = 1; samples <= MultisampleTarget::MaxSamples(); samples *= 2) {
+        results.push_back(run(root.get(), cache, samples, surfaceCount, bufferSize, frames));
+    }
+
+    std::printf("{\n"
+                "  \"surfaces\": %d,\n"
+                "  \"buffer_size\": %d,\n"
+                "  \"frames\": %d,\n"
+                "  \"mode\": \"%s\",\n"
+                "  \"results\": [\n",
+                surfaceCount, bufferSize, frames,
+                renderToTexture ? "render_to_texture" : "resolve_blit");
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto &result = results[i];
+        std::printf("    {\"samples\": %d, \"fps\": %.2f, "
+                    "\"frame_time_ms\": {\"p50\": %.3f, \"p99\": %.3f}, "
+                    "\"gpu_time_ms\": {\"p50\": %.3f, \"p99\": %.3f}, "
+                    "\"extra_bytes\": %zu, \"resolve_traffic_bytes_per_frame\": %zu}%s\n",
+                    result.samples, result.fps, result.frameTime.p50 / 1e6,
+                    result.frameTime.p99 / 1e6, result.gpuTime.p50 / 1e6,
+                    result.gpuTime.p99 / 1e6, result.extraBytes, result.resolveTraffic,
+                    i + 1 < results.size() ? "," : "");
+    }
+    std::printf("  ]\n"
+                "}\n");
+
+    GLFence::TrimPool();
+    BufferPool::Get().clear();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,150 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Draws a growing number of ChildSurfaces per frame, either all on the calling thread or spread
+// over a RenderWorkerPool, and reports the time from the first draw call to the applied
+// transaction. Each context finishes its GPU work before the join so the numbers include
+// rasterization. Between frames the loop sleeps (untimed) for the sped up host compositor to
+// release buffers, so no draw is skipped for lack of a free image.
+//
+// Usage: parallel_render_benchmark [frames] [surface size] [max workers]
+
+#include <GLES3/gl3.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ChildSurface.h"
+#include "GLResourceCache.h"
+#include "HeadlessEGL.h"
+#include "Platform.h"
+#include "RenderWorkerPool.h"
+
+namespace {
+
+constexpr int kChildCounts[] = {1, 2, 4, 8, 16};
+constexpr std::chrono::milliseconds kCompositorPeriod(1);
+
+double run(HeadlessEGL &egl, platform::Surface *root, int childCount, int workerCount,
+           int frames, int surfaceSize) {
+    std::unique_ptr<RenderWorkerPool> workers;
+    if (workerCount > 0) {
+        workers = RenderWorkerPool::Create(egl.display(), egl.config(), egl.context(),
+                                           workerCount);
+        if (!workers) {
+            return -1.0;
+        }
+    }
+    auto onContext = [&workers](int index, const std::function<void()> &task) {
+        if (workers) {
+            workers->run(index % workers->size(), task);
+        } else {
+            task();
+        }
+    };
+    int contextCount = workers ? workers->size() : 1;
+
+    std::vector<std::unique_ptr<GLResourceCache>> caches(contextCount);
+    for (int i = 0; i < contextCount; i++) {
+        onContext(i, [&caches, i] { caches[i] = std::make_unique<GLResourceCache>(""); });
+    }
+    std::vector<std::shared_ptr<ChildSurface>> children;
+    for (int i = 0; i < childCount; i++) {
+        children.push_back(std::make_shared<ChildSurface>(VK_NULL_HANDLE, VK_NULL_HANDLE));
+        onContext(i, [&, i] {
+            children[i]->init(root, "ParallelRenderBenchmark", *caches[i % contextCount]);
+            children[i]->resize(surfaceSize, surfaceSize);
+            children[i]->setAnimationDelta(1.0f + i);
+        });
+    }
+
+    auto drawFrame = [&] {
+        if (workers) {
+            workers->parallelFor(childCount, [&children](int i) {
+                children[i]->draw();
+                glFinish();
+            });
+        } else {
+            for (auto &child: children) {
+                child->draw();
+            }
+            glFinish();
+        }
+        platform::Transaction *transaction = platform::createTransaction();
+        for (auto &child: children) {
+            child->applyChanges(transaction);
+        }
+        platform::applyTransaction(transaction);
+        platform::deleteTransaction(transaction);
+    };
+
+    // Warm up shaders, wait for the buffers and fill the queues once.
+    auto resizePending = [&children] {
+        for (auto &child: children) {
+            if (child->isResizePending()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (int i = 0; i < 3 || resizePending(); i++) {
+        std::this_thread::sleep_for(kCompositorPeriod);
+        drawFrame();
+    }
+    std::chrono::steady_clock::duration elapsed{};
+    for (int i = 0; i < frames; i++) {
+        std::this_thread::sleep_for(kCompositorPeriod * 2);
+        auto start = std::chrono::steady_clock::now();
+        drawFrame();
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    for (int i = 0; i < childCount; i++) {
+        onContext(i, [&children, i] { children[i] = nullptr; });
+    }
+    for (int i = 0; i < contextCount; i++) {
+        onContext(i, [&caches, i] { caches[i] = nullptr; });
+    }
+    return std::chrono::duration<double, std::milli>(elapsed).count() / frames;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 100;
+    int surfaceSize = argc > 2 ? std::atoi(argv[2]) : 256;
+    int maxWorkers = argc > 3 ? std::atoi(argv[3]) : 4;
+
+    platform::setHostRefreshPeriod(kCompositorPeriod);
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+    platform::UniqueWindow window(platform::createHostWindow(surfaceSize, surfaceSize));
+    platform::UniqueSurface root(
+            platform::createSurfaceFromWindow(window.get(), "ParallelRenderBenchmark"));
+
+    std::printf("%d frames of %dx%d surfaces, ms/frame\n", frames, surfaceSize, surfaceSize);
+    std::printf("%-10s", "children");
+    for (int workers = 0; workers <= maxWorkers; workers = workers ? workers * 2 : 1) {
+        std::printf(" %9s", (std::to_string(workers) + " workers").c_str());
+    }
+    std::printf("\n");
+    for (int childCount: kChildCounts) {
+        std::printf("%-10d", childCount);
+        for (int workers = 0; workers <= maxWorkers; workers = workers ? workers * 2 : 1) {
+            std::printf(" %9.3f", run(egl, root.get(), childCount, workers, frames, surfaceSize));
+            std::fflush(stdout);
+        }
+        std::printf("\n");
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Drives a configurable number of ChildSurfaces through the whole pipeline headlessly: draw,
+// transaction, host compositor latch and release, as fast as the buffer queues allow. Prints one
+// JSON object to stdout so runs can be compared across changes, logs go to stderr.
+//
+// Usage: pipeline_benchmark [surfaces] [buffer size] [frames] [fifo|mailbox|latest-only]
+//                           [compositor period us]
+//
+// A frame ends once every surface drew and the transaction was applied, "frame_time_ms" is the time
+// between frame ends and "skipped_frames" how often a surface had to wait for a free buffer.
+// "allocations_per_frame" counts heap allocations on the frame loop's thread, "peak_buffer_bytes"
+// the buffers held by all queues plus the idle ones in BufferPool.
+
+#include <GLES3/gl3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AllocationCounter.h"
+#include "BufferPool.h"
+#include "ChildSurface.h"
+#include "GLFence.h"
+#include "GLResourceCache.h"
+#include "HeadlessEGL.h"
+#include "LatencyHistogram.h"
+#include "Platform.h"
+
+namespace {
+
+constexpr int kWindowWidth = 1080;
+constexpr int kWindowHeight = 2400;
+constexpr int kWarmUpFrames = 32;
+constexpr std::chrono::microseconds kRetryInterval(50);
+
+bool parsePresentMode(const char *name, BufferQueue::PresentMode *mode) {
+    if (std::strcmp(name, "fifo") == 0) {
+        *mode = BufferQueue::PresentMode::FIFO;
+    } else if (std::strcmp(name, "mailbox") == 0) {
+        *mode = BufferQueue::PresentMode::MAILBOX;
+    } else if (std::strcmp(name, "latest-only") == 0) {
+        *mode = BufferQueue::PresentMode::LATEST_ONLY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+struct FrameCounters {
+    uint64_t skipped = 0;
+    uint64_t dropped = 0;
+    uint64_t throttled = 0;
+};
+
+size_t bufferBytes() {
+    return BufferQueue::GetBufferBytes() + BufferPool::Get().stats().idleBytes;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int surfaceCount = argc > 1 ? std::atoi(argv[1]) : 4;
+    int bufferSize = argc > 2 ? std::atoi(argv[2]) : 512;
+    int frames = argc > 3 ? std::atoi(argv[3]) : 500;
+    const char *presentModeName = argc > 4 ? argv[4] : "fifo";
+    int compositorPeriodMicros = argc > 5 ? std::atoi(argv[5]) : 1000;
+
+    BufferQueue::PresentMode presentMode;
+    if (!parsePresentMode(presentModeName, &presentMode) || surfaceCount <= 0 ||
+        bufferSize <= 0 || frames <= 0 || compositorPeriodMicros <= 0) {
+        std::fprintf(stderr, "Usage: %s [surfaces] [buffer size] [frames] "
+                             "[fifo|mailbox|latest-only] [compositor period us]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    platform::setHostRefreshPeriod(std::chrono::microseconds(compositorPeriodMicros));
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+    // Enough for every surface, the benchmark measures drawing, not the budget.
+    BufferQueue::SetMemoryBudget(static_cast<size_t>(surfaceCount) *
+                                 BufferQueue::kMaxBufferCount * bufferSize * bufferSize * 4);
+
+    platform::UniqueWindow window(platform::createHostWindow(kWindowWidth, kWindowHeight));
+    platform::UniqueSurface root(
+            platform::createSurfaceFromWindow(window.get(), "PipelineBenchmark"));
+
+    GLResourceCache cache("");
+    std::vector<std::shared_ptr<ChildSurface>> children;
+    int columns = std::max(1, kWindowWidth / bufferSize);
+    for (int i = 0; i < surfaceCount; i++) {
+        children.push_back(std::make_shared<ChildSurface>(VK_NULL_HANDLE, VK_NULL_HANDLE));
+        auto &child = children.back();
+        std::string name = "PipelineBenchmark" + std::to_string(i);
+        if (!child->init(root.get(), name.c_str(), cache)) {
+            return EXIT_FAILURE;
+        }
+        child->resize(bufferSize, bufferSize);
+        child->setPosition(i % columns * bufferSize, i / columns * bufferSize);
+        child->setAnimationDelta(1.0f + i % 4 * 0.5f);
+        child->setPresentMode(presentMode);
+    }
+
+    size_t peakBufferBytes = 0;
+    auto drawFrame = [&children, &peakBufferBytes] {
+        // A frame is done once every surface drew, a surface without a free buffer tries again
+        // after the compositor had a chance to release one.
+        for (auto &child: children) {
+            const auto &skippedFrames = child->bufferStats().skippedFrames;
+            while (child->needsRedraw()) {
+                uint64_t skipped = skippedFrames.load(std::memory_order_relaxed);
+                child->draw();
+                if (skippedFrames.load(std::memory_order_relaxed) == skipped) {
+                    break;
+                }
+                std::this_thread::sleep_for(kRetryInterval);
+            }
+        }
+        platform::Transaction *transaction = platform::createTransaction();
+        for (auto &child: children) {
+            child->applyChanges(transaction);
+        }
+        platform::applyTransaction(transaction);
+        platform::deleteTransaction(transaction);
+        peakBufferBytes = std::max(peakBufferBytes, bufferBytes());
+    };
+
+    auto resizePending = [&children] {
+        for (auto &child: children) {
+            if (child->isResizePending()) {
+                return true;
+            }
+        }
+        return false;
+    };
+    for (int i = 0; i < kWarmUpFrames || resizePending(); i++) {
+        drawFrame();
+    }
+    glFinish();
+
+    auto counters = [&children] {
+        FrameCounters counters;
+        for (const auto &child: children) {
+            const auto &stats = child->bufferStats();
+            counters.skipped += stats.skippedFrames.load(std::memory_order_relaxed);
+            counters.dropped += stats.droppedFrames.load(std::memory_order_relaxed);
+            counters.throttled += stats.throttledFrames.load(std::memory_order_relaxed);
+        }
+        return counters;
+    };
+
+    FrameCounters before = counters();
+    LatencyHistogram frameTimes;
+    auto start = std::chrono::steady_clock::now();
+    auto frameStart = start;
+    allocation_counter::start();
+    for (int i = 0; i < frames; i++) {
+        drawFrame();
+        auto frameEnd = std::chrono::steady_clock::now();
+        frameTimes.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                frameEnd - frameStart).count());
+        frameStart = frameEnd;
+    }
+    allocation_counter::stop();
+    // Frames still in flight count towards the total time.
+    glFinish();
+    double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    FrameCounters after = counters();
+
+    std::printf("{\n"
+                "  \"surfaces\": %d,\n"
+                "  \"buffer_size\": %d,\n"
+                "  \"frames\": %d,\n"
+                "  \"present_mode\": \"%s\",\n"
+                "  \"compositor_period_us\": %d,\n"
+                "  \"fps\": %.2f,\n"
+                "  \"frame_time_ms\": {\"p50\": %.3f, \"p95\": %.3f, \"p99\": %.3f, "
+                "\"max\": %.3f},\n"
+                "  \"allocations_per_frame\": %.3f,\n"
+                "  \"peak_buffer_bytes\": %zu,\n"
+                "  \"skipped_frames\": %llu,\n"
+                "  \"dropped_frames\": %llu,\n"
+                "  \"throttled_frames\": %llu\n"
+                "}\n",
+                surfaceCount, bufferSize, frames, presentModeName, compositorPeriodMicros,
+                frames / seconds, frameTimes.percentile(50) / 1e6,
+                frameTimes.percentile(95) / 1e6, frameTimes.percentile(99) / 1e6,
+                frameTimes.summary().max / 1e6,
+                static_cast<double>(allocation_counter::count()) / frames, peakBufferBytes,
+                static_cast<unsigned long long>(after.skipped - before.skipped),
+                static_cast<unsigned long long>(after.dropped - before.dropped),
+                static_cast<unsigned long long>(after.throttled - before.throttled));
+
+    children.clear();
+    GLFence::TrimPool();
+    BufferPool::Get().clear();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Runs a producer that draws several frames per refresh against a compositor that latches one
+// image per refresh and releases the previous one, and compares produce->present latency and the
+// frames each BufferQueue::PresentMode drops or throttles.
+//
+// Usage: presentmode_benchmark [refreshes] [frames per refresh]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "BufferQueue.h"
+#include "HeadlessEGL.h"
+
+namespace {
+
+constexpr std::chrono::milliseconds kRefreshPeriod(8);
+constexpr std::chrono::microseconds kPollInterval(100);
+
+void run(const char *name, BufferQueue::PresentMode mode, int refreshes, int framesPerRefresh) {
+    BufferQueue queue(VK_NULL_HANDLE);
+    queue.resize(64, 64);
+    queue.setPresentMode(mode);
+    auto drawTime = kRefreshPeriod / framesPerRefresh;
+
+    std::atomic<bool> stop{false};
+    uint64_t produced = 0;
+    std::thread producer([&] {
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (!queue.produceImage()) {
+                std::this_thread::sleep_for(kPollInterval);
+                continue;
+            }
+            std::this_thread::sleep_for(drawTime);
+            queue.enqueueProducedImage(nullptr);
+            produced++;
+        }
+    });
+
+    // The image on screen, released once the next one is latched.
+    bool latched = false;
+    uint32_t latchedGeneration = 0;
+    uint64_t presented = 0;
+    auto refresh = std::chrono::steady_clock::now();
+    for (int i = 0; i < refreshes; i++) {
+        refresh += kRefreshPeriod;
+        std::this_thread::sleep_until(refresh);
+        const auto *image = queue.presentImage();
+        if (!image) {
+            continue;
+        }
+        if (latched) {
+            queue.releasePresentImage(latchedGeneration, -1);
+        }
+        latched = true;
+        latchedGeneration = image->generation;
+        presented++;
+    }
+    stop.store(true, std::memory_order_relaxed);
+    producer.join();
+
+    const auto &stats = queue.stats();
+    auto latency = stats.produceToPresent.summary();
+    std::printf("%-12s %6llu produced %6llu presented %6llu dropped %8llu throttled   "
+                "produce->present p50 %6.2f ms p99 %6.2f ms\n", name,
+                static_cast<unsigned long long>(produced),
+                static_cast<unsigned long long>(presented),
+                static_cast<unsigned long long>(stats.droppedFrames.load()),
+                static_cast<unsigned long long>(stats.throttledFrames.load()),
+                latency.p50 / 1e6, latency.p99 / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int refreshes = argc > 1 ? std::atoi(argv[1]) : 250;
+    int framesPerRefresh = argc > 2 ? std::atoi(argv[2]) : 4;
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    run("fifo", BufferQueue::PresentMode::FIFO, refreshes, framesPerRefresh);
+    run("mailbox", BufferQueue::PresentMode::MAILBOX, refreshes, framesPerRefresh);
+    run("latest-only", BufferQueue::PresentMode::LATEST_ONLY, refreshes, framesPerRefresh);
+    return EXIT_SUCCESS;
+}
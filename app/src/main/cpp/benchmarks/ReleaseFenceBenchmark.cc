@@ -0,0 +1,134 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Releases images with fences that signal after random delays, out of release order like a
+// compositor reading buffers on several hardware planes, and reports how produceImage() picks
+// images: how often it took one ahead of ring order, how long it blocked and how often it gave up
+// and left the wait to the GPU. Pipe read ends stand in for sync_file fds, both poll readable once
+// signaled. Fence fds that time out cannot be imported on host and log an error.
+//
+// Usage: releasefence_benchmark [frames] [max fence delay in microseconds]
+
+#include <unistd.h>
+
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "BufferQueue.h"
+#include "HeadlessEGL.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Signals pipe fences at their deadlines.
+class FenceSignaler {
+public:
+    FenceSignaler() : mThread([this] { run(); }) {}
+
+    ~FenceSignaler() {
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStop = true;
+            mCondition.notify_one();
+        }
+        mThread.join();
+    }
+
+    // Returns the fence fd, readable once |delay| passed.
+    int createFence(std::chrono::microseconds delay) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            return -1;
+        }
+        std::unique_lock<std::mutex> lock(mMutex);
+        mPending.emplace(Clock::now() + delay, fds[1]);
+        mCondition.notify_one();
+        return fds[0];
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStop || !mPending.empty()) {
+            if (mPending.empty()) {
+                mCondition.wait(lock);
+                continue;
+            }
+            auto next = mPending.begin();
+            if (!mStop && next->first > Clock::now()) {
+                mCondition.wait_until(lock, next->first);
+                continue;
+            }
+            char signal = 1;
+            (void) !write(next->second, &signal, 1);
+            close(next->second);
+            mPending.erase(next);
+        }
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::multimap<Clock::time_point, int> mPending;
+    bool mStop = false;
+    std::thread mThread;
+};
+
+void run(std::chrono::microseconds timeout, int frames, int maxDelayMicros) {
+    BufferQueue queue(VK_NULL_HANDLE);
+    queue.setBufferCountRange(4, 4);
+    queue.setFenceWaitTimeout(timeout);
+    queue.resize(64, 64);
+
+    FenceSignaler signaler;
+    std::mt19937 random(1);
+    std::uniform_int_distribution<int> delay(0, maxDelayMicros);
+    auto start = Clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+        if (!queue.produceImage()) {
+            continue;
+        }
+        queue.enqueueProducedImage(nullptr);
+        const auto *image = queue.presentImage();
+        queue.releasePresentImage(image->generation,
+                                  signaler.createFence(std::chrono::microseconds(delay(random))));
+    }
+    double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    const auto &stats = queue.stats();
+    auto wait = stats.fenceWait.summary();
+    std::printf("timeout %5lld us: %7.1f ms for %d frames, %5llu reordered, %5llu waits "
+                "p50 %6.3f ms p99 %6.3f ms, %4llu timeouts, %4llu skipped\n",
+                static_cast<long long>(timeout.count()), elapsed, frames,
+                static_cast<unsigned long long>(stats.reorderedImages.load()),
+                static_cast<unsigned long long>(wait.count), wait.p50 / 1e6, wait.p99 / 1e6,
+                static_cast<unsigned long long>(stats.fenceTimeouts.load()),
+                static_cast<unsigned long long>(stats.skippedFrames.load()));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int maxDelayMicros = argc > 2 ? std::atoi(argv[2]) : 2000;
+
+    // Fences signaled after their image was picked are closed already.
+    std::signal(SIGPIPE, SIG_IGN);
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    for (auto timeout: {250, 1000, 4000}) {
+        run(std::chrono::microseconds(timeout), frames, maxDelayMicros);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Holds a compositor release of a retired ring's image right after its generation check, then has
+// a synchronous BufferQueue::resize() rebuild that ring, and fails if the resize finishes while the
+// release is still on its way to the ring: the release would then land in the rebuilt one.
+// Afterwards the ring must still hand out and take back every image. Runs as part of the host
+// build.
+//
+// Usage: release_resize_check [iterations]
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+#include "BufferPool.h"
+#include "BufferQueue.h"
+#include "HeadlessEGL.h"
+
+namespace {
+
+constexpr int kSizes[] = {64, 96, 128};
+// Long enough for an unprotected resize to finish while the release is held.
+constexpr std::chrono::milliseconds kHoldTime(20);
+
+// Shared with the release hook, which takes no arguments.
+struct HeldRelease {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool held = false;
+    bool resized = false;
+    bool resizedWhileHeld = false;
+};
+HeldRelease sHeldRelease;
+
+void holdRelease() {
+    auto &state = sHeldRelease;
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.held = true;
+    state.condition.notify_all();
+    // A resize that waits for the release never gets here in time, the hold just times out.
+    state.resizedWhileHeld =
+            state.condition.wait_for(lock, kHoldTime, [&state] { return state.resized; });
+}
+
+bool cycleImages(BufferQueue &queue) {
+    for (int i = 0; i < queue.bufferCount() * 2; i++) {
+        const auto *image = queue.produceImage();
+        if (!image) {
+            return false;
+        }
+        queue.enqueueProducedImage(nullptr);
+        const auto *presented = queue.presentImage();
+        if (presented != image) {
+            return false;
+        }
+        queue.releasePresentImage(presented->generation, -1);
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20;
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    {
+        BufferQueue queue(VK_NULL_HANDLE);
+        queue.setBufferCountRange(3, 3);
+        queue.resize(kSizes[0], kSizes[0]);
+        for (int i = 0; i < iterations; i++) {
+            // An image of this ring stays with the compositor across the resize, which retires
+            // the ring.
+            if (!queue.produceImage()) {
+                failures++;
+                break;
+            }
+            queue.enqueueProducedImage(nullptr);
+            uint32_t lateGeneration = queue.presentImage()->generation;
+            queue.resize(kSizes[(i * 2 + 1) % std::size(kSizes)],
+                         kSizes[(i * 2 + 1) % std::size(kSizes)]);
+
+            // The next resize reuses the retired ring while its release is held.
+            sHeldRelease.held = false;
+            sHeldRelease.resized = false;
+            BufferQueue::SetReleaseHookForTesting(holdRelease);
+            std::thread compositor([&queue, lateGeneration] {
+                queue.releasePresentImage(lateGeneration, -1);
+            });
+            {
+                std::unique_lock<std::mutex> lock(sHeldRelease.mutex);
+                sHeldRelease.condition.wait(lock, [] { return sHeldRelease.held; });
+            }
+            queue.resize(kSizes[(i * 2 + 2) % std::size(kSizes)],
+                         kSizes[(i * 2 + 2) % std::size(kSizes)]);
+            {
+                std::unique_lock<std::mutex> lock(sHeldRelease.mutex);
+                sHeldRelease.resized = true;
+                sHeldRelease.condition.notify_all();
+            }
+            compositor.join();
+            BufferQueue::SetReleaseHookForTesting(nullptr);
+
+            if (sHeldRelease.resizedWhileHeld || !cycleImages(queue)) {
+                failures++;
+            }
+        }
+    }
+    BufferPool::Get().clear();
+
+    std::printf("%d late releases racing a resize, %d failures\n", iterations, failures);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,106 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Draws a frame into a BufferQueue every iteration and resizes it every few frames, cycling
+// through sizes BufferPool does not keep, so every resize has to allocate. Compares the frame
+// times of resize(), which allocates on the drawing thread, with resizeAsync(), which keeps
+// drawing at the old size until the background allocation is done.
+//
+// Usage: resize_benchmark [frames] [frames per resize]
+
+#include <GLES3/gl3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "BufferPool.h"
+#include "BufferQueue.h"
+#include "GLFence.h"
+#include "HeadlessEGL.h"
+
+namespace {
+
+constexpr int kSizes[][2] = {{1080, 1200}, {1200, 1080}, {960, 960}, {720, 1280}};
+
+struct Result {
+    double averageMillis = 0;
+    double p99Millis = 0;
+    double maxMillis = 0;
+    int framesAtOldSize = 0;
+};
+
+Result run(bool async, int frames, int framesPerResize) {
+    BufferQueue queue(VK_NULL_HANDLE);
+    queue.resize(kSizes[0][0], kSizes[0][1]);
+    int targetWidth = kSizes[0][0];
+
+    std::vector<double> times;
+    Result result;
+    for (int frame = 1; frame <= frames; frame++) {
+        auto start = std::chrono::steady_clock::now();
+        if (frame % framesPerResize == 0) {
+            const auto &size = kSizes[(frame / framesPerResize) % std::size(kSizes)];
+            targetWidth = size[0];
+            if (async) {
+                queue.resizeAsync(size[0], size[1]);
+            } else {
+                queue.resize(size[0], size[1]);
+            }
+        }
+        queue.updateSize();
+        if (queue.width() != targetWidth) {
+            result.framesAtOldSize++;
+        }
+        if (const auto *image = queue.produceImage()) {
+            glBindFramebuffer(GL_FRAMEBUFFER, image->framebuffer);
+            glViewport(0, 0, queue.width(), queue.height());
+            glClearColor(frame % 2, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            queue.enqueueProducedImage(GLFence::Create());
+            const auto *presented = queue.presentImage();
+            glFinish();
+            queue.releasePresentImage(presented->generation, -1);
+        }
+        times.push_back(std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::sort(times.begin(), times.end());
+    for (double time: times) {
+        result.averageMillis += time / times.size();
+    }
+    result.p99Millis = times[times.size() * 99 / 100];
+    result.maxMillis = times.back();
+    return result;
+}
+
+void print(const char *name, const Result &result) {
+    std::printf("%-14s avg %6.2f ms  p99 %6.2f ms  max %6.2f ms  %4d frames at the old size\n",
+                name, result.averageMillis, result.p99Millis, result.maxMillis,
+                result.framesAtOldSize);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 400;
+    int framesPerResize = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    HeadlessEGL egl;
+    if (!egl.isValid()) {
+        return EXIT_FAILURE;
+    }
+    // Every resize allocates.
+    BufferPool::Get().setMemoryCap(0);
+
+    print("resize()", run(false, frames, framesPerResize));
+    print("resizeAsync()", run(true, frames, framesPerResize));
+
+    BufferPool::Get().clear();
+    GLFence::TrimPool();
+    return EXIT_SUCCESS;
+}
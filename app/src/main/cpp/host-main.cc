@@ -0,0 +1,112 @@
+//
+// Created by huang on 2026-10-16.
+//
+
+// Host counterpart of native-lib.cpp: drives HelloSurfaceControl against the in-process compositor
+// the same way MainActivity's SurfaceHolder callbacks do on device.
+//
+// Usage: hellosurfacecontrol_host [seconds] [render workers] [idle after seconds] [trace file]
+//                                [gpu timing] [scene file]
+// Animations stop after the given number of seconds, after which the render thread goes idle. With
+// a trace file, buffer transitions are recorded and written there as Chrome trace JSON. A non-zero
+// gpu timing argument reports each child's CPU encode and GPU draw times. The children are laid out
+// as the scene file describes, see Scene.h and scenes/, or as the default scene without one.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "HelloSurfaceControl.h"
+#include "Log.h"
+#include "Platform.h"
+
+#define LOG_TAG "SurfaceControlApp"
+
+constexpr int kWindowWidth = 1080;
+constexpr int kWindowHeight = 2400;
+constexpr int kRGBA8888 = 1;
+
+int main(int argc, char **argv) {
+    int seconds = argc > 1 ? std::atoi(argv[1]) : 5;
+    int renderWorkers = argc > 2 ? std::atoi(argv[2]) : 0;
+    int idleAfterSeconds = argc > 3 ? std::atoi(argv[3]) : seconds;
+    const char *traceFile = argc > 4 && argv[4][0] != '\0' ? argv[4] : nullptr;
+    bool gpuTiming = argc > 5 && std::atoi(argv[5]) != 0;
+    std::string scenePath = argc > 6 ? argv[6] : "";
+
+    auto helloSurfaceControl = std::make_unique<HelloSurfaceControl>(renderWorkers);
+    helloSurfaceControl->setTracingEnabled(traceFile != nullptr);
+    helloSurfaceControl->setGpuTimingEnabled(gpuTiming);
+    if (!helloSurfaceControl->init(platform::createHostWindow(kWindowWidth, kWindowHeight),
+                                   std::filesystem::temp_directory_path().string(),
+                                   scenePath)) {
+        LOGE("Failed to init HelloSurfaceControl");
+        return EXIT_FAILURE;
+    }
+    helloSurfaceControl->update(kRGBA8888, kWindowWidth, kWindowHeight);
+
+    std::this_thread::sleep_for(std::chrono::seconds(std::min(idleAfterSeconds, seconds)));
+    if (idleAfterSeconds < seconds) {
+        helloSurfaceControl->setAnimating(false);
+        auto frames = helloSurfaceControl->getFrameStats().frames;
+        std::this_thread::sleep_for(std::chrono::seconds(seconds - idleAfterSeconds));
+        LOGD("%llu frames drawn while idle",
+             static_cast<unsigned long long>(helloSurfaceControl->getFrameStats().frames - frames));
+    }
+
+    auto frameStats = helloSurfaceControl->getFrameStats();
+    LOGD("%llu frames: %llu deadlines hit, %llu missed, %llu vsyncs dropped",
+         static_cast<unsigned long long>(frameStats.frames),
+         static_cast<unsigned long long>(frameStats.deadlinesHit),
+         static_cast<unsigned long long>(frameStats.deadlinesMissed),
+         static_cast<unsigned long long>(frameStats.vsyncsDropped));
+    auto latencies = helloSurfaceControl->getSurfaceLatencies();
+    for (size_t i = 0; i < latencies.size(); i++) {
+        const auto &latency = latencies[i];
+        LOGD("child %zu: %llu frames, produce->present p50=%.2fms p99=%.2fms, present->release "
+             "p50=%.2fms p99=%.2fms, starved %llu times, %llu dropped, %llu throttled, %d buffers, "
+             "%llu skipped, release fence wait p99=%.2fms",
+             i, static_cast<unsigned long long>(latency.produceToPresent.count),
+             latency.produceToPresent.p50 / 1e6, latency.produceToPresent.p99 / 1e6,
+             latency.presentToRelease.p50 / 1e6, latency.presentToRelease.p99 / 1e6,
+             static_cast<unsigned long long>(latency.starved.count),
+             static_cast<unsigned long long>(latency.droppedFrames),
+             static_cast<unsigned long long>(latency.throttledFrames), latency.bufferCount,
+             static_cast<unsigned long long>(latency.skippedFrames), latency.fenceWait.p99 / 1e6);
+        if (latency.resolutionScale < 1.0f) {
+            LOGD("child %zu: rendering at %.2f of its size, gpu recent=%.3fms", i,
+                 latency.resolutionScale, latency.recentGpuTime / 1e6);
+        }
+        if (gpuTiming) {
+            LOGD("child %zu: cpu encode p50=%.3fms p99=%.3fms recent=%.3fms, gpu p50=%.3fms "
+                 "p99=%.3fms recent=%.3fms over %llu draws",
+                 i, latency.cpuEncode.p50 / 1e6, latency.cpuEncode.p99 / 1e6,
+                 latency.recentCpuEncode / 1e6, latency.gpuTime.p50 / 1e6,
+                 latency.gpuTime.p99 / 1e6, latency.recentGpuTime / 1e6,
+                 static_cast<unsigned long long>(latency.gpuTime.count));
+        }
+    }
+    auto depthStencil = helloSurfaceControl->getDepthStencilUsage();
+    LOGD("depth/stencil: %d shared renderbuffers, %zu bytes instead of %zu for %d children, "
+         "%zu bytes not allocated without depth test, %.1f MB of tile traffic avoided",
+         depthStencil.shared.renderbuffers, depthStencil.shared.bytes,
+         depthStencil.shared.unsharedBytes, depthStencil.shared.users,
+         depthStencil.skippedBytes, depthStencil.trafficAvoided / 1e6);
+    auto atlasMemory = helloSurfaceControl->getAtlasMemory();
+    for (size_t i = 0; i < atlasMemory.size(); i++) {
+        const auto &memory = atlasMemory[i];
+        LOGD("atlas %zu: %dx%d, %d buffers, %zu bytes in %d allocations instead of %zu bytes in "
+             "%d", i, memory.width, memory.height, memory.bufferCount, memory.atlasBytes,
+             memory.atlasAllocations, memory.separateBytes, memory.separateAllocations);
+    }
+    if (traceFile && !helloSurfaceControl->dumpTrace(traceFile)) {
+        LOGE("Failed to write %s", traceFile);
+    }
+
+    helloSurfaceControl = nullptr;
+    return EXIT_SUCCESS;
+}
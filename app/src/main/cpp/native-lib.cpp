@@ -14,7 +14,8 @@ extern "C" JNIEXPORT void JNICALL
 Java_com_example_hellosurfacecontrol_MainActivity_nativeInitSurfaceControl(
         JNIEnv* env,
         jobject /* this */,
-        jobject surface) {
+        jobject surface,
+        jstring cacheDir) {
     assert(!gHelloSurfaceControl);
     gHelloSurfaceControl = std::make_unique<HelloSurfaceControl>();
 
@@ -24,7 +25,12 @@ Java_com_example_hellosurfacecontrol_MainActivity_nativeInitSurfaceControl(
         return;
     }
 
-    if (!gHelloSurfaceControl->init(window)) {
+    const char* cacheDirChars = env->GetStringUTFChars(cacheDir, nullptr);
+    std::string cacheDirString(cacheDirChars);
+    env->ReleaseStringUTFChars(cacheDir, cacheDirChars);
+
+    if (!gHelloSurfaceControl->init(platform::windowFromANativeWindow(window),
+                                    std::move(cacheDirString))) {
         LOGE("Failed to init HelloSurfaceControl");
         return;
     }
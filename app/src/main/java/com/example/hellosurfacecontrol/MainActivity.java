@@ -13,7 +13,7 @@ public class MainActivity extends AppCompatActivity {
         System.loadLibrary("hellosurfacecontrol");
     }
 
-    private native void nativeInitSurfaceControl(Surface surface);
+    private native void nativeInitSurfaceControl(Surface surface, String cacheDir);
 
     private native void nativeUpdateSurfaceControl(Surface surface, int format, int width, int height);
     private native void nativeDestroySurfaceControl(Surface surface);
@@ -28,7 +28,8 @@ public class MainActivity extends AppCompatActivity {
         surfaceView.getHolder().addCallback(new SurfaceHolder.Callback() {
             @Override
             public void surfaceCreated(@NonNull SurfaceHolder holder) {
-                nativeInitSurfaceControl(holder.getSurface());
+                nativeInitSurfaceControl(holder.getSurface(),
+                        getCodeCacheDir().getAbsolutePath());
             }
 
             @Override